@@ -7,11 +7,13 @@ mkdir -p build/shaders
 # 复制GLSL文件
 cp src/shaders/*.glsl build/shaders/
 
-# 编译到SPIR-V
+# 编译到SPIR-V（输出为 C 数组头文件，由 VkDisplay.cpp 嵌入程序）
 cd build/shaders
 echo "Compiling vertex shader..."
-glslangValidator -V -S vert vert.glsl -o vert.spv
+glslangValidator -V -S vert --vn vert_spv vert.glsl -o vert.spv.h
 echo "Compiling fragment shader..."
-glslangValidator -V -S frag frag.glsl -o frag.spv
+glslangValidator -V -S frag --vn frag_spv frag.glsl -o frag.spv.h
+echo "Compiling compute shader..."
+glslangValidator -V -S comp --vn expand_spv expand.glsl -o expand.spv.h
 
 echo "Shader compilation completed!"
@@ -1,26 +1,353 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
 #include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
 #include "./src/endo_viewer.h"
 #include "./src/inc/VkDisplay.h"
+#include "./src/inc/stream_layout.h"
+#include "./src/inc/stereo_sync.h"
+#include "./src/inc/present_scheduler.h"
 
-void testVulkan() {
-    printf("================ Vulkan Backend Test ================\n");
-    printf("Vulkan backend test skipped - implementation in progress.\n");
+// Vulkan 离屏基准测试的选项：选择 VkDisplay 的上传路径，与默认的拷贝路径对比
+struct VulkanBenchmarkOptions {
+    int frames = 300;
+    bool gpuExpand = false;     // gpu-expand：上传打包 RGB，由计算着色器展开为 RGBA
+    bool planar = false;        // planar：上传 YUV422P，由片段着色器转换为 RGB
+    bool linear = false;        // linear：CPU 直接写入主机可见的线性纹理
+    bool decodeTargets = false; // decode-targets：图像写在 createDecodeTargets 分配的解码目标中，只交接指针
+    bool hostImport = true;     // no-host-import：解码目标不导入主机内存，使用主机可见的设备内存
+};
+
+// 合成一幅纯色图像：打包 RGB / RGBX（每行 pitch 字节），或按全范围 BT.601 转换的 YUV422P（Y 平面每行 pitch 字节）
+static void fillImage(unsigned char* image, PixelFormat format, uint32_t pitch, int width, int height,
+                      const unsigned char rgb[3]) {
+    if (format == PixelFormat::YUV422P) {
+        const double r = rgb[0], g = rgb[1], b = rgb[2];
+        const double yuv[3] = {0.299 * r + 0.587 * g + 0.114 * b,
+                               128 - 0.168736 * r - 0.331264 * g + 0.5 * b,
+                               128 + 0.5 * r - 0.418688 * g - 0.081312 * b};
+        for (unsigned int p = 0; p < 3; p++) {
+            unsigned char value = static_cast<unsigned char>(std::min(std::max(std::lround(yuv[p]), 0L), 255L));
+            uint32_t rowPitch = p == 0 ? pitch : pitch / 2;
+            size_t columns = p == 0 ? width : (width + 1) / 2;
+            for (int y = 0; y < height; y++) {
+                memset(image + planeOffset(pitch, height, p) + static_cast<size_t>(rowPitch) * y, value, columns);
+            }
+        }
+        return;
+    }
+    const size_t bytesPerPixel = format == PixelFormat::RGB ? 3 : 4;
+    for (int y = 0; y < height; y++) {
+        unsigned char* row = image + static_cast<size_t>(pitch) * y;
+        for (int x = 0; x < width; x++) {
+            unsigned char* pixel = row + x * bytesPerPixel;
+            pixel[0] = rgb[0];
+            pixel[1] = rgb[1];
+            pixel[2] = rgb[2];
+            if (bytesPerPixel == 4) {
+                pixel[3] = 255;
+            }
+        }
+    }
+}
+
+// Vulkan 离屏基准测试：不需要显示器和相机（没有 GPU 的机器上可用 lavapipe），
+// 每路流上传一幅合成的纯色图像并绘制，统计每帧耗时，最后回读图像检查每路流格子中心的颜色
+int testVulkan(const VulkanBenchmarkOptions& options) {
+    printf("================ Vulkan Backend Test (headless) ================\n");
+
+    const int streamCount = 2;
+    const int imageWidth = 1920;
+    const int imageHeight = 1080;
+    VkDisplay display;
+    display.setHeadless(true, true);
+    display.setGpuColorExpansion(options.gpuExpand);
+    display.setPlanarYuv(options.planar);
+    display.setLinearTextures(options.linear);
+    display.setHostMemoryImport(options.hostImport);
+    if (!display.init(1920, 540, "Endoscope Viewer - Vulkan headless", streamCount)) {
+        printf("Vulkan headless init failed\n");
+        return 1;
+    }
+
+    // 设备不支持所选路径时 init 已退回拷贝路径：照常运行，但结果不能算作所选路径的，返回失败
+    const char* path = display.hasPlanarYuv() ? "planar YUV" : display.hasGpuColorExpansion() ? "GPU color expansion"
+                     : display.hasLinearTextures() ? "linear textures" : "copy";
+    bool fellBack = (options.planar && !display.hasPlanarYuv()) ||
+                    (options.gpuExpand && !options.planar && !display.hasGpuColorExpansion()) ||
+                    (options.linear && !display.hasLinearTextures());
+    printf("Vulkan headless: upload path %s%s\n", path, fellBack ? " (requested path not supported)" : "");
+
+    // 解码器输出的图像（打包 RGB，平面 YUV 路径为行距 planarPitch 的 YUV422P），每路流一种颜色
+    const unsigned char colors[streamCount][3] = {{200, 120, 40}, {10, 60, 220}};
+    const PixelFormat format = display.hasPlanarYuv() ? PixelFormat::YUV422P : PixelFormat::RGB;
+    const uint32_t pitch = display.hasPlanarYuv() ? planarPitch(imageWidth) : imageWidth * 3;
+    std::vector<std::vector<unsigned char>> images(streamCount);
+    std::vector<const unsigned char*> streams(streamCount);
+    for (int i = 0; i < streamCount; i++) {
+        images[i].resize(frameBytes(format, pitch, imageHeight));
+        fillImage(images[i].data(), format, pitch, imageWidth, imageHeight, colors[i]);
+        streams[i] = images[i].data();
+    }
+
+    // 解码目标：每路流 TARGET_COUNT 块（相当于 V4L2 缓冲区），按渲染器要求的格式和行距写入合成图像，
+    // 逐帧轮换使用并把持有者交给 updateVideo（与 EndoViewer 交接解码帧相同）；
+    // 轮换回来时该块应已被渲染器释放（GPU 拷贝完成），否则解码器会覆盖正在拷贝的图像
+    const uint32_t TARGET_COUNT = 4;
+    std::vector<std::vector<unsigned char*>> targets(streamCount);
+    std::vector<std::vector<std::weak_ptr<const void>>> targetOwners(streamCount);
+    std::vector<std::shared_ptr<const void>> owners(streamCount);
+    uint64_t busyTargets = 0;
+    if (options.decodeTargets) {
+        for (int i = 0; i < streamCount; i++) {
+            uint32_t targetPitch = 0;
+            PixelFormat targetFormat = PixelFormat::RGBX;
+            targets[i] = display.createDecodeTargets(i, TARGET_COUNT, targetPitch, targetFormat);
+            if (targets[i].empty()) {
+                // 线性纹理没有解码目标；分配失败时同样退回暂存缓冲区
+                printf("Vulkan headless: stream %d has no decode targets, frames go through the staging buffer\n", i);
+                fellBack = true;
+                continue;
+            }
+            printf("Vulkan headless: stream %d decode targets in %s (pitch %u)\n", i,
+                   display.decodeTargetsImported(i) ? "imported host memory" : "host visible device memory",
+                   targetPitch);
+            if (options.hostImport && !display.decodeTargetsImported(i)) {
+                printf("Vulkan headless: host memory import not available, using the fallback\n");
+            }
+            for (unsigned char* target : targets[i]) {
+                fillImage(target, targetFormat, targetPitch, imageWidth, imageHeight, colors[i]);
+            }
+            targetOwners[i].resize(TARGET_COUNT);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int drawn = 0;
+    for (int f = 0; f < options.frames; f++) {
+        for (int i = 0; i < streamCount; i++) {
+            if (targets[i].empty()) {
+                continue;
+            }
+            const uint32_t k = static_cast<uint32_t>(f) % TARGET_COUNT;
+            busyTargets += targetOwners[i][k].expired() ? 0 : 1;
+            owners[i] = std::shared_ptr<const void>(targets[i][k], [](const void*) {});
+            targetOwners[i][k] = owners[i];
+            streams[i] = targets[i][k];
+        }
+        display.updateVideo(streams, imageWidth, imageHeight, owners);
+        // 只有渲染器继续持有本帧的解码目标
+        for (auto& owner : owners) {
+            owner.reset();
+        }
+        drawn += display.draw() ? 1 : 0;
+    }
+    std::vector<unsigned char> pixels;
+    uint32_t width = 0, height = 0;
+    bool readOk = display.readback(pixels, width, height);  // 等待最后一帧完成
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("Vulkan headless: %d frames in %.1f ms (%.3f ms/frame, %.1f fps)\n",
+           drawn, totalMs, totalMs / std::max(drawn, 1), drawn * 1000.0 / totalMs);
+
+    if (!readOk) {
+        printf("Vulkan headless: readback failed\n");
+        return 1;
+    }
+    if (options.decodeTargets) {
+        printf("Vulkan headless: %lu decode target(s) still held by the renderer when reused\n",
+               static_cast<unsigned long>(busyTargets));
+    }
+
+    // 回读为 BGRA；纯色纹理的线性采样结果与输入一致（允许 ±2 的舍入误差，平面 YUV 含 YCbCr 的量化误差）
+    int failures = 0;
+    for (int i = 0; i < streamCount; i++) {
+        StreamCell cell = streamCell(i, streamCount, static_cast<int>(width), static_cast<int>(height));
+        const unsigned char* pixel = &pixels[(static_cast<size_t>(cell.y + cell.height / 2) * width +
+                                              cell.x + cell.width / 2) * 4];
+        bool match = std::abs(pixel[2] - colors[i][0]) <= 2 &&
+                     std::abs(pixel[1] - colors[i][1]) <= 2 &&
+                     std::abs(pixel[0] - colors[i][2]) <= 2;
+        printf("  stream %d: RGB (%d, %d, %d), expected (%d, %d, %d) %s\n", i,
+               pixel[2], pixel[1], pixel[0], colors[i][0], colors[i][1], colors[i][2], match ? "OK" : "MISMATCH");
+        failures += match ? 0 : 1;
+    }
+    return failures == 0 && busyTargets == 0 && !fellBack ? 0 : 1;
+}
+
+// 双目配对回放：文件每行一帧 "<眼 0/1> <采集时间 us>"（按解码完成的顺序），
+// 逐帧送入 StereoSync，打印配对结果与最终统计，不需要相机即可检查配对窗口与漂移估计
+int replayStereo(const char* path, uint64_t window_us) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("Stereo replay: can not open %s\n", path);
+        return 1;
+    }
+    StereoSync<uint64_t>::Config config;
+    config.window_us = window_us;
+    StereoSync<uint64_t> sync(config);
+
+    int eye = 0;
+    unsigned long long timestamp = 0;
+    uint64_t out[2];
+    while (fscanf(file, "%d %llu", &eye, &timestamp) == 2) {
+        if (eye != 0 && eye != 1) {
+            continue;
+        }
+        StereoSync<uint64_t>::Result result = sync.push(eye, timestamp, timestamp, out);
+        if (result == StereoSync<uint64_t>::PAIR) {
+            printf("PAIR   L=%llu R=%llu dt=%lld us\n", (unsigned long long)out[0], (unsigned long long)out[1],
+                   (long long)out[1] - (long long)out[0]);
+        } else if (result == StereoSync<uint64_t>::SINGLE) {
+            printf("SINGLE %c=%llu\n", eye == 0 ? 'L' : 'R', (unsigned long long)out[eye]);
+        }
+    }
+    fclose(file);
+
+    const StereoSync<uint64_t>::Stats& ss = sync.stats();
+    printf("Stereo replay: matched=%lu unmatched=%lu/%lu passed=%lu/%lu phase=%.0f us drift=%.1f ppm "
+           "period=%.0f/%.0f us\n",
+           ss.matched, ss.unmatched[0], ss.unmatched[1], ss.passed[0], ss.passed[1],
+           ss.phase_us, ss.drift_ppm, ss.period_us[0], ss.period_us[1]);
+    return 0;
+}
+
+// 提交调度模拟：在模拟时钟上运行 PresentScheduler，不需要显示器和相机。
+// 显示器以 refreshHz 刷新（呈现完成时间带 ±100us 抖动，标称刷新率取整数 Hz，与显示器模式一致），
+// 两路相机以 cameraFps 出帧（±300us 抖动），渲染按调度器给出的时间提交（GPU 耗时 1ms，FIFO 每个 VSync 一帧），
+// 检查测得的刷新周期是否收敛，并统计帧就绪到上屏的延迟
+int simulatePresent(double refreshHz, double cameraFps) {
+    printf("================ Present scheduler simulation ================\n");
+    const double period = 1e6 / refreshHz;
+    const double cameraPeriod = 1e6 / cameraFps;
+    const double vblankPhase = 1234.5;
+    const uint64_t renderUs = 1000;
+    const uint64_t durationUs = 20000000;
+    const int streamCount = 2;
+
+    PresentScheduler scheduler;
+    scheduler.setNominalPeriod(1e6 / std::round(refreshHz));
+    scheduler.setSubmitAhead(VkDisplay::SUBMIT_AHEAD_MS * 1000);
+
+    uint32_t seed = 12345;
+    auto jitter = [&seed](double amplitude) {
+        seed = seed * 1664525u + 1013904223u;
+        return (static_cast<double>(seed >> 8) / (1u << 24) * 2 - 1) * amplitude;
+    };
+    auto vblankAfter = [&](double t) {
+        return vblankPhase + std::ceil((t - vblankPhase) / period) * period;
+    };
+
+    double nextFrame[streamCount] = {cameraPeriod * 0.3, cameraPeriod * 0.55};
+    std::vector<uint64_t> completions;          // 呈现完成、还没交给调度器的时间
+    double lastVblank = 0;                      // 最近一帧上屏的 VSync
+    uint64_t now = 0, presents = 0, dropped = 0, latencySum = 0, latencyMax = 0;
+    while (now < durationUs) {
+        // 等待下一帧就绪
+        int stream = nextFrame[0] <= nextFrame[1] ? 0 : 1;
+        now = std::max(now, static_cast<uint64_t>(nextFrame[stream]));
+        uint64_t readyUs = now;
+        nextFrame[stream] += cameraPeriod + jitter(300);
+        for (uint64_t completeUs : completions) {
+            if (completeUs <= now) {
+                scheduler.onPresentComplete(completeUs);
+            }
+        }
+        completions.erase(std::remove_if(completions.begin(), completions.end(),
+                                         [now](uint64_t t) { return t <= now; }), completions.end());
+        scheduler.onFrameReady(stream, now);
+
+        // 截止前有更新的帧到达则改用最新帧
+        uint64_t submitUs = scheduler.submitTimeUs(now);
+        while (now < submitUs) {
+            stream = nextFrame[0] <= nextFrame[1] ? 0 : 1;
+            if (nextFrame[stream] >= static_cast<double>(submitUs)) {
+                now = submitUs;
+                break;
+            }
+            now = static_cast<uint64_t>(nextFrame[stream]);
+            readyUs = now;
+            nextFrame[stream] += cameraPeriod + jitter(300);
+            scheduler.onFrameReady(stream, now);
+            dropped++;
+            submitUs = scheduler.submitTimeUs(now);
+        }
+
+        // 提交：GPU 完成后的第一个空闲 VSync 上屏
+        scheduler.onSubmit(now);
+        double vblank = vblankAfter(static_cast<double>(now + renderUs));
+        if (vblank <= lastVblank + period / 2) {
+            vblank = lastVblank + period;
+        }
+        lastVblank = vblank;
+        completions.push_back(static_cast<uint64_t>(vblank + 50 + jitter(100)));
+        uint64_t latency = static_cast<uint64_t>(vblank) - readyUs;
+        latencySum += latency;
+        latencyMax = std::max(latencyMax, latency);
+        presents++;
+    }
+
+    const PresentScheduler::Stats& ps = scheduler.stats();
+    double errorPpm = (ps.period_us - period) / period * 1e6;
+    printf("refresh %.3f Hz, cameras %.3f fps: %lu presents, %lu frames replaced before submit\n",
+           refreshHz, cameraFps, presents, dropped);
+    printf("period %.3f us (true %.3f us, %+.0f ppm, %s), jitter %.0f us, samples %lu, rejected %lu, relocks %lu\n",
+           ps.period_us, period, errorPpm, ps.measured ? "measured" : "nominal",
+           ps.jitter_us, ps.samples, ps.rejected, ps.relocks);
+    printf("ready to scanout: avg %.0f us, max %lu us\n", presents > 0 ? double(latencySum) / presents : 0.0, latencyMax);
+    bool ok = ps.measured && std::fabs(errorPpm) < 1000;
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
 }
 
 int main(int argc, char* argv[])
 {
-    printf("================ Endoscope viewer startup (Simulation Mode with Real Image) ================\n");
+    // --vulkan-benchmark [帧数] [gpu-expand] [planar] [linear] [decode-targets] [no-host-import]：
+    // 只运行 Vulkan 离屏基准测试，可选的上传路径同 VkDisplay 的 setGpuColorExpansion / setPlanarYuv /
+    // setLinearTextures，decode-targets 时图像写在解码目标中（no-host-import 强制使用不导入主机内存的后备路径），
+    // 返回值表示所选路径可用且输出像素正确
+    if (argc > 1 && std::string(argv[1]) == "--vulkan-benchmark") {
+        VulkanBenchmarkOptions options;
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "gpu-expand") {
+                options.gpuExpand = true;
+            } else if (arg == "planar") {
+                options.planar = true;
+            } else if (arg == "linear") {
+                options.linear = true;
+            } else if (arg == "decode-targets") {
+                options.decodeTargets = true;
+            } else if (arg == "no-host-import") {
+                options.hostImport = false;
+            } else if (std::atoi(arg.c_str()) > 0) {
+                options.frames = std::atoi(arg.c_str());
+            } else {
+                printf("--vulkan-benchmark: unknown option %s\n", arg.c_str());
+                return 1;
+            }
+        }
+        return testVulkan(options);
+    }
+    // --present-sim [刷新率 Hz] [相机帧率]：在模拟时钟上检查提交调度，返回值表示刷新周期是否测准
+    if (argc > 1 && std::string(argv[1]) == "--present-sim") {
+        return simulatePresent(argc > 2 ? std::atof(argv[2]) : 164.998, argc > 3 ? std::atof(argv[3]) : 60.0);
+    }
+    // --stereo-replay <文件> [配对窗口 us]：回放记录的双目采集时间戳，检查配对
+    if (argc > 2 && std::string(argv[1]) == "--stereo-replay") {
+        return replayStereo(argv[2], argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 2000);
+    }
 
-    // Test Vulkan backend first
-    testVulkan();
+    printf("================ Endoscope viewer startup (Simulation Mode with Real Image) ================\n");
 
     // Then run original EndoViewer for OpenGL display mode
     EndoViewer endo_viewer;
-    endo_viewer.startup(4, 6, false);
-    // endo_viewer.startup(6, 7, false);
-    
+    endo_viewer.startup({4, 6}, false);
+    // endo_viewer.startup({6, 7}, false);
+
     return 0;
 }
-
-
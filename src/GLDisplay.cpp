@@ -4,9 +4,31 @@
 #include <stb_image.h>
 #include "efficiency_test.h"
 #include <cstdlib>
+#include <algorithm>
+#include "inc/stream_layout.h"
+#include "inc/mjpeg_decoder.h"
 
-GLDisplay::GLDisplay() : shaderProgram(0), VBO(0), EBO(0), windowWidth(0), windowHeight(0),
-    texLeftLocation(-1), texRightLocation(-1) {
+namespace {
+    // 检查并打印任何 GL 错误
+    void reportGLError(const char* where) {
+        GLenum err = glGetError();
+        if (err != GL_NO_ERROR) {
+            const char* errstr = "UNKNOWN";
+            switch (err) {
+                case GL_INVALID_ENUM: errstr = "GL_INVALID_ENUM"; break;
+                case GL_INVALID_VALUE: errstr = "GL_INVALID_VALUE"; break;
+                case GL_INVALID_OPERATION: errstr = "GL_INVALID_OPERATION"; break;
+                case GL_OUT_OF_MEMORY: errstr = "GL_OUT_OF_MEMORY"; break;
+                default: break;
+            }
+            fprintf(stderr, "GL error after %s: 0x%X (%s)\n", where, err, errstr);
+        }
+    }
+}
+
+GLDisplay::GLDisplay() : shaderProgram(0), VBO(0), EBO(0), streamCount(2), windowWidth(0), windowHeight(0),
+    framebufferWidth(0), framebufferHeight(0), texStreamLocation(-1), texCbLocation(-1), texCrLocation(-1),
+    planarYuvLocation(-1) {
     // 初始化帧追踪数组
     for (int i = 0; i < MAX_TRACKED_FRAMES; i++) {
         frame_fences[i] = nullptr;
@@ -17,14 +39,17 @@ GLDisplay::~GLDisplay() {
     cleanup();
 }
 
-bool GLDisplay::init(int width, int height, std::string title, int numWindows) {
+bool GLDisplay::init(int width, int height, std::string title, int numWindows, int streamCount) {
     windowWidth = width;
     windowHeight = height;
+    this->streamCount = std::max(streamCount, 1);
 
     // 初始化GLFW窗口系统
     if (!initGLFW(width, height, title, numWindows)) {
         return false;
     }
+    // 所有窗口尺寸相同，worker 线程按此尺寸逐路设置视口（glfwGetFramebufferSize 只能在主线程调用）
+    glfwGetFramebufferSize(windows[0], &framebufferWidth, &framebufferHeight);
 
     printf("VSync Enabled (Interval 1)\n");
 
@@ -169,8 +194,10 @@ bool GLDisplay::compileShaders() {
     glDeleteShader(fragmentShader);
 
     // 缓存uniform位置（在单线程初始化时获取，避免多线程并发查询）
-    texLeftLocation = glGetUniformLocation(shaderProgram, "texLeft");
-    texRightLocation = glGetUniformLocation(shaderProgram, "texRight");
+    texStreamLocation = glGetUniformLocation(shaderProgram, "texStream");
+    texCbLocation = glGetUniformLocation(shaderProgram, "texCb");
+    texCrLocation = glGetUniformLocation(shaderProgram, "texCr");
+    planarYuvLocation = glGetUniformLocation(shaderProgram, "planarYuv");
 
     return true;
 }
@@ -234,34 +261,18 @@ unsigned int GLDisplay::setupTexture(int width, int height) {
         glfwMakeContextCurrent(windows[0]);
     }
 
-    // 创建左眼纹理
-    glGenTextures(1, &leftTexID);
-    glBindTexture(GL_TEXTURE_2D, leftTexID);
-    // 分配纹理内存并初始化为白色，以便验证渲染管线（避免黑屏由空纹理引起）
-    {
-        size_t sz = static_cast<size_t>(width) * static_cast<size_t>(height) * 3;
-        std::vector<unsigned char> white(sz, 255);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, white.data());
-    }
-    // 设置纹理参数
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // 创建右眼纹理
-    glGenTextures(1, &rightTexID);
-    glBindTexture(GL_TEXTURE_2D, rightTexID);
-    {
-        size_t sz = static_cast<size_t>(width) * static_cast<size_t>(height) * 3;
-        std::vector<unsigned char> white(sz, 255);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, white.data());
+    // 为每路相机流创建纹理（平面 YUV 时另有每路两张半宽的 Cb/Cr 平面）
+    streamTexIDs.assign(streamCount, 0);
+    glGenTextures(streamCount, streamTexIDs.data());
+    chromaTexIDs.assign(planarYuv ? streamCount * 2 : 0, 0);
+    if (!chromaTexIDs.empty()) {
+        glGenTextures(static_cast<GLsizei>(chromaTexIDs.size()), chromaTexIDs.data());
+    }
+    streamTexWidths.assign(streamCount, 0);
+    streamTexHeights.assign(streamCount, 0);
+    for (int i = 0; i < streamCount; i++) {
+        allocateStreamTexture(i, width, height);
     }
-    // 设置纹理参数
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     // 释放临时绑定的上下文（恢复到无上下文，保持 worker 的持久绑定不被干扰）
     if (!windows.empty()) {
@@ -271,119 +282,169 @@ unsigned int GLDisplay::setupTexture(int width, int height) {
     // 所有 GL 资源已创建，安全地启动 worker 线程（worker 将长期持有各自上下文）
     initWorkers();
 
-    return leftTexID; // 返回左纹理ID以保持兼容性
+    return streamTexIDs[0]; // 返回第一路流的纹理ID以保持兼容性
 }
 
-void GLDisplay::updateVideo(unsigned char* leftData, unsigned char* rightData, int width, int height) {
+void GLDisplay::allocateStreamTexture(int stream, int width, int height) {
+    // 分配纹理内存并初始化为白色，以便验证渲染管线（避免黑屏由空纹理引起；
+    // 平面 YUV 的白色为 Y = 255, Cb = Cr = 128）
+    size_t sz = static_cast<size_t>(width) * static_cast<size_t>(height) * 3;
+    std::vector<unsigned char> white(sz, 255);
+    std::vector<unsigned char> neutral(planarYuv ? static_cast<size_t>(width) * height : 0, 128);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    auto initTexture = [](unsigned int texID, GLint internalFormat, GLenum format, int w, int h, const void* data) {
+        glBindTexture(GL_TEXTURE_2D, texID);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_UNSIGNED_BYTE, data);
+        // 设置纹理参数
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    };
+    if (planarYuv) {
+        initTexture(streamTexIDs[stream], GL_R8, GL_RED, width, height, white.data());
+        for (int p = 0; p < 2; p++) {
+            initTexture(chromaTexIDs[2 * stream + p], GL_R8, GL_RED, (width + 1) / 2, height, neutral.data());
+        }
+    } else {
+        initTexture(streamTexIDs[stream], GL_RGB, GL_RGB, width, height, white.data());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    streamTexWidths[stream] = width;
+    streamTexHeights[stream] = height;
+}
+
+void GLDisplay::updateVideo(const std::vector<const unsigned char*>& streams, int width, int height) {
     // 不在主线程进行任何 GL 调用，改为仅更新指针/尺寸供 worker 线程在其持久上下文中上传
     std::lock_guard<std::mutex> lock(mtx);
-    currentLeftData = leftData;
-    currentRightData = rightData;
-    currentImgWidth = width;
-    currentImgHeight = height;
+    currentStreamData.resize(std::max(currentStreamData.size(), streams.size()));
+    for (size_t i = 0; i < streams.size(); i++) {
+        if (streams[i] != nullptr) {
+            currentStreamData[i] = {streams[i], width, height, 0};
+        }
+    }
 }
 
-void GLDisplay::draw() {
-    // 向后兼容：只绘制第一个窗口
-    if (windows.empty() || VAOs.empty()) return;
-    
-    glfwMakeContextCurrent(windows[0]);
-    
-    // 清除颜色缓冲区
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // 使用着色器程序
-    glUseProgram(shaderProgram);
-    // 绑定顶点数组对象
-    glBindVertexArray(VAOs[0]);
+void GLDisplay::updateStream(int stream, const unsigned char* data, int width, int height, int pitch) {
+    if (stream < 0 || data == nullptr || width <= 0 || height <= 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    if (currentStreamData.size() <= static_cast<size_t>(stream)) {
+        currentStreamData.resize(stream + 1);
+    }
+    currentStreamData[stream] = {data, width, height, pitch};
+}
 
-    // 绑定左眼纹理到纹理单元0
-    // 在持久上下文中上传最新的纹理数据（如果有）— 先从共享状态读取指针
-    const unsigned char* leftPtr = nullptr;
-    const unsigned char* rightPtr = nullptr;
-    int imgW = 0, imgH = 0;
+void GLDisplay::uploadStreamTextures() {
+    // 在持久上下文中上传最新的纹理数据（如果有）— 先从共享状态取走待上传的图像，
+    // 纹理在各窗口的上下文之间共享，每份数据只上传一次
+    std::vector<PendingImage> images;
     {
         std::lock_guard<std::mutex> lock(mtx);
-        leftPtr = currentLeftData;
-        rightPtr = currentRightData;
-        imgW = currentImgWidth;
-        imgH = currentImgHeight;
+        images.assign(currentStreamData.size(), PendingImage{});
+        images.swap(currentStreamData);
     }
 
     static auto last_upload_log = std::chrono::steady_clock::now() - std::chrono::seconds(2);
-    if (leftPtr && imgW > 0 && imgH > 0) {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, leftTexID);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imgW, imgH, GL_RGB, GL_UNSIGNED_BYTE, leftPtr);
-
-        // 每秒打印一次上传心跳，帮助确认上传确实发生
-        auto now = std::chrono::steady_clock::now();
-        if (now - last_upload_log >= std::chrono::seconds(1)) {
-            last_upload_log = now;
-            printf("Uploading texture frame...\n");
+    bool uploaded = false;
+    glActiveTexture(GL_TEXTURE0);
+    for (size_t i = 0; i < images.size() && i < streamTexIDs.size(); i++) {
+        const PendingImage& image = images[i];
+        if (image.data == nullptr || image.width <= 0 || image.height <= 0) {
+            continue;
         }
-
-        // 检查并打印任何 GL 错误（上传后）
-        GLenum err = glGetError();
-        if (err != GL_NO_ERROR) {
-            const char* errstr = "UNKNOWN";
-            switch (err) {
-                case GL_INVALID_ENUM: errstr = "GL_INVALID_ENUM"; break;
-                case GL_INVALID_VALUE: errstr = "GL_INVALID_VALUE"; break;
-                case GL_INVALID_OPERATION: errstr = "GL_INVALID_OPERATION"; break;
-                case GL_OUT_OF_MEMORY: errstr = "GL_OUT_OF_MEMORY"; break;
-                default: break;
+        const int imgW = image.width;
+        const int imgH = image.height;
+        // 相机协商的尺寸与纹理不同（初始尺寸或重新连接了另一台相机）：按图像尺寸重新分配，
+        // 否则 glTexSubImage2D 会越界或只覆盖纹理的一部分
+        if (imgW != streamTexWidths[i] || imgH != streamTexHeights[i]) {
+            printf("Stream %zu texture resized to %dx%d\n", i, imgW, imgH);
+            allocateStreamTexture(static_cast<int>(i), imgW, imgH);
+        }
+        if (planarYuv) {
+            // 三个平面依次排列，按各自的行距上传（半宽的色度行不一定是 4 字节对齐）
+            const int pitch = image.pitch > 0 ? image.pitch
+                                              : static_cast<int>(planarPitch(static_cast<unsigned int>(imgW)));
+            const unsigned int planeTex[3] = {streamTexIDs[i], chromaTexIDs[2 * i], chromaTexIDs[2 * i + 1]};
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (unsigned int p = 0; p < 3; p++) {
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, p == 0 ? pitch : pitch / 2);
+                glBindTexture(GL_TEXTURE_2D, planeTex[p]);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, p == 0 ? imgW : (imgW + 1) / 2, imgH, GL_RED, GL_UNSIGNED_BYTE,
+                                image.data + planeOffset(pitch, imgH, p));
             }
-            fprintf(stderr, "GL error after glTexSubImage2D: 0x%X (%s)\n", err, errstr);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        } else {
+            // 行距以像素给出（解码缓冲区的行可能有填充），紧密排列的行不一定是 4 字节对齐
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, image.pitch > 0 ? image.pitch / 3 : 0);
+            glBindTexture(GL_TEXTURE_2D, streamTexIDs[i]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imgW, imgH, GL_RGB, GL_UNSIGNED_BYTE, image.data);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
         }
-    } else {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, leftTexID);
+        // 检查并打印任何 GL 错误（上传后）
+        reportGLError("glTexSubImage2D");
+        uploaded = true;
     }
-    glUniform1i(texLeftLocation, 0);
 
-    // 绑定并可能上传右眼纹理
-    if (rightPtr && imgW > 0 && imgH > 0) {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, rightTexID);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imgW, imgH, GL_RGB, GL_UNSIGNED_BYTE, rightPtr);
+    // 每秒打印一次上传心跳，帮助确认上传确实发生
+    auto now = std::chrono::steady_clock::now();
+    if (uploaded && now - last_upload_log >= std::chrono::seconds(1)) {
+        last_upload_log = now;
+        printf("Uploading texture frame...\n");
+    }
+}
 
-        // 检查并打印任何 GL 错误（上传后）
-        GLenum err = glGetError();
-        if (err != GL_NO_ERROR) {
-            const char* errstr = "UNKNOWN";
-            switch (err) {
-                case GL_INVALID_ENUM: errstr = "GL_INVALID_ENUM"; break;
-                case GL_INVALID_VALUE: errstr = "GL_INVALID_VALUE"; break;
-                case GL_INVALID_OPERATION: errstr = "GL_INVALID_OPERATION"; break;
-                case GL_OUT_OF_MEMORY: errstr = "GL_OUT_OF_MEMORY"; break;
-                default: break;
-            }
-            fprintf(stderr, "GL error after glTexSubImage2D (right): 0x%X (%s)\n", err, errstr);
+void GLDisplay::drawStreamCells() {
+    // 所有流共用纹理单元0（平面 YUV 的 Cb/Cr 用单元1/2），逐路绑定
+    glUniform1i(texStreamLocation, 0);
+    glUniform1i(texCbLocation, 1);
+    glUniform1i(texCrLocation, 2);
+    glUniform1i(planarYuvLocation, planarYuv ? 1 : 0);
+
+    int count = static_cast<int>(streamTexIDs.size());
+    for (int i = 0; i < count; i++) {
+        // 视口限定在该路流的格子内（格子从左上角计，OpenGL 视口原点在左下角）
+        StreamCell cell = streamCell(i, count, framebufferWidth, framebufferHeight);
+        glViewport(cell.x, framebufferHeight - cell.y - cell.height, cell.width, cell.height);
+        if (planarYuv) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, chromaTexIDs[2 * i]);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, chromaTexIDs[2 * i + 1]);
         }
-    } else {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, rightTexID);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, streamTexIDs[i]);
+
+        // 绘制全屏四边形（6个顶点）
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     }
-    glUniform1i(texRightLocation, 1);
+}
+
+void GLDisplay::draw() {
+    // 向后兼容：只绘制第一个窗口
+    if (windows.empty() || VAOs.empty()) return;
+    
+    glfwMakeContextCurrent(windows[0]);
+    
+    // 清除颜色缓冲区
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // 使用着色器程序
+    glUseProgram(shaderProgram);
+    // 绑定顶点数组对象
+    glBindVertexArray(VAOs[0]);
+
+    // 在持久上下文中上传最新的纹理数据（如果有）
+    uploadStreamTextures();
 
-    // 绘制全屏四边形（6个顶点）
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    // 逐路绘制各相机流
+    drawStreamCells();
     // 检查并打印任何 GL 错误（绘制后）
-    {
-        GLenum err = glGetError();
-        if (err != GL_NO_ERROR) {
-            const char* errstr = "UNKNOWN";
-            switch (err) {
-                case GL_INVALID_ENUM: errstr = "GL_INVALID_ENUM"; break;
-                case GL_INVALID_VALUE: errstr = "GL_INVALID_VALUE"; break;
-                case GL_INVALID_OPERATION: errstr = "GL_INVALID_OPERATION"; break;
-                case GL_OUT_OF_MEMORY: errstr = "GL_OUT_OF_MEMORY"; break;
-                default: break;
-            }
-            fprintf(stderr, "GL error after glDrawElements: 0x%X (%s)\n", err, errstr);
-        }
-    }
+    reportGLError("glDrawElements");
 
     //glFlush();
     glFinish();
@@ -406,18 +467,8 @@ void GLDisplay::drawSerial() {
         // 绑定当前窗口的VAO
         glBindVertexArray(VAOs[i]);
 
-        // 绑定左眼纹理到纹理单元0
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, leftTexID);
-        glUniform1i(texLeftLocation, 0);
-
-        // 绑定右眼纹理到纹理单元1
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, rightTexID);
-        glUniform1i(texRightLocation, 1);
-
-        // 绘制全屏四边形（6个顶点）
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        // 逐路绘制各相机流
+        drawStreamCells();
 
         // 确保命令执行完成
         glFinish();
@@ -508,77 +559,11 @@ void GLDisplay::renderWindowContext(int windowIndex) {
     // 绑定当前窗口的VAO
     glBindVertexArray(VAOs[windowIndex]);
 
-    // 在持久上下文中上传最新的纹理数据（如果有）— 先从共享状态读取指针
-    const unsigned char* leftPtr = nullptr;
-    const unsigned char* rightPtr = nullptr;
-    int imgW = 0, imgH = 0;
-    {
-        std::lock_guard<std::mutex> lock(mtx);
-        leftPtr = currentLeftData;
-        rightPtr = currentRightData;
-        imgW = currentImgWidth;
-        imgH = currentImgHeight;
-    }
+    // 在持久上下文中上传最新的纹理数据（如果有）
+    uploadStreamTextures();
 
-    static auto last_upload_log = std::chrono::steady_clock::now() - std::chrono::seconds(2);
-    if (leftPtr && imgW > 0 && imgH > 0) {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, leftTexID);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imgW, imgH, GL_RGB, GL_UNSIGNED_BYTE, leftPtr);
-
-        // 每秒打印一次上传心跳，帮助确认上传确实发生
-        auto now = std::chrono::steady_clock::now();
-        if (now - last_upload_log >= std::chrono::seconds(1)) {
-            last_upload_log = now;
-            printf("Uploading texture frame...\n");
-        }
-
-        // 检查并打印任何 GL 错误（上传后）
-        GLenum err = glGetError();
-        if (err != GL_NO_ERROR) {
-            const char* errstr = "UNKNOWN";
-            switch (err) {
-                case GL_INVALID_ENUM: errstr = "GL_INVALID_ENUM"; break;
-                case GL_INVALID_VALUE: errstr = "GL_INVALID_VALUE"; break;
-                case GL_INVALID_OPERATION: errstr = "GL_INVALID_OPERATION"; break;
-                case GL_OUT_OF_MEMORY: errstr = "GL_OUT_OF_MEMORY"; break;
-                default: break;
-            }
-            fprintf(stderr, "GL error after glTexSubImage2D: 0x%X (%s)\n", err, errstr);
-        }
-    } else {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, leftTexID);
-    }
-    glUniform1i(texLeftLocation, 0);
-
-    // 绑定并可能上传右眼纹理
-    if (rightPtr && imgW > 0 && imgH > 0) {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, rightTexID);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imgW, imgH, GL_RGB, GL_UNSIGNED_BYTE, rightPtr);
-
-        // 检查并打印任何 GL 错误（上传后）
-        GLenum err = glGetError();
-        if (err != GL_NO_ERROR) {
-            const char* errstr = "UNKNOWN";
-            switch (err) {
-                case GL_INVALID_ENUM: errstr = "GL_INVALID_ENUM"; break;
-                case GL_INVALID_VALUE: errstr = "GL_INVALID_VALUE"; break;
-                case GL_INVALID_OPERATION: errstr = "GL_INVALID_OPERATION"; break;
-                case GL_OUT_OF_MEMORY: errstr = "GL_OUT_OF_MEMORY"; break;
-                default: break;
-            }
-            fprintf(stderr, "GL error after glTexSubImage2D (right): 0x%X (%s)\n", err, errstr);
-        }
-    } else {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, rightTexID);
-    }
-    glUniform1i(texRightLocation, 1);
-
-    // 绘制全屏四边形（6个顶点）
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    // 逐路绘制各相机流
+    drawStreamCells();
 
     // 确保命令执行完成（关键：用于延迟测试）
     glFinish();
@@ -807,16 +792,15 @@ void GLDisplay::cleanup() {
     }
 
     // 清理纹理（在第一个上下文中删除即可，因为共享）
-    if (leftTexID != 0 && !windows.empty()) {
-        glfwMakeContextCurrent(windows[0]);
-        glDeleteTextures(1, &leftTexID);
-        leftTexID = 0;
-    }
-    if (rightTexID != 0 && !windows.empty()) {
+    if (!streamTexIDs.empty() && !windows.empty()) {
         glfwMakeContextCurrent(windows[0]);
-        glDeleteTextures(1, &rightTexID);
-        rightTexID = 0;
+        glDeleteTextures(static_cast<GLsizei>(streamTexIDs.size()), streamTexIDs.data());
+        if (!chromaTexIDs.empty()) {
+            glDeleteTextures(static_cast<GLsizei>(chromaTexIDs.size()), chromaTexIDs.data());
+        }
     }
+    streamTexIDs.clear();
+    chromaTexIDs.clear();
 
     // 销毁所有窗口
     for (auto* window : windows) {
@@ -1,6 +1,15 @@
 #include "inc/VkDisplay.h"
 #include <opencv2/opencv.hpp>
 #include "efficiency_test.h"
+#include "inc/stream_layout.h"
+#include "inc/frame_timing.h"
+
+// shaders 目标编译的 SPIR-V（glslangValidator --vn，生成在构建目录的 shaders/ 下）
+#include <cstdint>
+#include <cstdio>
+#include "shaders/vert.spv.h"
+#include "shaders/frag.spv.h"
+#include "shaders/expand.spv.h"
 
 // Vulkan验证层
 const std::vector<const char*> validationLayers = {
@@ -18,19 +27,89 @@ const std::vector<const char*> deviceExtensions = {
     const bool enableValidationLayers = true;
 #endif
 
+namespace {
+    // 设备是否支持某个可选扩展
+    bool hasDeviceExtension(VkPhysicalDevice device, const char* name) {
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+        for (const auto& extension : availableExtensions) {
+            if (strcmp(extension.extensionName, name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 创建初始值为 0 的时间线信号量
+    VkSemaphore createTimelineSemaphore(VkDevice device) {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create timeline semaphore!");
+        }
+        return semaphore;
+    }
+
+    // init 各步骤的耗时：每步结束时记录，init 结束（或失败）时输出
+    class InitTimer {
+    public:
+        void mark(const char* step) {
+            auto now = std::chrono::steady_clock::now();
+            steps.emplace_back(step, std::chrono::duration<double, std::milli>(now - last).count());
+            last = now;
+        }
+
+        void print() const {
+            double total = 0.0;
+            printf("Vulkan init timing:\n");
+            for (const auto& step : steps) {
+                printf("  %-24s %8.2f ms\n", step.first, step.second);
+                total += step.second;
+            }
+            printf("  %-24s %8.2f ms\n", "total", total);
+        }
+
+    private:
+        std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+        std::vector<std::pair<const char*, double>> steps;
+    };
+
+    // expand.glsl 的推送常量（offset/pitch 以字节计）
+    struct ExpandParams {
+        uint32_t offset;
+        uint32_t pitch;
+        uint32_t width;
+        uint32_t height;
+    };
+}
+
 VkDisplay::VkDisplay() {
-    // 初始化 VSync 追踪时间点为一个很早的时间，确保第一次 getTimeToNextVSync() 返回正值
-    lastPresentTime = std::chrono::steady_clock::now() - std::chrono::milliseconds(100);
+    scheduler.setSubmitAhead(SUBMIT_AHEAD_MS * 1000);
 }
 
 VkDisplay::~VkDisplay() {
     cleanup();
 }
 
-bool VkDisplay::init(int width, int height, std::string title) {
+bool VkDisplay::init(int width, int height, std::string title, int streamCount) {
+    this->streamCount = std::max(streamCount, 1);
+    InitTimer timer;
     try {
-        // 步骤A：初始化GLFW和窗口
-        initGLFW(width, height, title);
+        // 步骤A：初始化GLFW和窗口（离屏模式没有窗口）
+        if (!headless) {
+            initGLFW(width, height, title);
+        }
+        timer.mark("A window");
 
         // 步骤B：创建Vulkan实例
         createInstance();
@@ -39,55 +118,129 @@ bool VkDisplay::init(int width, int height, std::string title) {
         if (enableValidationLayers) {
             setupDebugMessenger();
         }
+        timer.mark("B instance");
 
         // 步骤C：创建表面
-        createSurface();
+        if (!headless) {
+            createSurface();
+        }
+        timer.mark("C surface");
 
         // 步骤D：选择物理设备
         pickPhysicalDevice();
+        timer.mark("D physical device");
 
         // 步骤E：创建逻辑设备
         createLogicalDevice();
-
-        // 步骤F：创建交换链
-        createSwapChain();
+        timer.mark("E logical device");
+
+        // 步骤E'：读取管线缓存（上次启动保存，设备或驱动变化时丢弃）
+        createPipelineCache();
+        timer.mark("E' pipeline cache");
+
+        // 步骤F：创建交换链（离屏模式为每个帧槽位一张离屏颜色图像）
+        if (headless) {
+            createOffscreenTargets(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+        } else {
+            createSwapChain();
+            updateNominalRefresh();
+            startPresentWait();
+        }
+        timer.mark("F swapchain");
 
         // 步骤G：创建图像视图
         createImageViews();
+        timer.mark("G image views");
 
         // 步骤H：创建渲染通道
         createRenderPass();
+        timer.mark("H render pass");
 
         // 步骤I：创建描述符集布局
         createDescriptorSetLayout();
+        timer.mark("I set layout");
 
         // 步骤J：创建图形管线
         createGraphicsPipeline();
+        timer.mark("J graphics pipeline");
 
         // 步骤K：创建帧缓冲
         createFramebuffers();
+        timer.mark("K framebuffers");
 
         // 步骤L：创建命令池
         createCommandPool();
+        timer.mark("L command pool");
+
+        // 步骤L'：GPU 颜色扩展的计算管线（可选，失败时退回拷贝路径，须在纹理和暂存缓冲区之前确定）
+        if (planarYuv && gpuColorExpansion) {
+            std::cerr << "GPU color expansion disabled: planar YUV is converted in the fragment shader" << std::endl;
+            gpuColorExpansion = false;
+        }
+        if (gpuColorExpansion) {
+            try {
+                createExpandPipeline();
+            } catch (const std::exception& e) {
+                std::cerr << "GPU color expansion disabled: " << e.what() << std::endl;
+                destroyExpandPipeline();
+                gpuColorExpansion = false;
+            }
+        }
+        timer.mark("L' expand pipeline");
+
+        // 步骤L''：线性纹理（可选，设备不支持时退回拷贝路径）
+        if (linearTextures && !checkLinearTextureSupport()) {
+            linearTextures = false;
+        }
+        timer.mark("L'' linear textures");
 
-        // 步骤M：创建纹理资源
-        createTextureResources();
+        // 步骤M：创建纹理资源（每路流按各自的图像尺寸，setFrameSize 未设置的流为默认尺寸）
+        streamExtents.resize(this->streamCount, {DEFAULT_FRAME_WIDTH, DEFAULT_FRAME_HEIGHT});
+        rejectedExtents.assign(this->streamCount, {0, 0});
+        for (int i = 0; i < this->streamCount; i++) {
+            createTextureResources(i);
+        }
+        timer.mark("M textures");
 
         // 步骤N：创建暂存缓冲区
-        createStagingBuffer();
+        for (int i = 0; i < this->streamCount; i++) {
+            createStagingBuffer(i);
+        }
+        timer.mark("N staging buffers");
 
         // 步骤O：创建描述符
-        createDescriptors();
+        for (int i = 0; i < this->streamCount; i++) {
+            createDescriptors(i);
+        }
+        timer.mark("O descriptors");
 
         // 步骤P：创建同步对象
         createSyncObjects();
+        timer.mark("P sync objects");
 
         // 步骤Q：创建命令缓冲区
         createCommandBuffers();
+        timer.mark("Q command buffers");
+
+        // 步骤R：传输队列上传（可选，设备没有独立传输队列时在图形队列上拷贝）
+        createTransferResources();
+        timer.mark("R transfer queue");
+
+        // 步骤S：预录制绘制命令（每个交换链图像和帧槽位一个，交换链重建时重新录制）
+        createRenderCommandBuffers();
+        timer.mark("S render commands");
 
+        // 步骤T：管线全部创建完成，缓存是空的或被丢弃时写回文件（下次启动直接使用）
+        if (!pipelineCacheWarm) {
+            savePipelineCache();
+        }
+        timer.mark("T save pipeline cache");
+
+        timer.print();
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Vulkan initialization failed: " << e.what() << std::endl;
+        timer.print();
         return false;
     }
 }
@@ -120,7 +273,7 @@ void VkDisplay::createInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_2;  // 时间线信号量（1.1 设备通过扩展使用）
 
     // 实例创建信息
     VkInstanceCreateInfo createInfo{};
@@ -220,6 +373,9 @@ void VkDisplay::createLogicalDevice() {
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    if (indices.transferFamily.has_value()) {
+        uniqueQueueFamilies.insert(indices.transferFamily.value());
+    }
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -239,8 +395,67 @@ void VkDisplay::createLogicalDevice() {
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    // 时间线信号量：1.2 设备为核心功能，1.1 设备需要 VK_KHR_timeline_semaphore；都不支持时按槽位等待 fence
+    std::vector<const char*> extensions = headless ? std::vector<const char*>{} : deviceExtensions;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    bool timelineCore = properties.apiVersion >= VK_API_VERSION_1_2;
+    bool timelineExtension = !timelineCore && hasDeviceExtension(physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    if (properties.apiVersion >= VK_API_VERSION_1_1 && (timelineCore || timelineExtension)) {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &timelineFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    }
+    timelineSemaphores = timelineFeatures.timelineSemaphore == VK_TRUE;
+    if (timelineSemaphores) {
+        if (timelineExtension) {
+            extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        }
+        createInfo.pNext = &timelineFeatures;
+    }
+
+    // 解码目标导入主机内存：扩展依赖 VK_KHR_external_memory（1.1 核心），不支持时解码目标分配主机可见的设备内存
+    hostMemoryImport = hostMemoryImportAllowed && properties.apiVersion >= VK_API_VERSION_1_1 &&
+                       hasDeviceExtension(physicalDevice, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+    if (hostMemoryImport) {
+        extensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties{};
+        hostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &hostProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        hostPointerAlignment = hostProperties.minImportedHostPointerAlignment;
+    }
+
+    // 呈现完成时间：VK_KHR_present_wait（依赖 VK_KHR_present_id），不支持时刷新周期取显示器模式的标称值
+    VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+    presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+    presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    presentWait = !headless && properties.apiVersion >= VK_API_VERSION_1_1 &&
+                  hasDeviceExtension(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+                  hasDeviceExtension(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    if (presentWait) {
+        presentIdFeatures.pNext = &presentWaitFeatures;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &presentIdFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        presentWait = presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+    }
+    if (presentWait) {
+        extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        presentWaitFeatures.pNext = const_cast<void*>(createInfo.pNext);
+        createInfo.pNext = &presentIdFeatures;
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (enableValidationLayers) {
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -256,120 +471,224 @@ void VkDisplay::createLogicalDevice() {
     // 获取队列句柄
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
-}
-
-void VkDisplay::cleanup() {
-    // 销毁所有 staging buffers
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (stagingBuffersMapped[i] != nullptr) {
-            vkUnmapMemory(device, stagingBufferMemories[i]);
-        }
-        if (stagingBuffers[i] != VK_NULL_HANDLE) {
-            vkDestroyBuffer(device, stagingBuffers[i], nullptr);
-        }
-        if (stagingBufferMemories[i] != VK_NULL_HANDLE) {
-            vkFreeMemory(device, stagingBufferMemories[i], nullptr);
-        }
+    graphicsFamilyIndex = indices.graphicsFamily.value();
+    if (indices.transferFamily.has_value()) {
+        transferFamilyIndex = indices.transferFamily.value();
+        vkGetDeviceQueue(device, transferFamilyIndex, 0, &transferQueue);
     }
 
-    // 销毁描述符池
-    if (descriptorPool != VK_NULL_HANDLE) {
-        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    if (timelineSemaphores) {
+        waitSemaphoresFn = reinterpret_cast<PFN_vkWaitSemaphores>(
+            vkGetDeviceProcAddr(device, timelineCore ? "vkWaitSemaphores" : "vkWaitSemaphoresKHR"));
+        timelineSemaphores = waitSemaphoresFn != nullptr;
     }
+    std::cout << "Frames in flight: " << framesInFlight
+              << (timelineSemaphores ? " (timeline semaphore)" : " (fences)") << std::endl;
 
-    // 销毁纹理资源
-    if (textureSampler != VK_NULL_HANDLE) {
-        vkDestroySampler(device, textureSampler, nullptr);
-    }
-    if (leftTextureImageView != VK_NULL_HANDLE) {
-        vkDestroyImageView(device, leftTextureImageView, nullptr);
+    if (hostMemoryImport) {
+        getMemoryHostPointerPropertiesFn = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+            vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT"));
+        hostMemoryImport = getMemoryHostPointerPropertiesFn != nullptr && hostPointerAlignment != 0;
     }
-    if (rightTextureImageView != VK_NULL_HANDLE) {
-        vkDestroyImageView(device, rightTextureImageView, nullptr);
-    }
-    if (leftTextureImage != VK_NULL_HANDLE) {
-        vkDestroyImage(device, leftTextureImage, nullptr);
-    }
-    if (rightTextureImage != VK_NULL_HANDLE) {
-        vkDestroyImage(device, rightTextureImage, nullptr);
-    }
-    if (leftTextureImageMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(device, leftTextureImageMemory, nullptr);
+    std::cout << "Decode targets: " << (hostMemoryImport ? "imported host memory" : "host visible device memory")
+              << std::endl;
+
+    if (presentWait) {
+        waitForPresentFn = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"));
+        presentWait = waitForPresentFn != nullptr;
     }
-    if (rightTextureImageMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(device, rightTextureImageMemory, nullptr);
+    if (!headless) {
+        std::cout << "Present timing: " << (presentWait ? "measured (present wait)" : "nominal refresh rate")
+                  << std::endl;
     }
+}
+
+void VkDisplay::cleanup() {
+    // 析构函数会再次调用 cleanup：销毁后的句柄都置空，第二次调用什么也不做
+    stopPresentWait();
+    if (device != VK_NULL_HANDLE) {
+        // 在途的帧（拷贝、绘制、呈现）全部完成后才能销毁它们使用的资源
+        vkDeviceWaitIdle(device);
+
+        // 销毁所有 staging buffers
+        for (size_t i = 0; i < stagingBuffers.size(); i++) {
+            if (stagingBuffersMapped[i] != nullptr) {
+                vkUnmapMemory(device, stagingBufferMemories[i]);
+            }
+            if (stagingBuffers[i] != VK_NULL_HANDLE) {
+                vkDestroyBuffer(device, stagingBuffers[i], nullptr);
+            }
+            if (stagingBufferMemories[i] != VK_NULL_HANDLE) {
+                vkFreeMemory(device, stagingBufferMemories[i], nullptr);
+            }
+        }
+
+        // 释放仍挂在提交上的帧，再销毁解码目标（解码线程此时必须已停止写入）
+        pendingOwners.clear();
+        inFlightOwners.clear();
+        streamUploads.clear();
+        for (auto& targets : decodeTargets) {
+            destroyDecodeTargets(targets);
+        }
+
+        // 销毁 GPU 颜色扩展的计算管线（其描述符集随描述符池释放）
+        destroyExpandPipeline();
 
-    // 销毁同步对象
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        if (renderFinishedSemaphores[i] != VK_NULL_HANDLE) {
-            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+        // 销毁描述符池
+        for (auto pool : descriptorPools) {
+            if (pool != VK_NULL_HANDLE) {
+                vkDestroyDescriptorPool(device, pool, nullptr);
+            }
         }
-        if (imageAvailableSemaphores[i] != VK_NULL_HANDLE) {
-            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+
+        // 销毁纹理资源
+        if (textureSampler != VK_NULL_HANDLE) {
+            vkDestroySampler(device, textureSampler, nullptr);
         }
-        if (inFlightFences[i] != VK_NULL_HANDLE) {
-            vkDestroyFence(device, inFlightFences[i], nullptr);
+        for (auto& texture : streamTextures) {
+            destroyStreamTexture(texture);
         }
-    }
+        // 尺寸变化时替换下来、还没等到销毁时机的资源
+        destroyRetiredResources(true);
 
-    // 释放命令缓冲区（通过销毁命令池）
-    if (commandPool != VK_NULL_HANDLE) {
-        vkDestroyCommandPool(device, commandPool, nullptr);
-    }
+        // 销毁同步对象
+        for (size_t i = 0; i < renderFinishedSemaphores.size(); i++) {
+            if (renderFinishedSemaphores[i] != VK_NULL_HANDLE) {
+                vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+            }
+            if (imageAvailableSemaphores[i] != VK_NULL_HANDLE) {
+                vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+            }
+            if (inFlightFences[i] != VK_NULL_HANDLE) {
+                vkDestroyFence(device, inFlightFences[i], nullptr);
+            }
+        }
+        if (frameTimeline != VK_NULL_HANDLE) {
+            vkDestroySemaphore(device, frameTimeline, nullptr);
+        }
+        if (uploadTimeline != VK_NULL_HANDLE) {
+            vkDestroySemaphore(device, uploadTimeline, nullptr);
+        }
+        if (transferCommandPool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(device, transferCommandPool, nullptr);
+        }
 
-    // 销毁帧缓冲
-    for (auto framebuffer : swapChainFramebuffers) {
-        vkDestroyFramebuffer(device, framebuffer, nullptr);
-    }
+        // 释放命令缓冲区（通过销毁命令池）
+        if (commandPool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(device, commandPool, nullptr);
+        }
 
-    // 销毁图形管线和相关资源
-    if (graphicsPipeline != VK_NULL_HANDLE) {
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    }
-    if (pipelineLayout != VK_NULL_HANDLE) {
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    }
-    if (descriptorSetLayout != VK_NULL_HANDLE) {
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-    }
+        // 销毁帧缓冲
+        for (auto framebuffer : swapChainFramebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
 
-    // 销毁渲染通道
-    if (renderPass != VK_NULL_HANDLE) {
-        vkDestroyRenderPass(device, renderPass, nullptr);
-    }
+        // 销毁图形管线和相关资源
+        if (graphicsPipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        }
+        if (pipelineCache != VK_NULL_HANDLE) {
+            vkDestroyPipelineCache(device, pipelineCache, nullptr);
+        }
+        if (pipelineLayout != VK_NULL_HANDLE) {
+            vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        }
+        if (descriptorSetLayout != VK_NULL_HANDLE) {
+            vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        }
 
-    // 销毁交换链图像视图
-    for (auto imageView : swapChainImageViews) {
-        vkDestroyImageView(device, imageView, nullptr);
-    }
+        // 销毁渲染通道
+        if (renderPass != VK_NULL_HANDLE) {
+            vkDestroyRenderPass(device, renderPass, nullptr);
+        }
 
-    // 销毁交换链
-    if (swapChain != VK_NULL_HANDLE) {
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
-    }
+        // 销毁交换链图像视图
+        for (auto imageView : swapChainImageViews) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
 
-    if (device != VK_NULL_HANDLE) {
-        vkDestroyDevice(device, nullptr);
-    }
+        // 销毁交换链
+        if (swapChain != VK_NULL_HANDLE) {
+            vkDestroySwapchainKHR(device, swapChain, nullptr);
+        }
 
-    if (enableValidationLayers) {
-        DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
-    }
+        // 离屏图像和回读缓冲区（交换链图像属于交换链，不单独销毁）
+        if (headless) {
+            for (auto image : swapChainImages) {
+                vkDestroyImage(device, image, nullptr);
+            }
+        }
+        for (auto memory : offscreenMemories) {
+            vkFreeMemory(device, memory, nullptr);
+        }
+        for (auto buffer : readbackBuffers) {
+            vkDestroyBuffer(device, buffer, nullptr);
+        }
+        for (auto memory : readbackMemories) {
+            vkFreeMemory(device, memory, nullptr);  // 映射随释放解除
+        }
 
-    if (surface != VK_NULL_HANDLE) {
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        vkDestroyDevice(device, nullptr);
     }
 
+    stagingBuffers.clear();
+    stagingBufferMemories.clear();
+    stagingBuffersMapped.clear();
+    decodeTargets.clear();
+    streamTextures.clear();
+    latestSlot.clear();
+    renderFinishedSemaphores.clear();
+    imageAvailableSemaphores.clear();
+    inFlightFences.clear();
+    slotTimelineValues.clear();
+    textureReadValues.clear();
+    commandBuffers.clear();
+    transferCommandBuffers.clear();
+    renderCommandBuffers.clear();
+    submitCount = 0;
+    swapChainFramebuffers.clear();
+    swapChainImageViews.clear();
+    swapChainImages.clear();
+    offscreenMemories.clear();
+    readbackBuffers.clear();
+    readbackMemories.clear();
+    readbackMapped.clear();
+    lastDrawnSlot = -1;
+    frameTimeline = VK_NULL_HANDLE;
+    uploadTimeline = VK_NULL_HANDLE;
+    transferCommandPool = VK_NULL_HANDLE;
+    transferQueue = VK_NULL_HANDLE;
+    transferUploads = false;
+    descriptorPools.clear();
+    rejectedExtents.clear();
+    textureSampler = VK_NULL_HANDLE;
+    commandPool = VK_NULL_HANDLE;
+    graphicsPipeline = VK_NULL_HANDLE;
+    pipelineCache = VK_NULL_HANDLE;
+    pipelineLayout = VK_NULL_HANDLE;
+    descriptorSetLayout = VK_NULL_HANDLE;
+    renderPass = VK_NULL_HANDLE;
+    swapChain = VK_NULL_HANDLE;
+    device = VK_NULL_HANDLE;
+
     if (instance != VK_NULL_HANDLE) {
+        if (enableValidationLayers && debugMessenger != VK_NULL_HANDLE) {
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+        }
+        if (surface != VK_NULL_HANDLE) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
         vkDestroyInstance(instance, nullptr);
     }
+    debugMessenger = VK_NULL_HANDLE;
+    surface = VK_NULL_HANDLE;
+    instance = VK_NULL_HANDLE;
 
     if (window != nullptr) {
         glfwDestroyWindow(window);
+        window = nullptr;
+        glfwTerminate();
     }
-
-    glfwTerminate();
 }
 
 // 辅助函数实现
@@ -400,11 +719,14 @@ bool VkDisplay::checkValidationLayerSupport() {
 }
 
 std::vector<const char*> VkDisplay::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    // 离屏模式不需要窗口系统的表面扩展
+    std::vector<const char*> extensions;
+    if (!headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -416,7 +738,7 @@ std::vector<const char*> VkDisplay::getRequiredExtensions() {
 bool VkDisplay::isDeviceSuitable(VkPhysicalDevice device) {
     QueueFamilyIndices indices = findQueueFamilies(device);
 
-    bool extensionsSupported = checkDeviceExtensionSupport(device);
+    bool extensionsSupported = headless || checkDeviceExtensionSupport(device);  // 离屏模式不需要交换链
 
     // 检查交换链支持
     bool swapChainAdequate = false;
@@ -463,6 +785,15 @@ VkDisplay::QueueFamilyIndices VkDisplay::findQueueFamilies(VkPhysicalDevice devi
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+    // 独立的传输队列族（通常对应 DMA 引擎）：拷贝可以与图形队列上的绘制并行执行
+    for (uint32_t f = 0; f < queueFamilyCount; f++) {
+        VkQueueFlags flags = queueFamilies[f].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transferFamily = f;
+            break;
+        }
+    }
+
     int i = 0;
     for (const auto& queueFamily : queueFamilies) {
         if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
@@ -470,7 +801,11 @@ VkDisplay::QueueFamilyIndices VkDisplay::findQueueFamilies(VkPhysicalDevice devi
         }
 
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        if (surface != VK_NULL_HANDLE) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+        } else if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            presentSupport = VK_TRUE;  // 离屏模式不呈现，呈现队列即图形队列
+        }
 
         if (presentSupport) {
             indices.presentFamily = i;
@@ -693,6 +1028,113 @@ void VkDisplay::createImageViews() {
     }
 }
 
+void VkDisplay::createOffscreenTargets(uint32_t width, uint32_t height) {
+    // 离屏颜色图像代替交换链图像：每个帧槽位一张，格式取交换链的首选格式，可作为拷贝源（回读）
+    swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+    swapChainExtent = {width, height};
+    swapChainImages.resize(framesInFlight);
+    offscreenMemories.resize(framesInFlight);
+
+    for (int i = 0; i < framesInFlight; i++) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {width, height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = swapChainImageFormat;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &swapChainImages[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create offscreen image!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, swapChainImages[i], &memRequirements);
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &offscreenMemories[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate offscreen image memory!");
+        }
+
+        vkBindImageMemory(device, swapChainImages[i], offscreenMemories[i], 0);
+    }
+
+    if (!headlessReadback) {
+        return;
+    }
+
+    // 回读缓冲区：每个槽位一个，绘制命令结束时从离屏图像拷贝（紧密排列的 BGRA），CPU 读取
+    readbackBuffers.resize(framesInFlight);
+    readbackMemories.resize(framesInFlight);
+    readbackMapped.resize(framesInFlight);
+
+    for (int i = 0; i < framesInFlight; i++) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = VkDeviceSize(width) * height * 4;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &readbackBuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create readback buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, readbackBuffers[i], &memRequirements);
+
+        // CPU 读取整幅图像，优先选择带 CPU 缓存的内存
+        uint32_t memoryType;
+        try {
+            memoryType = findMemoryType(memRequirements.memoryTypeBits,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        } catch (const std::runtime_error&) {
+            memoryType = findMemoryType(memRequirements.memoryTypeBits,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &readbackMemories[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate readback buffer memory!");
+        }
+
+        vkBindBufferMemory(device, readbackBuffers[i], readbackMemories[i], 0);
+
+        // 持久映射内存
+        vkMapMemory(device, readbackMemories[i], 0, bufferInfo.size, 0, &readbackMapped[i]);
+    }
+}
+
+bool VkDisplay::readback(std::vector<unsigned char>& pixels, uint32_t& width, uint32_t& height) {
+    if (!headlessReadback || lastDrawnSlot < 0) {
+        return false;
+    }
+
+    // 等待最近一次提交完成：其绘制命令末尾已把离屏图像拷贝到该槽位的回读缓冲区
+    waitForSlot(static_cast<uint32_t>(lastDrawnSlot));
+
+    width = swapChainExtent.width;
+    height = swapChainExtent.height;
+    const unsigned char* mapped = static_cast<const unsigned char*>(readbackMapped[lastDrawnSlot]);
+    pixels.assign(mapped, mapped + static_cast<size_t>(width) * height * 4);
+    return true;
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL VkDisplay::debugCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
     VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -725,11 +1167,11 @@ void VkDisplay::DestroyDebugUtilsMessengerEXT(VkInstance instance,
     }
 }
 
-VkShaderModule VkDisplay::createShaderModule(const std::vector<char>& code) {
+VkShaderModule VkDisplay::createShaderModule(const uint32_t* code, size_t codeSize) {
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    createInfo.codeSize = codeSize;
+    createInfo.pCode = code;
 
     VkShaderModule shaderModule;
     if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -748,7 +1190,7 @@ void VkDisplay::createRenderPass() {
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
@@ -766,32 +1208,40 @@ void VkDisplay::createRenderPass() {
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
 
+    // 离屏模式：绘制结果（连同到 Transfer Src 的布局转换）在回读拷贝之前可见
+    VkSubpassDependency readbackDependency{};
+    readbackDependency.srcSubpass = 0;
+    readbackDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    readbackDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    readbackDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    readbackDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    readbackDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    if (headless) {
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &readbackDependency;
+    }
+
     if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create render pass!");
     }
 }
 
 void VkDisplay::createDescriptorSetLayout() {
-    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-    samplerLayoutBinding.binding = 0;
-    samplerLayoutBinding.descriptorCount = 1;
-    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding.pImmutableSamplers = nullptr;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-    VkDescriptorSetLayoutBinding samplerLayoutBinding2{};
-    samplerLayoutBinding2.binding = 1;
-    samplerLayoutBinding2.descriptorCount = 1;
-    samplerLayoutBinding2.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    samplerLayoutBinding2.pImmutableSamplers = nullptr;
-    samplerLayoutBinding2.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {samplerLayoutBinding, samplerLayoutBinding2};
+    // binding 0 为该路流的纹理（平面 YUV 时为 Y 平面），binding 1/2 为 Cb/Cr 平面（RGBA 时不使用）
+    VkDescriptorSetLayoutBinding samplerLayoutBindings[3]{};
+    for (uint32_t b = 0; b < 3; b++) {
+        samplerLayoutBindings[b].binding = b;
+        samplerLayoutBindings[b].descriptorCount = 1;
+        samplerLayoutBindings[b].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        samplerLayoutBindings[b].pImmutableSamplers = nullptr;
+        samplerLayoutBindings[b].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
 
+    // 每路流一个描述符集，集合中只有该路流的纹理；绘制时逐路绑定
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-    layoutInfo.pBindings = bindings.data();
+    layoutInfo.bindingCount = 3;
+    layoutInfo.pBindings = samplerLayoutBindings;
 
     if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create descriptor set layout!");
@@ -799,13 +1249,9 @@ void VkDisplay::createDescriptorSetLayout() {
 }
 
 void VkDisplay::createGraphicsPipeline() {
-    // 从文件加载着色器
-    auto vertShaderCode = readFile("shaders/vert.spv");
-    auto fragShaderCode = readFile("shaders/frag.spv");
-
-    // 创建着色器模块
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+    // 创建着色器模块（SPIR-V 由 shaders 目标编译后嵌入程序，不依赖工作目录下的文件）
+    VkShaderModule vertShaderModule = createShaderModule(vert_spv, sizeof(vert_spv));
+    VkShaderModule fragShaderModule = createShaderModule(frag_spv, sizeof(frag_spv));
 
     // 顶点着色器阶段
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -814,12 +1260,25 @@ void VkDisplay::createGraphicsPipeline() {
     vertShaderStageInfo.module = vertShaderModule;
     vertShaderStageInfo.pName = "main";
 
-    // 片段着色器阶段
+    // 片段着色器阶段：特化常量 0 选择 RGBA 采样或平面 YUV 转换
+    VkBool32 fragPlanarYuv = planarYuv ? VK_TRUE : VK_FALSE;
+    VkSpecializationMapEntry fragSpecEntry{};
+    fragSpecEntry.constantID = 0;
+    fragSpecEntry.offset = 0;
+    fragSpecEntry.size = sizeof(VkBool32);
+
+    VkSpecializationInfo fragSpecInfo{};
+    fragSpecInfo.mapEntryCount = 1;
+    fragSpecInfo.pMapEntries = &fragSpecEntry;
+    fragSpecInfo.dataSize = sizeof(VkBool32);
+    fragSpecInfo.pData = &fragPlanarYuv;
+
     VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
     fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     fragShaderStageInfo.module = fragShaderModule;
     fragShaderStageInfo.pName = "main";
+    fragShaderStageInfo.pSpecializationInfo = &fragSpecInfo;
 
     VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
@@ -918,7 +1377,7 @@ void VkDisplay::createGraphicsPipeline() {
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    VkResult result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline);
+    VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &graphicsPipeline);
     if (result != VK_SUCCESS) {
         vkDestroyShaderModule(device, fragShaderModule, nullptr);
         vkDestroyShaderModule(device, vertShaderModule, nullptr);
@@ -966,76 +1425,184 @@ void VkDisplay::createCommandPool() {
     }
 }
 
-void VkDisplay::createTextureResources() {
+bool VkDisplay::checkLinearTextureSupport() {
+    // CPU 直接写入纹理只在统一内存上有意义：需要既设备本地又主机可见的内存，
+    // 以及线性排列的纹理格式支持采样和线性过滤（线性纹理由 CPU 写入和清为黑色，不做任何传输）
+    if (gpuColorExpansion) {
+        std::cerr << "Linear textures disabled: GPU color expansion writes the textures" << std::endl;
+        return false;
+    }
+    // CPU 覆盖纹理前须等待采样它的最后一次提交（可能是其他槽位的绘制），按 frameTimeline 上的序号等待
+    if (!timelineSemaphores) {
+        std::cerr << "Linear textures disabled: timeline semaphores not supported" << std::endl;
+        return false;
+    }
+
+    VkFormat format = planarYuv ? VK_FORMAT_R8_UNORM : VK_FORMAT_R8G8B8A8_UNORM;
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+    const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                          VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if ((formatProperties.linearTilingFeatures & required) != required) {
+        std::cerr << "Linear textures disabled: linear tiling can not be sampled" << std::endl;
+        return false;
+    }
+
+    const VkMemoryPropertyFlags memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if ((memProperties.memoryTypes[i].propertyFlags & memoryFlags) == memoryFlags) {
+            std::cout << "Texture uploads: host writes into linear textures" << std::endl;
+            return true;
+        }
+    }
+    std::cerr << "Linear textures disabled: no host visible device local memory" << std::endl;
+    return false;
+}
+
+void VkDisplay::createTexturePlane(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage,
+                                   VkImage& image, VkDeviceMemory& memory, VkImageView& view,
+                                   unsigned char*& mapped, VkDeviceSize& rowPitch) {
     // 图像创建信息
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.width = 1920;  // 相机图像宽度
-    imageInfo.extent.height = 1080; // 相机图像高度
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
     imageInfo.mipLevels = 1;
     imageInfo.arrayLayers = 1;
-    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.format = format;
+    // 线性纹理从 Preinitialized 开始：主机写入只允许在 Preinitialized 或 General 布局下进行
+    imageInfo.tiling = linearTextures ? VK_IMAGE_TILING_LINEAR : VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = linearTextures ? VK_IMAGE_LAYOUT_PREINITIALIZED : VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    // 创建左眼纹理图像
-    if (vkCreateImage(device, &imageInfo, nullptr, &leftTextureImage) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create left texture image!");
-    }
-
-    // 创建右眼纹理图像
-    if (vkCreateImage(device, &imageInfo, nullptr, &rightTextureImage) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create right texture image!");
+    if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create stream texture image!");
     }
 
-    // 为图像分配内存
     VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device, leftTextureImage, &memRequirements);
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
 
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
+        linearTextures ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                       : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &leftTextureImageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate left texture image memory!");
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate stream texture image memory!");
     }
 
-    vkBindImageMemory(device, leftTextureImage, leftTextureImageMemory, 0);
+    vkBindImageMemory(device, image, memory, 0);
 
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &rightTextureImageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate right texture image memory!");
-    }
+    // 线性纹理持久映射：行距由驱动决定（通常按 64 或 256 字节对齐），写入时逐行按 rowPitch 前进
+    mapped = nullptr;
+    rowPitch = 0;
+    if (linearTextures) {
+        VkImageSubresource subresource{};
+        subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        VkSubresourceLayout layout;
+        vkGetImageSubresourceLayout(device, image, &subresource, &layout);
 
-    vkBindImageMemory(device, rightTextureImage, rightTextureImageMemory, 0);
+        void* data = nullptr;
+        if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to map stream texture image memory!");
+        }
+        mapped = static_cast<unsigned char*>(data) + layout.offset;
+        rowPitch = layout.rowPitch;
+    }
 
-    // 创建图像视图
+    // 图像视图创建信息
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    viewInfo.image = leftTextureImage;
+    viewInfo.image = image;
     viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     viewInfo.subresourceRange.baseMipLevel = 0;
     viewInfo.subresourceRange.levelCount = 1;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
 
-    if (vkCreateImageView(device, &viewInfo, nullptr, &leftTextureImageView) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create left texture image view!");
+    if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create stream texture image view!");
     }
+}
+
+void VkDisplay::createTextureResources(int stream) {
+    // 缓冲区拷贝和清为黑色写入纹理；最新图像不在本槽位时绘制命令直接采样那个槽位的纹理，纹理之间不拷贝。
+    // 线性纹理由 CPU 写入和清为黑色，只需采样
+    VkImageUsageFlags usage = linearTextures ? VK_IMAGE_USAGE_SAMPLED_BIT
+                                             : VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (gpuColorExpansion) {
+        usage |= VK_IMAGE_USAGE_STORAGE_BIT;  // 计算着色器直接写入
+    }
+
+    // 为每个帧槽位创建该路流的纹理图像、分配内存并创建图像视图：上传只写本槽位的纹理，
+    // 不必等待其他在途帧绘制完成；平面 YUV 路径为全宽的 Y 平面和两张半宽的 Cb/Cr 平面（4:2:2，行数相同）。
+    // 尺寸取该路流的相机格式，各路流的纹理互不影响
+    const uint32_t width = streamExtents[stream].width;
+    const uint32_t height = streamExtents[stream].height;
+    streamTextures.resize(framesInFlight * streamCount);
+    latestSlot.resize(streamCount, -1);
+    latestSlot[stream] = -1;
+    for (int slot = 0; slot < framesInFlight; slot++) {
+        StreamTexture& texture = streamTexture(slot, stream);
+        texture.extent = {width, height};
+        if (!planarYuv) {
+            createTexturePlane(width, height, VK_FORMAT_R8G8B8A8_UNORM, usage,
+                               texture.image, texture.memory, texture.view, texture.mapped, texture.rowPitch);
+        } else {
+            createTexturePlane(width, height, VK_FORMAT_R8_UNORM, usage,
+                               texture.image, texture.memory, texture.view, texture.mapped, texture.rowPitch);
+            for (auto& plane : texture.chroma) {
+                createTexturePlane((width + 1) / 2, height, VK_FORMAT_R8_UNORM, usage,
+                                   plane.image, plane.memory, plane.view, plane.mapped, plane.rowPitch);
+            }
+        }
+        if (!linearTextures) {
+            continue;
+        }
 
-    viewInfo.image = rightTextureImage;
-    if (vkCreateImageView(device, &viewInfo, nullptr, &rightTextureImageView) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create right texture image view!");
+        // 线性纹理没有 Undefined 状态可供 recordUploads 清除：在此直接写为黑色（Cb/Cr 为 128，无色度）
+        texture.state.layout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+        for (uint32_t y = 0; y < height; y++) {
+            unsigned char* row = texture.mapped + texture.rowPitch * y;
+            if (planarYuv) {
+                memset(row, 0, width);
+                continue;
+            }
+            for (uint32_t x = 0; x < width; x++) {
+                row[x * 4] = 0;
+                row[x * 4 + 1] = 0;
+                row[x * 4 + 2] = 0;
+                row[x * 4 + 3] = 255;
+            }
+        }
+        for (auto& plane : texture.chroma) {
+            if (plane.mapped == nullptr) {
+                continue;
+            }
+            plane.state.layout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+            for (uint32_t y = 0; y < height; y++) {
+                memset(plane.mapped + plane.rowPitch * y, 128, (width + 1) / 2);
+            }
+        }
     }
 
-    // 创建采样器
+    // 创建采样器（与图像尺寸无关，所有流共用，setFrameSize 重新分配纹理时沿用）
+    if (textureSampler != VK_NULL_HANDLE) {
+        return;
+    }
     VkSamplerCreateInfo samplerInfo{};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
     samplerInfo.magFilter = VK_FILTER_LINEAR;
@@ -1058,18 +1625,63 @@ void VkDisplay::createTextureResources() {
     }
 }
 
-void VkDisplay::createStagingBuffer() {
-    VkDeviceSize bufferSize = 1920 * 1080 * 4 * 2;  // 左眼 + 右眼，RGBA格式
+void VkDisplay::destroyStreamTexture(StreamTexture& texture) {
+    // 描述符集随描述符池释放
+    if (texture.view != VK_NULL_HANDLE) {
+        vkDestroyImageView(device, texture.view, nullptr);
+    }
+    if (texture.image != VK_NULL_HANDLE) {
+        vkDestroyImage(device, texture.image, nullptr);
+    }
+    if (texture.memory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, texture.memory, nullptr);
+    }
+    for (auto& plane : texture.chroma) {
+        if (plane.view != VK_NULL_HANDLE) {
+            vkDestroyImageView(device, plane.view, nullptr);
+        }
+        if (plane.image != VK_NULL_HANDLE) {
+            vkDestroyImage(device, plane.image, nullptr);
+        }
+        if (plane.memory != VK_NULL_HANDLE) {
+            vkFreeMemory(device, plane.memory, nullptr);
+        }
+    }
+    texture = StreamTexture{};
+}
+
+void VkDisplay::createStagingBuffer(int stream) {
+    // 各路流的上传来源与解码目标（解码目标在相机连上后由 createDecodeTargets 分配）
+    streamUploads.resize(streamCount);
+    pendingOwners.resize(streamCount);
+    decodeTargets.resize(streamCount);
+    streamUploads[stream] = StreamUpload{};
+    pendingOwners[stream] = nullptr;
+
+    // 线性纹理由 CPU 直接写入，不需要暂存缓冲区
+    if (linearTextures) {
+        return;
+    }
 
-    stagingBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    stagingBufferMemories.resize(MAX_FRAMES_IN_FLIGHT);
-    stagingBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    // 每个槽位一个按该路流图像尺寸分配的缓冲区：拷贝路径为 RGBA，GPU 颜色扩展路径为打包 RGB，
+    // 平面 YUV 路径为 YUV422P
+    const VkExtent2D extent = streamExtents[stream];
+    VkDeviceSize bufferSize;
+    if (planarYuv) {
+        bufferSize = frameBytes(PixelFormat::YUV422P, planarPitch(extent.width), extent.height);
+    } else {
+        bufferSize = VkDeviceSize(extent.width) * extent.height * (gpuColorExpansion ? 3 : 4);
+    }
+    stagingBuffers.resize(framesInFlight * streamCount, VK_NULL_HANDLE);
+    stagingBufferMemories.resize(framesInFlight * streamCount, VK_NULL_HANDLE);
+    stagingBuffersMapped.resize(framesInFlight * streamCount, nullptr);
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (int slot = 0; slot < framesInFlight; slot++) {
+        const int i = slot * streamCount + stream;
         VkBufferCreateInfo bufferInfo{};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
         bufferInfo.size = bufferSize;
-        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.usage = gpuColorExpansion ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
         if (vkCreateBuffer(device, &bufferInfo, nullptr, &stagingBuffers[i]) != VK_SUCCESS) {
@@ -1097,96 +1709,678 @@ void VkDisplay::createStagingBuffer() {
     }
 }
 
-void VkDisplay::createDescriptors() {
-    // 创建描述符池
-    VkDescriptorPoolSize poolSize{};
-    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSize.descriptorCount = 2;  // 左眼 + 右眼
-
-    VkDescriptorPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 1;
-    poolInfo.pPoolSizes = &poolSize;
-    poolInfo.maxSets = 1;
-
-    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create descriptor pool!");
-    }
+bool VkDisplay::importDecodeTargets(DecodeTargets& dt, VkBufferCreateInfo bufferInfo) {
+    // 导入的指针和大小都须按 minImportedHostPointerAlignment（通常为页大小）对齐
+    VkDeviceSize size = (bufferInfo.size + hostPointerAlignment - 1) / hostPointerAlignment * hostPointerAlignment;
+    try {
+        dt.hostAllocation = aligned_alloc(static_cast<size_t>(hostPointerAlignment), static_cast<size_t>(size));
+        if (dt.hostAllocation == nullptr) {
+            throw std::runtime_error("Failed to allocate decode target host memory!");
+        }
 
-    // 分配描述符集
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &descriptorSetLayout;
+        VkMemoryHostPointerPropertiesEXT pointerProperties{};
+        pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+        if (getMemoryHostPointerPropertiesFn(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                                             dt.hostAllocation, &pointerProperties) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to query host pointer properties!");
+        }
 
-    if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate descriptor set!");
-    }
+        VkExternalMemoryBufferCreateInfo externalInfo{};
+        externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+        externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+        bufferInfo.pNext = &externalInfo;
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &dt.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create decode target buffer!");
+        }
 
-    // 更新描述符集
-    VkDescriptorImageInfo leftImageInfo{};
-    leftImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    leftImageInfo.imageView = leftTextureImageView;
-    leftImageInfo.sampler = textureSampler;
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, dt.buffer, &memRequirements);
+        if (memRequirements.size > size) {
+            throw std::runtime_error("Imported host memory is smaller than the decode target buffer!");
+        }
 
-    VkDescriptorImageInfo rightImageInfo{};
-    rightImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    rightImageInfo.imageView = rightTextureImageView;
-    rightImageInfo.sampler = textureSampler;
+        // 解码线程写入后不刷新缓存，导入的内存须为主机一致的类型
+        VkImportMemoryHostPointerInfoEXT importInfo{};
+        importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+        importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+        importInfo.pHostPointer = dt.hostAllocation;
 
-    VkWriteDescriptorSet descriptorWrites[2]{};
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = &importInfo;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits & pointerProperties.memoryTypeBits,
+                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = descriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pImageInfo = &leftImageInfo;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &dt.memory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to import decode target host memory!");
+        }
 
-    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = descriptorSet;
-    descriptorWrites[1].dstBinding = 1;
-    descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[1].descriptorCount = 1;
-    descriptorWrites[1].pImageInfo = &rightImageInfo;
+        vkBindBufferMemory(device, dt.buffer, dt.memory, 0);
+        dt.mapped = static_cast<unsigned char*>(dt.hostAllocation);
+        return true;
+    } catch (const std::exception& e) {
+        // 退回分配主机可见的设备内存
+        std::cerr << "VkDisplay::createDecodeTargets: host memory import failed: " << e.what() << std::endl;
+        destroyDecodeTargets(dt);
+        return false;
+    }
+}
 
-    vkUpdateDescriptorSets(device, 2, descriptorWrites, 0, nullptr);
+void VkDisplay::destroyDecodeTargets(DecodeTargets& dt) {
+    // 导入的主机内存没有映射，设备内存释放后才能归还给分配器
+    if (dt.mapped != nullptr && dt.hostAllocation == nullptr) {
+        vkUnmapMemory(device, dt.memory);
+    }
+    if (dt.buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, dt.buffer, nullptr);
+    }
+    if (dt.memory != VK_NULL_HANDLE) {
+        vkFreeMemory(device, dt.memory, nullptr);
+    }
+    free(dt.hostAllocation);
+    dt = DecodeTargets{};
 }
 
-void VkDisplay::updateVideo(unsigned char* leftData, unsigned char* rightData, int width, int height) {
-    auto start = std::chrono::high_resolution_clock::now();
+std::vector<unsigned char*> VkDisplay::createDecodeTargets(int stream, uint32_t count, uint32_t& pitch, PixelFormat& format) {
+    std::vector<unsigned char*> targets;
+    // 线性纹理：解码目标按 V4L2 缓冲区绑定、纹理按帧槽位轮换，两者无法一一对应，解码器写入自己的缓冲区，
+    // updateVideo 再由 CPU 写入纹理（只有这一次写入，没有 GPU 拷贝）
+    if (linearTextures || stream < 0 || stream >= static_cast<int>(decodeTargets.size()) || count == 0) {
+        return targets;
+    }
+
+    DecodeTargets& dt = decodeTargets[stream];
+    if (dt.buffer == VK_NULL_HANDLE) {
+        try {
+            // 拷贝路径：行距按拷贝的最佳行对齐取整（bufferRowLength 以纹素计，需为 4 字节的整数倍）；
+            // GPU 颜色扩展路径：打包 RGB，行距取 4 字节对齐，整个缓冲区作为一个存储缓冲区绑定；
+            // 平面 YUV 路径：Y 行距不小于 planarPitch，取最佳行对齐的两倍，使半宽的色度行同样对齐。
+            // 每个图像的起点按最佳偏移对齐，且不小于 256 字节
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+            VkDeviceSize copyRowAlign = std::max<VkDeviceSize>(properties.limits.optimalBufferCopyRowPitchAlignment, 4);
+            VkDeviceSize offsetAlign = std::max<VkDeviceSize>(properties.limits.optimalBufferCopyOffsetAlignment, 256);
+            const VkExtent2D extent = streamExtents[stream];
+            VkDeviceSize rowBytes;
+            VkDeviceSize imageBytes;
+            if (planarYuv) {
+                VkDeviceSize rowAlign = copyRowAlign * 2;
+                rowBytes = (VkDeviceSize(planarPitch(extent.width)) + rowAlign - 1) / rowAlign * rowAlign;
+                imageBytes = frameBytes(PixelFormat::YUV422P, static_cast<unsigned int>(rowBytes), extent.height);
+            } else {
+                VkDeviceSize bytesPerPixel = gpuColorExpansion ? 3 : 4;
+                VkDeviceSize rowAlign = gpuColorExpansion ? 4 : copyRowAlign;
+                rowBytes = (VkDeviceSize(extent.width) * bytesPerPixel + rowAlign - 1) / rowAlign * rowAlign;
+                imageBytes = rowBytes * extent.height;
+            }
+            VkDeviceSize slotSize = (imageBytes + offsetAlign - 1) / offsetAlign * offsetAlign;
+            if (gpuColorExpansion && slotSize * count > properties.limits.maxStorageBufferRange) {
+                throw std::runtime_error("Decode targets exceed maxStorageBufferRange!");
+            }
 
-    // 使用当前帧对应的 staging buffer
-    void* mapped = stagingBuffersMapped[currentFrame];
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = slotSize * count;
+            bufferInfo.usage = gpuColorExpansion ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            // 优先导入按页对齐的主机内存：解码器写入普通的带缓存内存，拷贝直接从中读取
+            if (!hostMemoryImport || !importDecodeTargets(dt, bufferInfo)) {
+                if (vkCreateBuffer(device, &bufferInfo, nullptr, &dt.buffer) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create decode target buffer!");
+                }
+
+                VkMemoryRequirements memRequirements;
+                vkGetBufferMemoryRequirements(device, dt.buffer, &memRequirements);
+
+                // 录像线程也从解码目标读取，优先选择带 CPU 缓存的内存，避免读写合并内存
+                uint32_t memoryType;
+                try {
+                    memoryType = findMemoryType(memRequirements.memoryTypeBits,
+                                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                                                VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+                } catch (const std::runtime_error&) {
+                    memoryType = findMemoryType(memRequirements.memoryTypeBits,
+                                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+                }
+
+                VkMemoryAllocateInfo allocInfo{};
+                allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+                allocInfo.allocationSize = memRequirements.size;
+                allocInfo.memoryTypeIndex = memoryType;
+
+                if (vkAllocateMemory(device, &allocInfo, nullptr, &dt.memory) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to allocate decode target memory!");
+                }
+
+                vkBindBufferMemory(device, dt.buffer, dt.memory, 0);
+
+                // 持久映射内存
+                void* mapped = nullptr;
+                if (vkMapMemory(device, dt.memory, 0, bufferInfo.size, 0, &mapped) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to map decode target memory!");
+                }
+                dt.mapped = static_cast<unsigned char*>(mapped);
+            }
+            dt.slotSize = slotSize;
+            dt.count = count;
+            dt.pitch = static_cast<uint32_t>(rowBytes);
+            if (gpuColorExpansion) {
+                for (int slot = 0; slot < framesInFlight; slot++) {
+                    dt.expandSets.push_back(createExpandSet(stream, streamTexture(slot, stream), dt.buffer));
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "VkDisplay::createDecodeTargets: " << e.what() << std::endl;
+            destroyDecodeTargets(dt);
+            return targets;
+        }
+    } else if (dt.count != count) {
+        // 已交给解码线程的目标可能仍在写入，不能重新分配
+        std::cerr << "VkDisplay::createDecodeTargets: stream " << stream << " already has "
+                  << dt.count << " decode targets" << std::endl;
+        return targets;
+    }
 
-    // 左眼图像：包装外部数据为cv::Mat（不分配新内存）
-    cv::Mat leftBGR(height, width, CV_8UC3, leftData);
-    // 右眼图像：包装外部数据为cv::Mat（不分配新内存）
-    cv::Mat rightBGR(height, width, CV_8UC3, rightData);
+    pitch = dt.pitch;
+    format = planarYuv ? PixelFormat::YUV422P : gpuColorExpansion ? PixelFormat::RGB : PixelFormat::RGBX;
+    for (uint32_t i = 0; i < dt.count; i++) {
+        targets.push_back(dt.mapped + dt.slotSize * i);
+    }
+    return targets;
+}
 
-    // 左眼目标：包装暂存缓冲区为cv::Mat（不分配新内存）
-    cv::Mat leftRGBA(height, width, CV_8UC4, static_cast<unsigned char*>(mapped));
-    // 右眼目标：包装暂存缓冲区第二部分为cv::Mat（不分配新内存）
-    cv::Mat rightRGBA(height, width, CV_8UC4,
-                      static_cast<unsigned char*>(mapped) + width * height * 4);
+void VkDisplay::createDescriptors(int stream) {
+    // 创建描述符池：每路流一个（该路流重新分配纹理时整池替换），每个槽位一个描述符集，每个集合三个采样器
+    descriptorPools.resize(streamCount, VK_NULL_HANDLE);
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = static_cast<uint32_t>(framesInFlight * 3);
 
-    // 使用OpenCV SIMD加速转换（零拷贝）
-    cv::cvtColor(leftBGR, leftRGBA, cv::COLOR_BGR2BGRA);
-    cv::cvtColor(rightBGR, rightRGBA, cv::COLOR_BGR2BGRA);
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = static_cast<uint32_t>(framesInFlight);
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPools[stream]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor pool!");
+    }
+
+    // 分配描述符集
+    std::vector<VkDescriptorSetLayout> layouts(framesInFlight, descriptorSetLayout);
+    std::vector<VkDescriptorSet> sets(framesInFlight);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPools[stream];
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(framesInFlight);
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set!");
+    }
+
+    // 更新描述符集：每个集合指向一张纹理（RGBA 纹理同时填入未使用的 Cb/Cr 绑定）
+    std::vector<VkDescriptorImageInfo> imageInfos(framesInFlight * 3);
+    std::vector<VkWriteDescriptorSet> descriptorWrites(framesInFlight * 3);
+    for (int slot = 0; slot < framesInFlight; slot++) {
+        StreamTexture& texture = streamTexture(slot, stream);
+        texture.descriptorSet = sets[slot];
+
+        for (int b = 0; b < 3; b++) {
+            VkDescriptorImageInfo& imageInfo = imageInfos[slot * 3 + b];
+            imageInfo.imageLayout = sampledLayout();
+            imageInfo.imageView = (planarYuv && b > 0) ? texture.chroma[b - 1].view : texture.view;
+            imageInfo.sampler = textureSampler;
+
+            VkWriteDescriptorSet& write = descriptorWrites[slot * 3 + b];
+            write = VkWriteDescriptorSet{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = sets[slot];
+            write.dstBinding = static_cast<uint32_t>(b);
+            write.dstArrayElement = 0;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.descriptorCount = 1;
+            write.pImageInfo = &imageInfo;
+        }
+    }
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+    // GPU 颜色扩展：每张纹理一个集合（源为同一槽位该路流的暂存缓冲区），解码目标的集合（每个槽位一个）在分配时创建
+    if (gpuColorExpansion) {
+        expandDescriptorPools.resize(streamCount, VK_NULL_HANDLE);
+        VkDescriptorPoolSize expandPoolSizes[2]{};
+        expandPoolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        expandPoolSizes[0].descriptorCount = static_cast<uint32_t>(framesInFlight * 2);
+        expandPoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        expandPoolSizes[1].descriptorCount = static_cast<uint32_t>(framesInFlight * 2);
+
+        VkDescriptorPoolCreateInfo expandPoolInfo{};
+        expandPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        expandPoolInfo.poolSizeCount = 2;
+        expandPoolInfo.pPoolSizes = expandPoolSizes;
+        expandPoolInfo.maxSets = static_cast<uint32_t>(framesInFlight * 2);
+
+        if (vkCreateDescriptorPool(device, &expandPoolInfo, nullptr, &expandDescriptorPools[stream]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create expand descriptor pool!");
+        }
+
+        for (int slot = 0; slot < framesInFlight; slot++) {
+            streamTexture(slot, stream).expandSet = createExpandSet(stream, streamTexture(slot, stream),
+                                                                    stagingBuffers[slot * streamCount + stream]);
+        }
+    }
+}
+
+bool VkDisplay::setFrameSize(int stream, uint32_t width, uint32_t height) {
+    if (stream < 0 || width == 0 || height == 0) {
+        return false;
+    }
+    if (device == VK_NULL_HANDLE) {
+        // init 之前：该路流的资源按此尺寸创建
+        if (streamExtents.size() <= static_cast<size_t>(stream)) {
+            streamExtents.resize(stream + 1, {DEFAULT_FRAME_WIDTH, DEFAULT_FRAME_HEIGHT});
+        }
+        streamExtents[stream] = {width, height};
+        return true;
+    }
+    if (stream >= streamCount) {
+        return false;
+    }
+    VkExtent2D& extent = streamExtents[stream];
+    if (width == extent.width && height == extent.height) {
+        return true;
+    }
+    if (decodeTargets[stream].buffer != VK_NULL_HANDLE) {
+        std::cerr << "Cannot change frame size of stream " << stream << " to " << width << "x" << height
+                  << ": decode targets are allocated for " << extent.width << "x" << extent.height << std::endl;
+        return false;
+    }
+
+    try {
+        // 传输队列上已提交的拷贝还在读旧的暂存缓冲区、写旧纹理：只等待这些拷贝，图形队列照常运行
+        if (transferUploads && uploadCounter != 0) {
+            VkSemaphoreWaitInfo waitInfo{};
+            waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            waitInfo.semaphoreCount = 1;
+            waitInfo.pSemaphores = &uploadTimeline;
+            waitInfo.pValues = &uploadCounter;
+            waitSemaphoresFn(device, &waitInfo, UINT64_MAX);
+        }
+
+        // 在途的帧仍在采样该路流的旧纹理：旧资源退役，由 draw 在槽位等待覆盖这些提交后销毁。
+        // 其他路流的纹理、暂存缓冲区、描述符和解码目标不受影响
+        RetiredResources retired;
+        retired.submitCount = submitCount;
+        for (int slot = 0; slot < framesInFlight; slot++) {
+            const int index = slot * streamCount + stream;
+            retired.textures.push_back(streamTextures[index]);
+            streamTextures[index] = StreamTexture{};
+            textureReadValues[index] = 0;
+            if (!stagingBuffers.empty()) {
+                retired.buffers.push_back(stagingBuffers[index]);
+                retired.memories.push_back(stagingBufferMemories[index]);
+                stagingBuffers[index] = VK_NULL_HANDLE;
+                stagingBufferMemories[index] = VK_NULL_HANDLE;
+                stagingBuffersMapped[index] = nullptr;
+            }
+        }
+        retired.descriptorPools.push_back(descriptorPools[stream]);
+        descriptorPools[stream] = VK_NULL_HANDLE;
+        if (!expandDescriptorPools.empty()) {
+            retired.descriptorPools.push_back(expandDescriptorPools[stream]);
+            expandDescriptorPools[stream] = VK_NULL_HANDLE;
+        }
+        retiredResources.push_back(std::move(retired));
+
+        extent = {width, height};
+        createTextureResources(stream);
+        createStagingBuffer(stream);
+        createDescriptors(stream);
+        rejectedExtents[stream] = {0, 0};
+
+        // 预录制的绘制命令引用旧的描述符集：其他槽位的命令可能仍在执行，各自在槽位复用时重新录制
+        for (auto& entry : renderCommandBuffers) {
+            entry.second.dirty = true;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to resize stream " << stream << " textures: " << e.what() << std::endl;
+        return false;
+    }
+
+    std::cout << "Stream " << stream << " frame size: " << width << "x" << height << std::endl;
+    return true;
+}
+
+void VkDisplay::destroyRetiredResources(bool all) {
+    // 提交按顺序完成：当前槽位的等待覆盖了 submitCount - framesInFlight 及之前的全部提交
+    for (auto it = retiredResources.begin(); it != retiredResources.end();) {
+        if (!all && submitCount + 1 < it->submitCount + framesInFlight) {
+            ++it;
+            continue;
+        }
+        for (auto pool : it->descriptorPools) {
+            if (pool != VK_NULL_HANDLE) {
+                vkDestroyDescriptorPool(device, pool, nullptr);
+            }
+        }
+        for (auto& texture : it->textures) {
+            destroyStreamTexture(texture);
+        }
+        for (auto buffer : it->buffers) {
+            vkDestroyBuffer(device, buffer, nullptr);
+        }
+        for (auto memory : it->memories) {
+            vkFreeMemory(device, memory, nullptr);  // 映射随释放解除
+        }
+        it = retiredResources.erase(it);
+    }
+}
+
+void VkDisplay::createExpandPipeline() {
+    // 图形队列须同时支持计算（规范保证存在这样的队列族，这里只检查选中的那个）
+    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    if (!(queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+        throw std::runtime_error("The graphics queue does not support compute!");
+    }
+
+    // 描述符集布局：binding 0 为打包像素（存储缓冲区），binding 1 为目标纹理（存储图像）
+    VkDescriptorSetLayoutBinding bindings[2]{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &expandSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create expand descriptor set layout!");
+    }
+
+    // 管线布局：图像在缓冲区中的位置和尺寸通过推送常量传入
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(ExpandParams);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &expandSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &expandPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create expand pipeline layout!");
+    }
+
+    // 计算着色器（嵌入的 SPIR-V），R/B 顺序由特化常量 0 决定
+    VkShaderModule expandShaderModule = createShaderModule(expand_spv, sizeof(expand_spv));
+
+    VkBool32 swapRedBlue = expandSwapRedBlue ? VK_TRUE : VK_FALSE;
+    VkSpecializationMapEntry specEntry{};
+    specEntry.constantID = 0;
+    specEntry.offset = 0;
+    specEntry.size = sizeof(VkBool32);
+
+    VkSpecializationInfo specInfo{};
+    specInfo.mapEntryCount = 1;
+    specInfo.pMapEntries = &specEntry;
+    specInfo.dataSize = sizeof(VkBool32);
+    specInfo.pData = &swapRedBlue;
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = expandShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = &specInfo;
+    pipelineInfo.layout = expandPipelineLayout;
+
+    VkResult result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &expandPipeline);
+    vkDestroyShaderModule(device, expandShaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create expand pipeline! Error: " + std::to_string(result));
+    }
+}
+
+void VkDisplay::destroyExpandPipeline() {
+    for (auto& pool : expandDescriptorPools) {
+        if (pool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+    }
+    expandDescriptorPools.clear();
+    if (expandPipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, expandPipeline, nullptr);
+        expandPipeline = VK_NULL_HANDLE;
+    }
+    if (expandPipelineLayout != VK_NULL_HANDLE) {
+        vkDestroyPipelineLayout(device, expandPipelineLayout, nullptr);
+        expandPipelineLayout = VK_NULL_HANDLE;
+    }
+    if (expandSetLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, expandSetLayout, nullptr);
+        expandSetLayout = VK_NULL_HANDLE;
+    }
+}
+
+VkDescriptorSet VkDisplay::createExpandSet(int stream, const StreamTexture& texture, VkBuffer source) {
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = expandDescriptorPools[stream];
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &expandSetLayout;
+
+    VkDescriptorSet set;
+    if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate expand descriptor set!");
+    }
+
+    // 整个缓冲区绑定为一个存储缓冲区，图像的偏移由推送常量给出
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = source;
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageView = texture.view;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet writes[2]{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[0].descriptorCount = 1;
+    writes[0].pBufferInfo = &bufferInfo;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = set;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].descriptorCount = 1;
+    writes[1].pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+    return set;
+}
+
+void VkDisplay::updateVideo(const std::vector<const unsigned char*>& streams, int width, int height,
+                            const std::vector<std::shared_ptr<const void>>& owners) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    int count = std::min(static_cast<int>(streams.size()), streamCount);
+    for (int i = 0; i < count; i++) {
+        updateStream(i, streams[i], width, height, i < static_cast<int>(owners.size()) ? owners[i] : nullptr);
+    }
 
     auto end = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 
-    // 注意：纹理上传将在recordCommandBuffer中进行，无需额外操作
+    // 注意：图形队列路径的纹理上传将在recordUploads中进行，无需额外操作
 
 #if DO_EFFECIENCY_TEST
     printf("COLOR_CONVERSION: %ld us\n", duration.count());
+#else
+    (void)duration;
 #endif
 }
 
+void VkDisplay::updateStream(int stream, const unsigned char* data, int width, int height,
+                             const std::shared_ptr<const void>& owner) {
+    if (stream < 0 || stream >= streamCount || data == nullptr) {
+        return;
+    }
+
+    // 采集格式变化：按新尺寸重新分配该路流的纹理和暂存缓冲区，失败时不上传（数据与纹理尺寸不符）；
+    // 失败过的尺寸不再逐帧重试，该尺寸的帧直接丢弃
+    const VkExtent2D extent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+    if (extent.width != streamExtents[stream].width || extent.height != streamExtents[stream].height) {
+        const VkExtent2D& rejected = rejectedExtents[stream];
+        if (extent.width == rejected.width && extent.height == rejected.height) {
+            return;
+        }
+        if (!setFrameSize(stream, extent.width, extent.height)) {
+            rejectedExtents[stream] = extent;
+            return;
+        }
+    }
+
+    // 使用当前帧对应的 staging buffer：先等待该槽位上一次提交的拷贝完成再覆盖（同一帧内再次调用时立即返回）
+    waitForSlot(currentFrame);
+
+    stageUpload(stream, data, width, height, owner);
+
+    // 该路流的数据已就绪：传输队列模式下立即提交拷贝，不等其他路流
+    if (transferUploads && streamUploads[stream].expandSet == VK_NULL_HANDLE) {
+        submitTransferUpload(stream);
+    }
+}
+
+void VkDisplay::stageUpload(int stream, const unsigned char* data, int width, int height,
+                            const std::shared_ptr<const void>& owner) {
+    StreamUpload& upload = streamUploads[stream];
+
+    // 同一帧内第二次更新该路流：等待上一次的传输拷贝读完暂存内存
+    if (upload.transferValue != 0) {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &uploadTimeline;
+        waitInfo.pValues = &upload.transferValue;
+        waitSemaphoresFn(device, &waitInfo, UINT64_MAX);
+        upload.transferValue = 0;
+    }
+
+    if (linearTextures) {
+        writeLinearTexture(stream, data, width, height);
+        return;
+    }
+    upload.extent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+
+    // 数据已由解码器写入解码目标：只记录拷贝来源，并持有该帧直到 GPU 拷贝完成
+    for (const auto& dt : decodeTargets) {
+        if (dt.mapped != nullptr && data >= dt.mapped && data < dt.mapped + dt.slotSize * dt.count) {
+            upload.buffer = dt.buffer;
+            upload.offset = static_cast<VkDeviceSize>(data - dt.mapped);
+            upload.pitch = dt.pitch;
+            upload.expandSet = dt.expandSets.empty() ? VK_NULL_HANDLE : dt.expandSets[currentFrame];
+            pendingOwners[stream] = owner;
+            return;
+        }
+    }
+
+    const int index = static_cast<int>(currentFrame) * streamCount + stream;
+    unsigned char* mapped = static_cast<unsigned char*>(stagingBuffersMapped[index]);
+    upload.buffer = stagingBuffers[index];
+    upload.offset = 0;
+    upload.pitch = 0;
+    upload.expandSet = VK_NULL_HANDLE;
+    pendingOwners[stream] = nullptr;
+
+    if (planarYuv) {
+        // YUV422P 原样写入（行距与解码器对平面输出的最小行距一致），由片段着色器转换
+        uint32_t pitch = planarPitch(static_cast<unsigned int>(width));
+        memcpy(mapped + upload.offset, data, frameBytes(PixelFormat::YUV422P, pitch, height));
+        upload.pitch = pitch;
+        return;
+    }
+
+    if (gpuColorExpansion) {
+        // 打包 RGB 原样写入，由计算着色器展开
+        memcpy(mapped + upload.offset, data, static_cast<size_t>(width) * height * 3);
+        upload.pitch = static_cast<uint32_t>(width) * 3;
+        upload.expandSet = streamTexture(currentFrame, stream).expandSet;
+        return;
+    }
+
+    // 源图像：包装外部数据为cv::Mat（不分配新内存）
+    cv::Mat bgr(height, width, CV_8UC3, const_cast<unsigned char*>(data));
+    // 目标：包装暂存缓冲区中该路流的区域为cv::Mat（不分配新内存）
+    cv::Mat rgba(height, width, CV_8UC4, mapped + upload.offset);
+
+    // 使用OpenCV SIMD加速转换（零拷贝）
+    cv::cvtColor(bgr, rgba, cv::COLOR_BGR2BGRA);
+}
+
+void VkDisplay::writeLinearTexture(int stream, const unsigned char* data, int width, int height) {
+    StreamUpload& upload = streamUploads[stream];
+    const int index = static_cast<int>(currentFrame) * streamCount + stream;
+    StreamTexture& texture = streamTextures[index];
+
+    // 本槽位的绘制已由 updateVideo 等待；该纹理还可能被其他槽位的提交作为拷贝源读取（recordUploads），
+    // 覆盖前等待那次提交完成
+    if (!upload.hostWritten && textureReadValues[index] != 0) {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &frameTimeline;
+        waitInfo.pValues = &textureReadValues[index];
+        waitSemaphoresFn(device, &waitInfo, UINT64_MAX);
+    }
+    upload.hostWritten = true;
+    pendingOwners[stream] = nullptr;
+
+    if (planarYuv) {
+        // YUV422P 逐行写入三个平面（源行距与解码器对平面输出的最小行距一致）
+        uint32_t pitch = planarPitch(static_cast<unsigned int>(width));
+        for (int y = 0; y < height; y++) {
+            memcpy(texture.mapped + texture.rowPitch * y, data + static_cast<size_t>(pitch) * y, width);
+        }
+        for (int p = 1; p < 3; p++) {
+            const TexturePlane& plane = texture.chroma[p - 1];
+            const unsigned char* source = data + planeOffset(pitch, height, p);
+            for (int y = 0; y < height; y++) {
+                memcpy(plane.mapped + plane.rowPitch * y, source + static_cast<size_t>(pitch / 2) * y, (width + 1) / 2);
+            }
+        }
+        return;
+    }
+
+    // 纹理内存按驱动的行距包装为cv::Mat，转换结果直接写入纹理（零拷贝）
+    cv::Mat bgr(height, width, CV_8UC3, const_cast<unsigned char*>(data));
+    cv::Mat rgba(height, width, CV_8UC4, texture.mapped, static_cast<size_t>(texture.rowPitch));
+    cv::cvtColor(bgr, rgba, cv::COLOR_BGR2BGRA);
+}
+
 // 辅助函数：查找合适的内存类型
 uint32_t VkDisplay::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
     VkPhysicalDeviceMemoryProperties memProperties;
@@ -1220,10 +2414,81 @@ std::vector<char> VkDisplay::readFile(const std::string& filename) {
     return buffer;
 }
 
+void VkDisplay::createPipelineCache() {
+    // 上次保存的缓存数据：头部（VkPipelineCacheHeaderVersionOne）的厂商、设备 ID 和 pipelineCacheUUID
+    // 与当前设备一致才使用；换卡或升级驱动后 UUID 改变，旧数据丢弃，init 结束后重新写入
+    std::vector<char> data;
+    if (!pipelineCachePath.empty()) {
+        try {
+            data = readFile(pipelineCachePath);
+        } catch (const std::runtime_error&) {
+            // 第一次启动还没有缓存文件
+        }
+    }
+
+    pipelineCacheWarm = false;
+    if (!data.empty()) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        VkPipelineCacheHeaderVersionOne header{};
+        if (data.size() >= sizeof(header)) {
+            memcpy(&header, data.data(), sizeof(header));
+            pipelineCacheWarm = header.headerSize >= sizeof(header) &&
+                                header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                                header.vendorID == properties.vendorID &&
+                                header.deviceID == properties.deviceID &&
+                                memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+        if (!pipelineCacheWarm) {
+            std::cout << "Pipeline cache " << pipelineCachePath << " does not match this device/driver, rebuilding" << std::endl;
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(device, &createInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
+    if (pipelineCacheWarm) {
+        std::cout << "Pipeline cache: loaded " << data.size() << " bytes from " << pipelineCachePath << std::endl;
+    }
+}
+
+void VkDisplay::savePipelineCache() {
+    if (pipelineCache == VK_NULL_HANDLE || pipelineCachePath.empty()) {
+        return;
+    }
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    // 先写临时文件再改名：写入途中断电或退出不会留下不完整的缓存文件
+    std::string tempPath = pipelineCachePath + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(size));
+    file.close();
+    if (!file || std::rename(tempPath.c_str(), pipelineCachePath.c_str()) != 0) {
+        std::cerr << "Failed to save pipeline cache to " << pipelineCachePath << std::endl;
+        std::remove(tempPath.c_str());
+        return;
+    }
+    std::cout << "Pipeline cache: saved " << size << " bytes to " << pipelineCachePath << std::endl;
+}
+
 void VkDisplay::createSyncObjects() {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    imageAvailableSemaphores.resize(framesInFlight);
+    renderFinishedSemaphores.resize(framesInFlight);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1232,17 +2497,47 @@ void VkDisplay::createSyncObjects() {
     fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;  // 创建时设为已信号状态
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    inFlightOwners.resize(framesInFlight);
+    for (int i = 0; i < framesInFlight; i++) {
         if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-            vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create synchronization objects for a frame!");
+        }
+    }
+
+    // 时间线信号量：每次提交递增一个值，槽位记下自己的值，复用前等到该值即可（一个对象代替每槽位一个 fence）
+    if (timelineSemaphores) {
+        frameTimeline = createTimelineSemaphore(device);
+        frameCounter = 0;
+        slotTimelineValues.assign(framesInFlight, 0);
+        return;
+    }
+
+    inFlightFences.resize(framesInFlight);
+    for (int i = 0; i < framesInFlight; i++) {
+        if (vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create synchronization objects for a frame!");
         }
     }
 }
 
+void VkDisplay::waitForSlot(uint32_t slot) {
+    if (timelineSemaphores) {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &frameTimeline;
+        waitInfo.pValues = &slotTimelineValues[slot];
+        waitSemaphoresFn(device, &waitInfo, UINT64_MAX);
+    } else {
+        vkWaitForFences(device, 1, &inFlightFences[slot], VK_TRUE, UINT64_MAX);
+    }
+    // 上一次使用该槽位的拷贝已完成，归还其解码目标中的帧
+    inFlightOwners[slot].clear();
+}
+
 void VkDisplay::createCommandBuffers() {
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    commandBuffers.resize(framesInFlight);
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1255,99 +2550,424 @@ void VkDisplay::createCommandBuffers() {
     }
 }
 
-void VkDisplay::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-    // 1. 开始录制
+void VkDisplay::createTransferResources() {
+    // 计算着色器展开只能在图形队列上执行；没有时间线信号量时两个队列之间无法按帧序号等待。
+    // 暂存缓冲区和解码目标在此模式下只被传输队列读取，只有纹理需要在两个队列族之间转移所有权
+    textureReadValues.assign(streamTextures.size(), 0);
+    transferUploads = transferQueue != VK_NULL_HANDLE && timelineSemaphores && !gpuColorExpansion && !linearTextures;
+    if (!transferUploads) {
+        std::cout << "Texture uploads: graphics queue" << std::endl;
+        return;
+    }
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = transferFamilyIndex;
+
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create transfer command pool!");
+    }
+
+    // 每个槽位每路流一个命令缓冲区：各路流独立提交，槽位复用时其上一次拷贝必然已完成
+    transferCommandBuffers.resize(framesInFlight * streamCount);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = transferCommandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(transferCommandBuffers.size());
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, transferCommandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate transfer command buffers!");
+    }
+
+    uploadTimeline = createTimelineSemaphore(device);
+    uploadCounter = 0;
+    std::cout << "Texture uploads: dedicated transfer queue (family " << transferFamilyIndex << ")" << std::endl;
+}
+
+void VkDisplay::submitTransferUpload(int stream) {
+    VkCommandBuffer commandBuffer = transferCommandBuffers[currentFrame * streamCount + stream];
+    vkResetCommandBuffer(commandBuffer, 0);
+
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to begin recording command buffer!");
+        throw std::runtime_error("Failed to begin recording transfer command buffer!");
     }
+    recordUploadCopy(commandBuffer, stream);
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record transfer command buffer!");
+    }
+
+    // 这张纹理可能仍被之前提交的帧采样（其他槽位的帧绘制该路流的最新图像），等那次提交完成后再覆盖；
+    // 拷贝完成时 uploadTimeline 推进到本次上传的序号，图形队列提交时等待该值
+    uint64_t waitValue = textureReadValues[currentFrame * streamCount + stream];
+    uint64_t signalValue = uploadCounter + 1;
 
-    // 2. 直接在当前 CommandBuffer 中录制 Barrier 和 Copy
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &frameTimeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &uploadTimeline;
+
+    if (vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit transfer command buffer!");
+    }
+    uploadCounter = signalValue;
+    streamUploads[stream].transferValue = signalValue;
+}
+
+void VkDisplay::BarrierBatch::transition(VkImage image, ImageState& state, VkImageLayout layout,
+                                         VkAccessFlags access, VkPipelineStageFlags stage,
+                                         uint32_t srcFamily, uint32_t dstFamily) {
+    const VkAccessFlags writeAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+                                      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT;
+
+    // 布局不变、前后都只是读取（读后读没有冲突）：不需要屏障，只合并读取的阶段
+    if (state.layout == layout && srcFamily == dstFamily &&
+        !(state.access & writeAccess) && !(access & writeAccess)) {
+        state.access |= access;
+        state.stage |= stage;
+        return;
+    }
 
-    // 设置通用的 barrier 参数
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.oldLayout = state.layout;
+    barrier.newLayout = layout;
+    barrier.srcAccessMask = state.access & writeAccess;  // 只有写入需要使其可见，读后写只需执行依赖
+    barrier.dstAccessMask = access;
+    barrier.srcQueueFamilyIndex = srcFamily;
+    barrier.dstQueueFamilyIndex = dstFamily;
+    barrier.image = image;
     barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel = 0;
     barrier.subresourceRange.levelCount = 1;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = 1;
+    barriers.push_back(barrier);
 
-    // --- 左眼: Undefined -> Transfer Dst ---
-    barrier.image = leftTextureImage;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-    vkCmdPipelineBarrier(commandBuffer,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    // --- 左眼: Copy ---
-    VkBufferImageCopy leftRegion{};
-    leftRegion.bufferOffset = 0;  // 左眼从缓冲区开始处
-    leftRegion.bufferRowLength = 0;
-    leftRegion.bufferImageHeight = 0;
-    leftRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    leftRegion.imageSubresource.mipLevel = 0;
-    leftRegion.imageSubresource.baseArrayLayer = 0;
-    leftRegion.imageSubresource.layerCount = 1;
-    leftRegion.imageOffset = {0, 0, 0};
-    leftRegion.imageExtent = {1920, 1080, 1};
-
-    vkCmdCopyBufferToImage(commandBuffer, stagingBuffers[currentFrame], leftTextureImage,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &leftRegion);
-
-    // --- 左眼: Transfer Dst -> Shader Read ---
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    vkCmdPipelineBarrier(commandBuffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    // --- 右眼: Undefined -> Transfer Dst ---
-    barrier.image = rightTextureImage;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-    vkCmdPipelineBarrier(commandBuffer,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    // --- 右眼: Copy ---
-    VkBufferImageCopy rightRegion{};
-    rightRegion.bufferOffset = 1920 * 1080 * 4;  // 右眼偏移到缓冲区后半部分
-    rightRegion.bufferRowLength = 0;
-    rightRegion.bufferImageHeight = 0;
-    rightRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    rightRegion.imageSubresource.mipLevel = 0;
-    rightRegion.imageSubresource.baseArrayLayer = 0;
-    rightRegion.imageSubresource.layerCount = 1;
-    rightRegion.imageOffset = {0, 0, 0};
-    rightRegion.imageExtent = {1920, 1080, 1};
-
-    vkCmdCopyBufferToImage(commandBuffer, stagingBuffers[currentFrame], rightTextureImage,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &rightRegion);
-
-    // --- 右眼: Transfer Dst -> Shader Read ---
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    vkCmdPipelineBarrier(commandBuffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        0, 0, nullptr, 0, nullptr, 1, &barrier);
+    srcStages |= state.stage;
+    dstStages |= stage;
+    state.layout = layout;
+    state.access = access;
+    state.stage = stage;
+}
+
+void VkDisplay::BarrierBatch::record(VkCommandBuffer commandBuffer) {
+    if (barriers.empty()) {
+        return;
+    }
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+    barriers.clear();
+    srcStages = 0;
+    dstStages = 0;
+}
+
+uint32_t VkDisplay::texturePlanes(StreamTexture& texture, VkImage images[3], ImageState* states[3]) {
+    // RGBA 纹理为 1 个平面，平面 YUV 为 Y/Cb/Cr 3 个平面
+    images[0] = texture.image;
+    states[0] = &texture.state;
+    if (!planarYuv) {
+        return 1;
+    }
+    for (uint32_t p = 1; p < 3; p++) {
+        images[p] = texture.chroma[p - 1].image;
+        states[p] = &texture.chroma[p - 1].state;
+    }
+    return 3;
+}
+
+uint32_t VkDisplay::uploadPlanes(int stream, VkBufferImageCopy regions[3]) {
+    // 拷贝的目标：RGBA 纹理，或平面 YUV 的 Y/Cb/Cr 三个平面（在缓冲区中依次排列）
+    const StreamUpload& upload = streamUploads[stream];
+    uint32_t planeCount = planarYuv ? 3 : 1;
+    for (uint32_t p = 0; p < planeCount; p++) {
+        VkBufferImageCopy& region = regions[p];
+        region = VkBufferImageCopy{};
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+    }
+
+    regions[0].bufferOffset = upload.offset;
+    regions[0].bufferRowLength = upload.pitch / 4;
+    regions[0].imageExtent = {upload.extent.width, upload.extent.height, 1};
+    if (planarYuv) {
+        regions[0].bufferRowLength = upload.pitch;
+        for (uint32_t p = 1; p < 3; p++) {
+            regions[p].bufferOffset = upload.offset + planeOffset(upload.pitch, upload.extent.height, p);
+            regions[p].bufferRowLength = upload.pitch / 2;
+            regions[p].imageExtent = {(upload.extent.width + 1) / 2, upload.extent.height, 1};
+        }
+    }
+    return planeCount;
+}
+
+void VkDisplay::recordUploadCopy(VkCommandBuffer commandBuffer, int stream) {
+    // 传输队列上录制：纹理属于图形队列族，不取回所有权，直接从 Undefined 开始（旧内容丢弃）；
+    // 读后写已由提交时等待 frameTimeline 保证，源阶段取传输阶段与该等待衔接
+    VkImage images[3]{};
+    ImageState* states[3]{};
+    VkBufferImageCopy regions[3]{};
+    uint32_t planeCount = texturePlanes(streamTexture(currentFrame, stream), images, states);
+    uploadPlanes(stream, regions);
+
+    ImageState transferStates[3]{};
+    BarrierBatch batch;
+    for (uint32_t p = 0; p < planeCount; p++) {
+        transferStates[p].stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        batch.transition(images[p], transferStates[p], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    }
+    batch.record(commandBuffer);
+
+    for (uint32_t p = 0; p < planeCount; p++) {
+        vkCmdCopyBufferToImage(commandBuffer, streamUploads[stream].buffer, images[p],
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &regions[p]);
+    }
+
+    // 释放所有权给图形队列族（布局转换在释放和获取时各写一次，必须一致）
+    for (uint32_t p = 0; p < planeCount; p++) {
+        batch.transition(images[p], transferStates[p], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         0, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, transferFamilyIndex, graphicsFamilyIndex);
+    }
+    batch.record(commandBuffer);
+}
+
+bool VkDisplay::recordUploads(VkCommandBuffer commandBuffer) {
+    // 1. 开始录制
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+
+    // 2. 按纹理的跟踪状态录制：所有写入前的转换合并为一次屏障，拷贝/展开后再一次屏障转为 Shader Read。
+    //    本帧没有新数据、且最新图像已在本槽位的流不生成任何屏障，继续显示纹理中的上一帧
+    enum class Action { None, Clear, Copy, Expand, Acquire, Host };
+    std::vector<Action> actions(streamCount, Action::None);
+    BarrierBatch batch;
+
+    for (int i = 0; i < streamCount; i++) {
+        const StreamUpload& upload = streamUploads[i];
+        VkImage images[3]{};
+        ImageState* states[3]{};
+        uint32_t planeCount = texturePlanes(streamTexture(currentFrame, i), images, states);
+
+        if (upload.hostWritten) {
+            // 线性纹理已由 CPU 写入（提交本身使主机写入对设备可见）：第一次使用时从 Preinitialized
+            // 转为 General，之后一直在 General 布局下采样，不生成屏障
+            for (uint32_t p = 0; p < planeCount; p++) {
+                batch.transition(images[p], *states[p], VK_IMAGE_LAYOUT_GENERAL,
+                                 VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+            }
+            actions[i] = Action::Host;
+        } else if (upload.buffer == VK_NULL_HANDLE) {
+            // 最新图像在其他槽位时由绘制命令直接采样那个槽位的纹理（见 renderSources），不拷贝
+            if (latestSlot[i] >= 0) {
+                continue;
+            }
+            // 创建时已由 CPU 清为黑色的线性纹理：只需转为 General
+            if (states[0]->layout == VK_IMAGE_LAYOUT_PREINITIALIZED) {
+                for (uint32_t p = 0; p < planeCount; p++) {
+                    batch.transition(images[p], *states[p], VK_IMAGE_LAYOUT_GENERAL,
+                                     VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+                }
+                actions[i] = Action::Host;
+                continue;
+            }
+            // 还没有写入过的纹理（init 或该路流 setFrameSize 之后）：清为黑色后才能被预录制的绘制命令采样
+            if (states[0]->layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                continue;
+            }
+            for (uint32_t p = 0; p < planeCount; p++) {
+                batch.transition(images[p], *states[p], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            }
+            actions[i] = Action::Clear;
+        } else if (upload.transferValue != 0) {
+            // 已在传输队列上拷贝并释放所有权：获取时的布局转换与释放时一致，提交时等待 uploadTimeline
+            // （片段着色器阶段）之后执行
+            for (uint32_t p = 0; p < planeCount; p++) {
+                states[p]->layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                states[p]->access = 0;
+                states[p]->stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+                batch.transition(images[p], *states[p], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                 VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                                 transferFamilyIndex, graphicsFamilyIndex);
+            }
+            actions[i] = Action::Acquire;
+        } else if (upload.expandSet != VK_NULL_HANDLE) {
+            batch.transition(images[0], *states[0], VK_IMAGE_LAYOUT_GENERAL,
+                             VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            actions[i] = Action::Expand;
+        } else {
+            for (uint32_t p = 0; p < planeCount; p++) {
+                batch.transition(images[p], *states[p], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            }
+            actions[i] = Action::Copy;
+        }
+    }
+    // 线性纹理只有第一次使用时有屏障，之后 CPU 写入的帧没有任何命令，不必提交上传命令缓冲区
+    bool recorded = !batch.barriers.empty();
+    batch.record(commandBuffer);
+
+    // 3. 拷贝和计算展开
+    for (int i = 0; i < streamCount; i++) {
+        const StreamUpload& upload = streamUploads[i];
+        VkImage images[3]{};
+        ImageState* states[3]{};
+        uint32_t planeCount = texturePlanes(streamTexture(currentFrame, i), images, states);
+
+        if (actions[i] == Action::None) {
+            continue;
+        }
+        if (actions[i] == Action::Host) {
+            if (upload.hostWritten) {
+                latestSlot[i] = static_cast<int>(currentFrame);
+            }
+            continue;
+        }
+        recorded = true;
+
+        if (actions[i] == Action::Clear) {
+            // 还没有收到图像的流显示为黑色（与清屏颜色相同）；平面 YUV 的 Cb/Cr 取 128 对应无色度
+            VkClearColorValue black = {{0.0f, 0.0f, 0.0f, 1.0f}};
+            VkClearColorValue neutralChroma = {{128.0f / 255.0f, 0.0f, 0.0f, 1.0f}};
+            VkImageSubresourceRange range{};
+            range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            range.levelCount = 1;
+            range.layerCount = 1;
+            for (uint32_t p = 0; p < planeCount; p++) {
+                vkCmdClearColorImage(commandBuffer, images[p], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     p == 0 ? &black : &neutralChroma, 1, &range);
+            }
+        } else if (actions[i] == Action::Expand) {
+            // 打包 RGB 展开为 RGBA
+            ExpandParams params{};
+            params.offset = static_cast<uint32_t>(upload.offset);
+            params.pitch = upload.pitch;
+            params.width = upload.extent.width;
+            params.height = upload.extent.height;
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, expandPipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, expandPipelineLayout,
+                                   0, 1, &upload.expandSet, 0, nullptr);
+            vkCmdPushConstants(commandBuffer, expandPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+                               0, sizeof(params), &params);
+            vkCmdDispatch(commandBuffer,
+                          (upload.extent.width + EXPAND_GROUP_SIZE - 1) / EXPAND_GROUP_SIZE,
+                          (upload.extent.height + EXPAND_GROUP_SIZE - 1) / EXPAND_GROUP_SIZE, 1);
+        } else if (actions[i] == Action::Copy) {
+            // 从暂存缓冲区中该路流的区域，或解码器直接写入的解码目标
+            VkBufferImageCopy regions[3]{};
+            uploadPlanes(i, regions);
+            for (uint32_t p = 0; p < planeCount; p++) {
+                vkCmdCopyBufferToImage(commandBuffer, upload.buffer, images[p],
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &regions[p]);
+            }
+        }
+
+        // 写入的纹理转为 Shader Read（所有权获取已在上一次屏障中完成，这里不再生成屏障）
+        for (uint32_t p = 0; p < planeCount; p++) {
+            batch.transition(images[p], *states[p], sampledLayout(),
+                             VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        }
+        if (actions[i] != Action::Clear) {
+            latestSlot[i] = static_cast<int>(currentFrame);
+        }
+    }
+    batch.record(commandBuffer);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record command buffer!");
+    }
+    return recorded;
+}
+
+void VkDisplay::createRenderCommandBuffers() {
+    // 绘制命令只依赖交换链图像、帧槽位和各路流采样的纹理槽位，录制一次后每帧直接提交。
+    // 每个（交换链图像，帧槽位）先录制各路流都采样本槽位的那一个，其余组合按需录制
+    for (uint32_t image = 0; image < swapChainImages.size(); image++) {
+        for (int slot = 0; slot < framesInFlight; slot++) {
+            uint32_t sources = 0;
+            for (int i = streamCount - 1; i >= 0; i--) {
+                sources = sources * framesInFlight + slot;
+            }
+            renderCommandBuffer(image, slot, sources);
+        }
+    }
+}
+
+uint32_t VkDisplay::renderSources(int slot) const {
+    // 每路流采样最新图像所在槽位的纹理；还没有收到图像的流采样本槽位（上传命令把它清为黑色）
+    uint32_t sources = 0;
+    for (int i = streamCount - 1; i >= 0; i--) {
+        sources = sources * framesInFlight + (latestSlot[i] >= 0 ? latestSlot[i] : slot);
+    }
+    return sources;
+}
+
+uint64_t VkDisplay::renderCommandKey(uint32_t imageIndex, int slot, uint32_t sources) const {
+    return (static_cast<uint64_t>(imageIndex * framesInFlight + slot) << 32) | sources;
+}
+
+VkCommandBuffer VkDisplay::renderCommandBuffer(uint32_t imageIndex, int slot, uint32_t sources) {
+    RenderCommands& commands = renderCommandBuffers[renderCommandKey(imageIndex, slot, sources)];
+
+    // 这个组合第一次出现（某路流的最新图像在其他槽位），或纹理重新分配后第一次使用：
+    // 命令缓冲区只在本槽位提交，上一次的提交已执行完，可以（重新）录制
+    if (commands.commandBuffer == VK_NULL_HANDLE) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commands.commandBuffer) != VK_SUCCESS) {
+            renderCommandBuffers.erase(renderCommandKey(imageIndex, slot, sources));
+            throw std::runtime_error("Failed to allocate render command buffers!");
+        }
+        recordCommandBuffer(commands.commandBuffer, imageIndex, slot, sources);
+    } else if (commands.dirty) {
+        recordCommandBuffer(commands.commandBuffer, imageIndex, slot, sources);
+    }
+    commands.dirty = false;
+    return commands.commandBuffer;
+}
+
+void VkDisplay::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, int slot,
+                                    uint32_t sources) {
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
 
     // 开始渲染通道
     VkRenderPassBeginInfo renderPassInfo{};
@@ -1366,32 +2986,58 @@ void VkDisplay::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imag
     // 绑定图形管线
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 
-    // 设置动态视口
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swapChainExtent.width;
-    viewport.height = (float)swapChainExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-    // 设置动态裁剪矩形
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swapChainExtent;
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-    // 绑定描述符集
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-                           0, 1, &descriptorSet, 0, nullptr);
-
-    // 绘制命令（6个顶点组成的全屏四边形）
-    vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+    // 逐路绘制：视口和裁剪矩形限定在该路流的格子内，绑定 sources 中该路流所在槽位的描述符集
+    // （即提交时该路流最新图像所在的纹理；还没有收到过图像的流采样本槽位，在首次使用前清为黑色）
+    for (int i = 0; i < streamCount; i++, sources /= framesInFlight) {
+        const int source = static_cast<int>(sources % framesInFlight);
+        StreamCell cell = streamCell(i, streamCount,
+                                     static_cast<int>(swapChainExtent.width),
+                                     static_cast<int>(swapChainExtent.height));
+
+        // 设置动态视口
+        VkViewport viewport{};
+        viewport.x = static_cast<float>(cell.x);
+        viewport.y = static_cast<float>(cell.y);
+        viewport.width = static_cast<float>(cell.width);
+        viewport.height = static_cast<float>(cell.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        // 设置动态裁剪矩形
+        VkRect2D scissor{};
+        scissor.offset = {cell.x, cell.y};
+        scissor.extent = {static_cast<uint32_t>(cell.width), static_cast<uint32_t>(cell.height)};
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        // 绑定描述符集
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+                               0, 1, &streamTexture(source, i).descriptorSet, 0, nullptr);
+
+        // 绘制命令（6个顶点组成的全屏四边形，由视口缩放到格子内）
+        vkCmdDraw(commandBuffer, 6, 1, 0, 0);
+    }
 
     // 结束渲染通道
     vkCmdEndRenderPass(commandBuffer);
 
+    // 离屏回读：图像已转为 Transfer Src（渲染通道的外部依赖保证绘制结果可见），拷贝到该槽位的回读缓冲区
+    if (headlessReadback) {
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {swapChainExtent.width, swapChainExtent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               readbackBuffers[slot], 1, &region);
+
+        VkMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             1, &hostBarrier, 0, nullptr, 0, nullptr);
+    }
+
     // 结束命令缓冲区记录
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         throw std::runtime_error("Failed to record command buffer!");
@@ -1407,8 +3053,13 @@ void VkDisplay::recreateSwapChain() {
     }
 
     vkDeviceWaitIdle(device);
+    stopPresentWait();
 
-    // 销毁旧的交换链相关资源
+    // 销毁旧的交换链相关资源（预录制的绘制命令引用了帧缓冲，一起释放）
+    for (auto& entry : renderCommandBuffers) {
+        vkFreeCommandBuffers(device, commandPool, 1, &entry.second.commandBuffer);
+    }
+    renderCommandBuffers.clear();
     for (auto framebuffer : swapChainFramebuffers) {
         vkDestroyFramebuffer(device, framebuffer, nullptr);
     }
@@ -1423,6 +3074,89 @@ void VkDisplay::recreateSwapChain() {
     createSwapChain();
     createImageViews();
     createFramebuffers();
+    createRenderCommandBuffers();
+
+    // 窗口可能移到了另一台显示器上：重新取标称刷新率，重新测量
+    scheduler.reset();
+    updateNominalRefresh();
+    startPresentWait();
+}
+
+void VkDisplay::updateNominalRefresh() {
+    // 全屏时取窗口所在显示器，窗口模式取主显示器
+    GLFWmonitor* monitor = glfwGetWindowMonitor(window);
+    if (monitor == nullptr) {
+        monitor = glfwGetPrimaryMonitor();
+    }
+    const GLFWvidmode* mode = monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
+    if (mode != nullptr && mode->refreshRate > 0) {
+        scheduler.setNominalPeriod(1e6 / mode->refreshRate);
+        std::cout << "Display refresh rate: " << mode->refreshRate << " Hz (monitor mode)" << std::endl;
+    }
+}
+
+void VkDisplay::startPresentWait() {
+    if (!presentWait || swapChain == VK_NULL_HANDLE) {
+        return;
+    }
+    // 呈现 ID 在交换链之间继续递增，新线程只等待此后的呈现
+    {
+        std::lock_guard<std::mutex> lck(presentWaitMutex);
+        presentWaitStop = false;
+        presentWaitTarget = presentId;
+        presentCompletions.clear();
+    }
+    presentWaitThread = std::thread(&VkDisplay::presentWaitLoop, this, swapChain, presentId);
+}
+
+void VkDisplay::stopPresentWait() {
+    if (!presentWaitThread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lck(presentWaitMutex);
+        presentWaitStop = true;
+    }
+    presentWaitCv.notify_all();
+    presentWaitThread.join();  // 正在进行的等待最多 100ms 后返回
+}
+
+void VkDisplay::presentWaitLoop(VkSwapchainKHR swapchain, uint64_t waited) {
+    constexpr uint64_t WAIT_TIMEOUT_NS = 100000000;
+    std::unique_lock<std::mutex> lck(presentWaitMutex);
+    while (true) {
+        presentWaitCv.wait(lck, [&]() { return presentWaitStop || presentWaitTarget > waited; });
+        if (presentWaitStop) {
+            return;
+        }
+        // 只等待最新一次呈现：积压的较早呈现已经完成，它们的完成时间测不到了
+        uint64_t id = presentWaitTarget;
+        lck.unlock();
+        VkResult result = waitForPresentFn(device, swapchain, id, WAIT_TIMEOUT_NS);
+        uint64_t completeUs = monotonicNowUs();
+        lck.lock();
+        if (result == VK_TIMEOUT) {
+            continue;  // 窗口最小化等情况下呈现迟迟不完成，重新检查退出标志
+        }
+        waited = id;
+        if (result == VK_SUCCESS && presentCompletions.size() < 64) {
+            presentCompletions.push_back(completeUs);
+        }
+    }
+}
+
+PresentScheduler& VkDisplay::presentScheduler() {
+    if (presentWait) {
+        std::vector<uint64_t> completions;
+        {
+            std::lock_guard<std::mutex> lck(presentWaitMutex);
+            completions.swap(presentCompletions);
+        }
+        for (uint64_t completeUs : completions) {
+            scheduler.onPresentComplete(completeUs);
+        }
+    }
+    return scheduler;
 }
 
 void VkDisplay::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
@@ -1515,103 +3249,168 @@ void VkDisplay::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
     vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
 
-void VkDisplay::draw() {
-    // 等待当前槽位的上一次使用完成
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-
-    // 获取下一个可用的交换链图像
-    uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(
-        device,
-        swapChain,
-        UINT64_MAX,
-        imageAvailableSemaphores[currentFrame],
-        VK_NULL_HANDLE,
-        &imageIndex
-    );
+bool VkDisplay::draw() {
+    // 等待当前槽位的上一次使用完成（updateVideo 已等待过时立即返回）
+    waitForSlot(currentFrame);
+    destroyRetiredResources(false);
+
+    // 获取下一个可用的交换链图像（离屏模式直接使用本槽位的离屏图像）
+    uint32_t imageIndex = currentFrame;
+    VkResult result = VK_SUCCESS;
+    if (!headless) {
+        result = vkAcquireNextImageKHR(
+            device,
+            swapChain,
+            UINT64_MAX,
+            imageAvailableSemaphores[currentFrame],
+            VK_NULL_HANDLE,
+            &imageIndex
+        );
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         recreateSwapChain();
-        return;
+        return false;
     } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("Failed to acquire swap chain image!");
     }
 
     // 重置栅栏，为本帧提交做准备
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
+    if (!timelineSemaphores) {
+        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+    }
 
-    // 重置并记录本帧命令缓冲区
+    // 只录制本帧的上传命令（屏障和拷贝），绘制命令已按交换链图像和槽位预先录制
     vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-    recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    bool hasUploads = recordUploads(commandBuffers[currentFrame]);
+    // 绘制命令按各路流最新图像所在的槽位选取（recordUploads 已更新 latestSlot）
+    const int slot = static_cast<int>(currentFrame);
+    VkCommandBuffer submitBuffers[] = { commandBuffers[currentFrame],
+                                        renderCommandBuffer(imageIndex, slot, renderSources(slot)) };
 
     // 提交命令缓冲区
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-
+    // 传输队列模式：还要等待本帧各路流的拷贝完成（在片段着色器采样之前）
+    uint64_t uploadWaitValue = 0;
+    for (int i = 0; i < streamCount; i++) {
+        uploadWaitValue = std::max(uploadWaitValue, streamUploads[i].transferValue);
+    }
+    VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame], uploadTimeline };
+    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
+    uint64_t waitValues[] = { 0, uploadWaitValue };
+    // 离屏模式没有获取交换链图像，不等待 imageAvailable
+    uint32_t firstWait = headless ? 1 : 0;
+    submitInfo.waitSemaphoreCount = (uploadWaitValue != 0 ? 2 : 1) - firstWait;
+    submitInfo.pWaitSemaphores = &waitSemaphores[firstWait];
+    submitInfo.pWaitDstStageMask = &waitStages[firstWait];
+    submitInfo.commandBufferCount = hasUploads ? 2 : 1;
+    submitInfo.pCommandBuffers = hasUploads ? submitBuffers : &submitBuffers[1];
+
+    // 离屏模式不呈现，不发出 renderFinished
     VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = headless ? 0 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+    // 时间线模式：同时向 frameTimeline 发出本次提交的序号（二值信号量的值被忽略）
+    VkFence submitFence = timelineSemaphores ? VK_NULL_HANDLE : inFlightFences[currentFrame];
+    VkSemaphore timelineSignals[] = { renderFinishedSemaphores[currentFrame], frameTimeline };
+    uint64_t timelineValues[] = { 0, frameCounter + 1 };
+    uint32_t firstSignal = headless ? 1 : 0;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    if (timelineSemaphores) {
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+        timelineInfo.pWaitSemaphoreValues = &waitValues[firstWait];
+        timelineInfo.signalSemaphoreValueCount = 2 - firstSignal;
+        timelineInfo.pSignalSemaphoreValues = &timelineValues[firstSignal];
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 2 - firstSignal;
+        submitInfo.pSignalSemaphores = &timelineSignals[firstSignal];
+    }
+
+    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, submitFence) != VK_SUCCESS) {
         throw std::runtime_error("Failed to submit draw command buffer!");
     }
+    submitCount++;
+    if (timelineSemaphores) {
+        slotTimelineValues[currentFrame] = ++frameCounter;
+        // 本次提交采样了各路流最新图像所在的纹理（可能在其他槽位）：传输队列和 CPU 覆盖它们之前须等到该值
+        for (int i = 0; i < streamCount; i++) {
+            const int source = latestSlot[i] >= 0 ? latestSlot[i] : static_cast<int>(currentFrame);
+            textureReadValues[source * streamCount + i] = frameCounter;
+        }
+    }
+    lastSubmitTime = std::chrono::steady_clock::now();
+    scheduler.onSubmit(monotonicUs(lastSubmitTime));
 
-    // 呈现图像：等待渲染完成信号量，保持无撕裂 VSync（FIFO / MAILBOX）
-    VkPresentInfoKHR presentInfo{};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    // 本帧的上传已录制：解码目标中的帧挂到该槽位上，直到该槽位的提交完成
+    for (int i = 0; i < streamCount; i++) {
+        if (pendingOwners[i]) {
+            inFlightOwners[currentFrame].push_back(std::move(pendingOwners[i]));
+        }
+        pendingOwners[i] = nullptr;
+        streamUploads[i] = StreamUpload{};
+    }
+
+    // 离屏模式：图像留在本槽位的离屏图像中（开启回读时已拷贝到回读缓冲区），不呈现
+    lastDrawnSlot = static_cast<int>(currentFrame);
+    if (!headless) {
+        // 呈现图像：等待渲染完成信号量，保持无撕裂 VSync（FIFO / MAILBOX）
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = signalSemaphores;
+
+        VkSwapchainKHR swapChains[] = { swapChain };
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = swapChains;
+        presentInfo.pImageIndices = &imageIndex;
+
+        // 带上呈现 ID，等待线程据此测得这次呈现完成（上屏）的时间
+        uint64_t nextPresentId = presentId + 1;
+        VkPresentIdKHR presentIdInfo{};
+        if (presentWait) {
+            presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+            presentIdInfo.swapchainCount = 1;
+            presentIdInfo.pPresentIds = &nextPresentId;
+            presentInfo.pNext = &presentIdInfo;
+        }
 
-    VkSwapchainKHR swapChains[] = { swapChain };
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
+        result = vkQueuePresentKHR(presentQueue, &presentInfo);
 
-    result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        if (presentWait && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)) {
+            presentId = nextPresentId;
+            {
+                std::lock_guard<std::mutex> lck(presentWaitMutex);
+                presentWaitTarget = presentId;
+            }
+            presentWaitCv.notify_one();
+        }
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
-        framebufferResized = false;
-        recreateSwapChain();
-    } else if (result != VK_SUCCESS) {
-        throw std::runtime_error("Failed to present swap chain image!");
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
+            framebufferResized = false;
+            recreateSwapChain();
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to present swap chain image!");
+        }
     }
 
-    // ===== VSync 相位追踪 =====
-    // 记录最近一次 Present 的时间点，用于 Just-in-Time 提交优化
+    // 记录最近一次 Present 的时间点（逐帧延迟统计）；测不到呈现完成时间时以它为 VSync 网格的起点
     lastPresentTime = std::chrono::steady_clock::now();
+    if (!headless && !presentWait) {
+        scheduler.onPresentReturned(monotonicUs(lastPresentTime));
+    }
 
-    // ===== 60Hz FIFO 优化：移除 vkQueueWaitIdle，仅依赖 vkWaitForFences =====
-    // 原因：vkWaitForFences 在 draw() 开头已保证上一帧完成，额外的 vkQueueWaitIdle
+    // ===== 60Hz FIFO 优化：移除 vkQueueWaitIdle，仅依赖槽位等待 =====
+    // 原因：waitForSlot 在 draw() 开头已保证该槽位的上一次提交完成，额外的 vkQueueWaitIdle
     //      会导致等待时间不稳定（有时 0ms，有时 10+ms），增大方差。移除后依赖
     //      fence + semaphore 同步，相位关系更可预测。
     // 注意：如果测试发现均值显著增加（>5ms），可考虑恢复 vkDeviceWaitIdle 作为折中。
 
-    // 更新当前帧索引（单缓冲模式，currentFrame 始终为 0）
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-}
-
-double VkDisplay::getTimeToNextVSync() {
-    // 计算从最近一次 Present 到当前的时间差
-    auto now = std::chrono::steady_clock::now();
-    double elapsedMs = std::chrono::duration<double, std::milli>(now - lastPresentTime).count();
-
-    // 计算距离下一个 VSync 的剩余时间
-    double remaining = VSYNC_PERIOD_MS - elapsedMs;
-
-#if DO_EFFECIENCY_TEST
-    // 首次调用时（elapsedMs 可能很大），返回合理的正值
-    if (elapsedMs > VSYNC_PERIOD_MS * 2) {
-        remaining = VSYNC_PERIOD_MS;
-    }
-#endif
-
-    return remaining;
+    // 更新当前帧索引（深度为 1 的低延迟模式下 currentFrame 始终为 0）
+    currentFrame = (currentFrame + 1) % framesInFlight;
+    return true;
 }
@@ -1,14 +1,35 @@
 #include "endo_viewer.h"
 #include <ctime>
 #include "./inc/v4l2_capture.h"
+#include "./inc/decode_pool.h"
+#include "./inc/capture_reactor.h"
+#include "./inc/stream_layout.h"
 #include "./inc/GLDisplay.h"
 #include "./inc/VkDisplay.h"
+#include "./inc/present_scheduler.h"
 
 #include "efficiency_test.h"
 
 // 渲染模式切换：0 = 串行渲染（单线程），1 = 并行渲染（多线程）
 #define RENDER_MODE_PARALLEL 1
 
+// Vulkan 颜色扩展：0 = 解码器直接输出 RGBX, 1 = 上传打包的 RGB，由计算着色器扩展为 RGBA
+#define GPU_COLOR_EXPANSION 0
+
+// 平面 YUV：0 = 解码为 RGB, 1 = 解码为 YUV422P（跳过 CPU 颜色转换），两个后端都在片段着色器中转换
+#define PLANAR_YUV_DECODE 0
+
+// Vulkan 线性纹理：0 = 暂存缓冲区/解码目标经 GPU 拷贝上传, 1 = 统一内存设备上 CPU 直接写入主机可见的纹理
+#define LINEAR_TEXTURES 0
+
+// Vulkan 在途帧数：1 = 低延迟（手术模式，上传与显示不重叠），2~3 = 4K / 多路相机下以一帧延迟换吞吐
+#define FRAMES_IN_FLIGHT 1
+
+// 双目同步：0 = 左右眼各自发布最新帧, 1 = 按驱动时间戳配对左右眼帧，只成对发布（最多增加一帧延迟）
+#define STEREO_SYNC 0
+// 配对的左右眼帧采集时间之差的上限（微秒）
+#define STEREO_SYNC_WINDOW_US 2000
+
 // 后端选择：0 = OpenGL模式, 1 = Vulkan模式 (通过CMake定义)
 
 namespace {
@@ -42,139 +63,256 @@ namespace {
             std::chrono::microseconds>(end - start).count();
     }
 
-    const uint8_t TIME_INTTERVAL = 17;  // 17ms
+    // 每个相机的 V4L2 缓冲区数量：驱动队列 + 解码线程池（解码中/待解码各 1）
+    // + 渲染/录像信箱各自的最新帧与正在使用的帧 + 渲染器中 GPU 还在拷贝的帧
+    const uint8_t CAPTURE_BUFFER_COUNT = 8;
+
+    // 相机自己的解码缓冲区中的像素格式（渲染器未提供解码目标时使用）
+    const PixelFormat INTERNAL_DECODE_FORMAT = PLANAR_YUV_DECODE ? PixelFormat::YUV422P : PixelFormat::RGB;
+
+    StereoSync<FramePtr>::Config stereoSyncConfig() {
+        StereoSync<FramePtr>::Config config;
+        config.window_us = STEREO_SYNC_WINDOW_US;
+        return config;
+    }
 }
 
 
 EndoViewer::EndoViewer()
     : imwidth(1920), imheight(1080)
+    , _stereo_sync(stereoSyncConfig())
     , _is_write_to_video(false)
     , _keep_running(true)
 {
-    // 初始化双缓冲的所有 Mat
-    for (int i = 0; i < 2; i++) {
-        _image_l_buffers[i] = cv::Mat(imheight, imwidth, CV_8UC3);
-        _image_r_buffers[i] = cv::Mat(imheight, imwidth, CV_8UC3);
-    }
 }
 
 
 EndoViewer::~EndoViewer() {
-    delete _cap_l;
-    delete _cap_r;
+    stopPipeline();
+    for (auto& stream : _streams) {
+        delete stream->cap.exchange(nullptr);
+    }
     cv::destroyAllWindows();
 }
 
 
-void EndoViewer::startup(uint8_t left_cam_id, uint8_t right_cam_id, bool is_write_to_video) {
-    _is_write_to_video = is_write_to_video;
-    if(_is_write_to_video) {
-        _thread_writer = std::thread(&EndoViewer::writeVideo, this);
-        _thread_writer.detach();
+void EndoViewer::stopPipeline() {
+    // 录像线程先退出，它持有的帧可能指向渲染器的解码目标
+    _keep_running = false;
+    notifyNewFrame();
+    if (_thread_writer.joinable()) {
+        _thread_writer.join();
+    }
+    // 还在重试的相机随通知结束等待；连上设备的线程注册完再退出，reactor 停止后不会再有相机加入
+    for (auto& stream : _streams) {
+        if (stream->opener.joinable()) {
+            stream->opener.join();
+        }
+    }
+    // 再停掉采集线程，不再有新帧提交
+    if (_reactor) {
+        _reactor->stop();
     }
+    if (_thread_capture.joinable()) {
+        _thread_capture.join();
+    }
+    // 借出的帧必须在相机关闭前归还：先停掉解码线程池（丢弃待解码帧），再释放已发布的帧
+    if (_decode_pool) {
+        _decode_pool->stop();
+    }
+    {
+        std::lock_guard<std::mutex> lck(_stereo_mtx);
+        _stereo_sync.reset();
+    }
+    for (auto& stream : _streams) {
+        stream->render.clear();
+        stream->record.clear();
+    }
+}
 
-    _thread_read_l = std::thread(&EndoViewer::readLeftImage, this, left_cam_id);
-    _thread_read_l.detach();
-    _thread_read_r = std::thread(&EndoViewer::readRightImage, this, right_cam_id);
-    _thread_read_r.detach();
 
-    show();
-}
+void EndoViewer::startup(const std::vector<int>& cam_ids, bool is_write_to_video) {
+    _is_write_to_video = is_write_to_video;
+    if (cam_ids.empty()) {
+        printf("EndoViewer::startup: no camera is given.\n");
+        return;
+    }
 
+    // 解码线程池在采集线程启动前创建，所有相机共享；每路相机一条流水线
+    _decode_pool.reset(new DecodePool());
+    for (size_t i = 0; i < cam_ids.size(); i++) {
+        std::unique_ptr<CameraStream> stream(new CameraStream());
+        CameraStream* s = stream.get();
+        s->device = cam_ids[i];
+        s->name = i == 0 ? "L" : i == 1 ? "R" : "C" + std::to_string(i);
+        s->source = _decode_pool->addSource([this, s](FramePtr frame, bool success) {
+            publishFrame(s, std::move(frame), success);
+        });
+        _streams.push_back(std::move(stream));
+    }
+    printf("EndoViewer: %zu camera stream(s), %u decode worker(s) shared by all cameras.\n",
+           _streams.size(), _decode_pool->workerCount());
 
-void EndoViewer::readLeftImage(int index) {
-    _cap_l = new V4L2Capture(imwidth, imheight, 3);
-    while(!_cap_l->openDevice(index)) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        printf("Camera %d is retrying to connection!!!\n", index);
+    if(_is_write_to_video) {
+        _thread_writer = std::thread(&EndoViewer::writeVideo, this);
     }
 
-    bool flag = 0;
-    while(_keep_running) {
-        auto time_start = ::getCurrentTimePoint();
+    // 所有相机共用一个 epoll 采集线程；打开相机的线程连上设备、注册到 reactor 后即退出
+    _reactor.reset(new CaptureReactor());
+    _thread_capture = std::thread(&CaptureReactor::run, _reactor.get());
 
-        // 获取当前写入索引
-        int write_idx = _write_index_l.load(std::memory_order_relaxed);
+    for (auto& stream : _streams) {
+        stream->opener = std::thread(&EndoViewer::openCamera, this, stream.get());
+    }
 
-        // 写入当前缓冲区
-        flag = _cap_l->ioctlDequeueBuffers(_image_l_buffers[write_idx].data);
-        flag = flag && (!_image_l_buffers[write_idx].empty());
+    show();
+}
 
-        // // Debug: check data
-        // if(flag) {
-        //     unsigned char* ptr = _image_l_buffers[write_idx].data;
-        //     printf("Data Check Left: [0]=%02X [1]=%02X Size=%ld\n", ptr[0], ptr[1], _image_l_buffers[write_idx].total() * _image_l_buffers[write_idx].elemSize());
-        // }
 
-        if(!flag) {
-            printf("EndoViewer::readLeftImage: USB ID: %d, image empty: %d.\n",
-                    index, _image_l_buffers[write_idx].empty());
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            continue;
+void EndoViewer::openCamera(CameraStream* stream) {
+    V4L2Capture* cap = new V4L2Capture(imwidth, imheight, CAPTURE_BUFFER_COUNT);
+    while(!cap->openDevice(stream->device)) {
+        // 每秒重试一次；退出时 stopPipeline 通知 _frame_cv，不必等满 1 秒
+        {
+            std::unique_lock<std::mutex> lck(_frame_mtx);
+            _frame_cv.wait_for(lck, std::chrono::seconds(1), [this]() { return !_keep_running; });
         }
+        if(!_keep_running) {
+            delete cap;
+            return;
+        }
+        printf("Camera %d is retrying to connection!!!\n", stream->device);
+    }
+    // 只解码最新帧：驱动队列里积压的旧帧直接重新入队，不再解码和显示
+    cap->setDrainToNewest(true);
+    cap->setDecodeTargets({}, 0, INTERNAL_DECODE_FORMAT);
+    stream->cap = cap;
+
+    // 帧就绪时 reactor 线程出队（借用 V4L2 缓冲区），解码交给线程池
+    int id = _reactor->addCamera(cap, [this, stream](FramePtr frame, long dequeue_us) {
+        _decode_pool->submit(stream->source, std::move(frame), dequeue_us);
+    });
+    if(id < 0) {
+        printf("EndoViewer::openCamera: USB ID: %d, cannot register the camera.\n", stream->device);
+    }
+}
 
-        // 写入完成后，切换缓冲区索引（原子操作，确保渲染线程看到完整帧）
-        _write_index_l.store(1 - write_idx, std::memory_order_release);
-        _new_frame_l.store(true, std::memory_order_release);
 
-        // 更新帧 ID（用于最新帧策略追踪）
-        _frame_id_l.fetch_add(1, std::memory_order_release);
+void EndoViewer::publishFrame(CameraStream* stream, FramePtr frame, bool success) {
+    // 在解码线程中调用
+    if(!success) {
+        printf("EndoViewer::publishFrame: [%s] decode failed, frame dropped.\n", stream->name.c_str());
+        return;
+    }
 
-        auto ms = getDurationSince(time_start);
-#if DO_EFFECIENCY_TEST
-        printf("CAMERA_ACQUIRE: [%ld]ms\n", ms);
-#endif
-        if(ms < 17) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(TIME_INTTERVAL - ms));
+#if STEREO_SYNC
+    // 左右眼的帧先配对：等待另一眼采集时间相近的帧，配对成功后两帧一起发布；
+    // 另一眼丢失或长时间配不上时单独发布，不让画面冻结。
+    // 一眼的信箱可能由另一眼的解码线程发布，信箱只允许一个生产者，发布也在锁内进行
+    int eye = _streams.size() >= 2 ? (stream == _streams[0].get() ? 0 : stream == _streams[1].get() ? 1 : -1) : -1;
+    if (eye >= 0) {
+        uint64_t timestamp = frame->timestamp() != 0 ? frame->timestamp() : frame->timing().dequeue_us;
+        FramePtr out[2];
+        std::lock_guard<std::mutex> lck(_stereo_mtx);
+        if (_stereo_sync.push(eye, timestamp, std::move(frame), out) != StereoSync<FramePtr>::NONE) {
+            // 成对发布：先写入两眼的信箱，再更新两个帧 ID，只通知一次，
+            // 渲染线程不会在两眼之间醒来而配上新的左眼和旧的右眼
+            bool stored[2] = {false, false};
+            for (int i = 0; i < 2; i++) {
+                if (out[i]) {
+                    storeFrame(_streams[i].get(), std::move(out[i]));
+                    stored[i] = true;
+                }
+            }
+            for (int i = 0; i < 2; i++) {
+                if (stored[i]) {
+                    _streams[i]->frame_id.fetch_add(1, std::memory_order_release);
+                }
+            }
+            notifyNewFrame();
         }
-
+        return;
     }
+#endif
+    deliverFrame(stream, std::move(frame));
 }
 
 
-void EndoViewer::readRightImage(int index) {
-    _cap_r = new V4L2Capture(imwidth, imheight, 3);
-    while(!_cap_r->openDevice(index)) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-        printf("Camera %d is retrying to connection!!!\n", index);
+void EndoViewer::storeFrame(CameraStream* stream, FramePtr frame) {
+    // 写入各消费者信箱的后台槽位再交换（无锁，渲染线程看到的总是完整帧）
+    if (_is_write_to_video) {
+        stream->record.back() = frame;
+        stream->record.publish();
+        // 交换回来的是消费者跳过或已用完的旧帧，立即释放，让其 V4L2 缓冲区重新入队
+        stream->record.back().reset();
     }
+    stream->render.back() = std::move(frame);
+    stream->render.publish();
+    stream->render.back().reset();
+}
 
-    bool flag = 0;
-    while(_keep_running) {
-        auto time_start = ::getCurrentTimePoint();
-
-        int write_idx = _write_index_r.load(std::memory_order_relaxed);
 
-        flag = _cap_r->ioctlDequeueBuffers(_image_r_buffers[write_idx].data);
-        flag = flag && (!_image_r_buffers[write_idx].empty());
+void EndoViewer::deliverFrame(CameraStream* stream, FramePtr frame) {
+    // 发布新帧：写入信箱
+    storeFrame(stream, std::move(frame));
 
-        // // Debug: check data
-        // if(flag) {
-        //     unsigned char* ptr = _image_r_buffers[write_idx].data;
-        //     printf("Data Check Right: [0]=%02X [1]=%02X Size=%ld\n", ptr[0], ptr[1], _image_r_buffers[write_idx].total() * _image_r_buffers[write_idx].elemSize());
-        // }
+    // 更新帧 ID（用于最新帧策略追踪）
+    stream->frame_id.fetch_add(1, std::memory_order_release);
+    notifyNewFrame();
+}
 
-        if(!flag) {
-            printf("EndoViewer::readRightImage: USB ID: %d, image empty: %d.\n",
-                    index, _image_r_buffers[write_idx].empty());
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            continue;
-        }
 
-        _write_index_r.store(1 - write_idx, std::memory_order_release);
-        _new_frame_r.store(true, std::memory_order_release);
+void EndoViewer::notifyNewFrame() {
+    // 录像线程和渲染线程在条件变量上等待新帧
+    // 加锁后再通知，避免等待方在检查帧 ID 与进入等待之间错过通知
+    { std::lock_guard<std::mutex> lck(_frame_mtx); }
+    _frame_cv.notify_all();
+}
 
-        // 更新帧 ID（用于最新帧策略追踪）
-        _frame_id_r.fetch_add(1, std::memory_order_release);
 
-        auto ms = getDurationSince(time_start);
-// #if DO_EFFECIENCY_TEST
-//         printf("EndoViewer::readRightImage: [%ld]ms elapsed.\n", ms);
-// #endif
-        if(ms < 17) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(TIME_INTTERVAL - ms));
+bool EndoViewer::fetchFrames(FrameMailbox CameraStream::*mailbox, std::vector<bool>& fresh) {
+    // 从各路流的信箱取得最新帧，fresh 标出取到新帧的流。双目同步时左右眼在发布所用的锁内一起取走：
+    // 配对的两帧总是同时可见，不会取到新的左眼和上一对的右眼
+    bool anyFresh = false;
+    size_t first = 0;
+#if STEREO_SYNC
+    if (_streams.size() >= 2) {
+        std::lock_guard<std::mutex> lck(_stereo_mtx);
+        for (size_t i = 0; i < 2; i++) {
+            FrameMailbox& box = (*_streams[i]).*mailbox;
+            fresh[i] = box.fetch() && box.front();
+            anyFresh = anyFresh || fresh[i];
         }
+        first = 2;
+    }
+#endif
+    for (size_t i = first; i < _streams.size(); i++) {
+        FrameMailbox& box = (*_streams[i]).*mailbox;
+        fresh[i] = box.fetch() && box.front();
+        anyFresh = anyFresh || fresh[i];
     }
+    return anyFresh;
+}
+
+
+bool EndoViewer::waitNewFrame(const std::vector<uint64_t>& last_ids, uint64_t deadline_us) {
+    // 任意一路发布新帧时返回，不按固定时间休眠；默认超时仅用于检查退出标志
+    // 截止时间为 CLOCK_MONOTONIC 上的微秒（steady_clock 的时钟），条件变量按绝对时间等待
+    auto deadline = deadline_us != 0
+        ? std::chrono::steady_clock::time_point(std::chrono::microseconds(deadline_us))
+        : std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    std::unique_lock<std::mutex> lck(_frame_mtx);
+    return _frame_cv.wait_until(lck, deadline, [&]() {
+        if (!_keep_running) {
+            return true;
+        }
+        for (size_t i = 0; i < _streams.size(); i++) {
+            if (_streams[i]->frame_id.load(std::memory_order_acquire) != last_ids[i]) {
+                return true;
+            }
+        }
+        return false;
+    }) && _keep_running;
 }
 
 
@@ -187,14 +325,24 @@ void EndoViewer::show() {
 #endif
     printf("============================================================\n");
 
+    // 每路流在窗口中占一个 960x540 的格子，双目时左右并排
+    const size_t streamCount = _streams.size();
+    StreamGrid grid = streamGrid(static_cast<int>(streamCount));
+    const int windowWidth = 960 * grid.columns;
+    const int windowHeight = 540 * grid.rows;
+
 #if USE_VULKAN
     // ========== VULKAN BACKEND ==========
     // 1. 创建 Vulkan 显示实例
     VkDisplay* vkDisplay = new VkDisplay();
 
     // 2. 初始化 (注意：VkDisplay 内部已经封装了 GLFW 窗口创建)
-    // 参数 2 是 dummy，因为 Vulkan 实现里不依赖这个数量，但为了兼容接口保留
-    if (!vkDisplay->init(1920, 540, "Endoscope Viewer - Vulkan")) {
+    // 每路相机流对应一张流纹理
+    vkDisplay->setGpuColorExpansion(GPU_COLOR_EXPANSION != 0);
+    vkDisplay->setPlanarYuv(PLANAR_YUV_DECODE != 0);
+    vkDisplay->setLinearTextures(LINEAR_TEXTURES != 0);
+    vkDisplay->setFramesInFlight(FRAMES_IN_FLIGHT);
+    if (!vkDisplay->init(windowWidth, windowHeight, "Endoscope Viewer - Vulkan", static_cast<int>(streamCount))) {
         printf("❌ Failed to initialize VkDisplay. Falling back or exiting.\n");
         delete vkDisplay;
         return;
@@ -207,12 +355,14 @@ void EndoViewer::show() {
     // ========== OPENGL BACKEND ==========
     // Initialize OpenGL display with 1 window for single-window latency testing
     GLDisplay* glDisplay = new GLDisplay();
-    if (!glDisplay->init(1920, 540, "Endoscope Viewer - OpenGL Mode", 1)) {
+    if (!glDisplay->init(windowWidth, windowHeight, "Endoscope Viewer - OpenGL Mode", 1, static_cast<int>(streamCount))) {
         printf("Failed to initialize GLDisplay\n");
         delete glDisplay;
         return;
     }
 
+    glDisplay->setPlanarYuv(PLANAR_YUV_DECODE != 0);
+    // 相机此时可能尚未连上：纹理先按请求尺寸分配，第一帧上传时按协商的图像尺寸重新分配
     if (!glDisplay->setupTexture(imwidth, imheight)) {
         printf("Failed to setup GLDisplay texture\n");
         delete glDisplay;
@@ -232,90 +382,144 @@ void EndoViewer::show() {
     // ========== VULKAN MAIN LOOP - Just-in-Time 提交 + 最新帧策略 ==========
     printf("Starting Vulkan low-latency main loop with Just-in-Time submission...\n");
 
-    uint64_t lastFrameId_l = 0;  // 上次渲染的帧 ID
-    uint64_t lastFrameId_r = 0;
+    std::vector<uint64_t> lastFrameIds(streamCount, 0);     // 上次渲染的帧 ID
+    std::vector<uint64_t> currentFrameIds(streamCount, 0);
+    std::vector<FrameTiming> timings(streamCount);          // 纹理中当前图像的时间记录（没有新帧的流沿用）
+    std::vector<bool> fresh(streamCount, false);            // 本次绘制上传了新帧的流
+    std::vector<bool> decodeTargetsSet(streamCount, false);
     uint64_t droppedFrames = 0;  // 丢帧统计
     uint64_t totalFrames = 0;    // 总渲染帧数
+    constexpr uint64_t NO_FRAME_WAIT_US = 5000;   // 没有新帧时最长等待，之后处理窗口事件
+    constexpr uint64_t SUBMIT_SPIN_US = 200;      // 提交截止前自旋的时长，抵消定时器唤醒误差
 
     while (!vkDisplay->shouldClose()) {
         // 3.1 处理窗口事件 (必须在主线程调用)
         vkDisplay->pollEvents();
 
+        // 相机连上后让解码器直接写入渲染器的暂存内存（RGBX），上传时不再做颜色扩展和拷贝
+        for (size_t i = 0; i < streamCount; i++) {
+            V4L2Capture* cap = _streams[i]->cap.load();
+            if (decodeTargetsSet[i] || cap == nullptr) {
+                continue;
+            }
+            decodeTargetsSet[i] = true;
+            // 纹理和解码目标按该路相机协商的图像尺寸分配（驱动可能不支持请求的 imwidth x imheight，
+            // 各路相机也可以不同）；分配失败时只报告这一次，不创建尺寸不符的解码目标
+            if (!vkDisplay->setFrameSize(static_cast<int>(i), cap->width(), cap->height())) {
+                printf("EndoViewer: [%s] cannot display %ux%u frames, the stream stays black.\n",
+                       _streams[i]->name.c_str(), cap->width(), cap->height());
+                continue;
+            }
+            uint32_t pitch = 0;
+            PixelFormat format = PixelFormat::RGBX;
+            std::vector<unsigned char*> targets =
+                vkDisplay->createDecodeTargets(static_cast<int>(i), cap->bufferCount(), pitch, format);
+            if (targets.empty() || !cap->setDecodeTargets(targets, pitch, format)) {
+                printf("EndoViewer: [%s] decodes into its own buffers, frames are copied to the staging buffer.\n",
+                       _streams[i]->name.c_str());
+            }
+        }
+
         // 3.2 读取当前帧 ID（无锁读取，使用 relaxed 语义）
-        uint64_t currentFrameId_l = _frame_id_l.load(std::memory_order_relaxed);
-        uint64_t currentFrameId_r = _frame_id_r.load(std::memory_order_relaxed);
+        // 任一路流有新帧即更新并重绘，不等待另一路：迟到的相机不拖慢另一路，没有新帧的流沿用纹理中的图像
+        // 看到新帧的时间交给调度器，作为各路相机的帧时钟
+        PresentScheduler& scheduler = vkDisplay->presentScheduler();
+        uint64_t nowUs = monotonicNowUs();
+        bool anyNew = false;
+        for (size_t i = 0; i < streamCount; i++) {
+            uint64_t frameId = _streams[i]->frame_id.load(std::memory_order_relaxed);
+            if (frameId != currentFrameIds[i]) {
+                scheduler.onFrameReady(static_cast<int>(i), nowUs);
+            }
+            currentFrameIds[i] = frameId;
+            if (currentFrameIds[i] != lastFrameIds[i]) {
+                anyNew = true;
+            }
+        }
 
-        // 3.3 如果没有新帧，短暂休眠后继续检查
-        if (currentFrameId_l == lastFrameId_l || currentFrameId_r == lastFrameId_r) {
-            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        // 3.3 如果没有新帧，等待解码线程发布（超时只为按时处理窗口事件）
+        if (!anyNew) {
+            waitNewFrame(lastFrameIds, nowUs + NO_FRAME_WAIT_US);
             continue;
         }
 
-        // 3.4 Just-in-Time 等待：延迟到 VSync 前合适的时机才提交
-        // 目标：在 VSync 前 SUBMIT_AHEAD_MS 提交，给驱动留出缓冲时间
-        double timeToVsync = vkDisplay->getTimeToNextVSync();
-        constexpr double MIN_WAIT_MS = 2.0;  // 最小等待阈值
-
-        // 主动丢帧策略：如果离 VSync 还很远，持续检查新帧
-        while (timeToVsync > vkDisplay->SUBMIT_AHEAD_MS + MIN_WAIT_MS) {
-            // 休眠 1ms 后重新检查
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-
-            // 检查是否有更新的帧到达
-            uint64_t newFrameId_l = _frame_id_l.load(std::memory_order_relaxed);
-            uint64_t newFrameId_r = _frame_id_r.load(std::memory_order_relaxed);
-
-            if (newFrameId_l != currentFrameId_l || newFrameId_r != currentFrameId_r) {
-                // 发现新帧，更新当前帧 ID（丢旧帧）
-                if (newFrameId_l > currentFrameId_l) {
-                    droppedFrames += (newFrameId_l - currentFrameId_l);
-                    currentFrameId_l = newFrameId_l;
-                }
-                if (newFrameId_r > currentFrameId_r) {
-                    droppedFrames += (newFrameId_r - currentFrameId_r);
-                    currentFrameId_r = newFrameId_r;
+        // 3.4 Just-in-Time 等待：调度器按测得的刷新周期和 VSync 相位给出目标 VSync 前 SUBMIT_AHEAD_MS 的截止时间，
+        // 截止前预计还有更新的相机帧时才等待，否则立即提交
+        // 主动丢帧策略：等待期间有更新的帧到达则改用最新帧，并重新决定提交时间
+        uint64_t submitUs = scheduler.submitTimeUs(nowUs);
+        while (nowUs < submitUs && !vkDisplay->shouldClose()) {
+            // 条件变量等到截止前 SUBMIT_SPIN_US，最后一段自旋补齐（不按 1ms 步长轮询）
+            bool newer = submitUs > nowUs + SUBMIT_SPIN_US &&
+                         waitNewFrame(currentFrameIds, submitUs - SUBMIT_SPIN_US) && _keep_running;
+            if (!newer) {
+                sleepUntilUs(submitUs, SUBMIT_SPIN_US);
+                break;
+            }
+            nowUs = monotonicNowUs();
+            for (size_t i = 0; i < streamCount; i++) {
+                uint64_t newFrameId = _streams[i]->frame_id.load(std::memory_order_relaxed);
+                if (newFrameId > currentFrameIds[i]) {
+                    droppedFrames += (newFrameId - currentFrameIds[i]);
+                    currentFrameIds[i] = newFrameId;
+                    scheduler.onFrameReady(static_cast<int>(i), nowUs);
                 }
+            }
 #if DO_EFFECIENCY_TEST
-                printf("DROPPED_FRAMES: skipped %ld old frame(s), using newest\n", droppedFrames);
+            printf("DROPPED_FRAMES: skipped %ld old frame(s), using newest\n", droppedFrames);
 #endif
-            }
-
-            // 重新计算剩余时间
-            timeToVsync = vkDisplay->getTimeToNextVSync();
+            submitUs = scheduler.submitTimeUs(nowUs);
         }
 
-        // 3.5 读取最新缓冲区索引
-        // // 根据当前帧 ID 确定要读取的缓冲区
-        // int read_idx_l = (currentFrameId_l % 2);
-        // int read_idx_r = (currentFrameId_r % 2);
-        // 应该使用与采集线程一致的逻辑
-        int read_idx_l = 1 - _write_index_l.load(std::memory_order_acquire);
-        int read_idx_r = 1 - _write_index_r.load(std::memory_order_acquire);
-        // 检查缓冲区是否有效
-        if (_image_l_buffers[read_idx_l].empty() ||
-            _image_r_buffers[read_idx_r].empty()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        // 3.5 从信箱取得各路流的最新帧（持有期间对应的 V4L2 缓冲区不会被重新入队/覆盖）
+        // 帧 ID 已前进但信箱里没有新帧（帧 ID 先于信箱被读到，或上一轮已取走）：这些帧 ID 视为已处理，
+        // 阻塞到下一次发布，不按固定时间轮询
+        bool anyFresh = fetchFrames(&CameraStream::render, fresh);
+        if (!anyFresh) {
+            lastFrameIds = currentFrameIds;
+            waitNewFrame(lastFrameIds, monotonicNowUs() + NO_FRAME_WAIT_US);
             continue;
         }
 
-        // 3.6 数据上传 (CPU -> Staging Buffer)
-        // Vulkan 的 updateVideo 只是内存拷贝 (memcpy)，非常快
+        // 3.6 数据上传 (CPU -> Staging Buffer)，只上传有新帧的流
+        // 帧已解码在渲染器的解码目标中时只交接指针，渲染器持有该帧到 GPU 拷贝完成；
+        // 否则 updateStream 做一次颜色扩展写入暂存缓冲区
         auto frame_start = ::getCurrentTimePoint();
-        vkDisplay->updateVideo(
-            _image_l_buffers[read_idx_l].data,
-            _image_r_buffers[read_idx_r].data,
-            imwidth, imheight
-        );
+        for (size_t i = 0; i < streamCount; i++) {
+            if (!fresh[i]) {
+                continue;
+            }
+            FramePtr& frame = _streams[i]->render.front();
+            vkDisplay->updateStream(static_cast<int>(i), frame->data(), static_cast<int>(frame->width()),
+                                    static_cast<int>(frame->height()), frame);
+            // 帧的时间记录随帧一起传递，归还帧之前取出并补上暂存写入时间
+            timings[i] = frame->timing();
+            timings[i].staging_write_us = monotonicNowUs();
+            // 交接完成，尽早归还帧（仍在拷贝的帧由渲染器持有）
+            frame.reset();
+        }
 
         // 3.7 渲染提交 (Submit & Present)
         // 这一步是非阻塞的，除非 GPU 积压了超过 MAX_FRAMES_IN_FLIGHT 帧
-        vkDisplay->draw();
+        if (vkDisplay->draw()) {
+            // 逐帧记录采集到呈现的各阶段延迟；每路流显示的图像的新旧（重复显示的图像只计入显示时的图像年龄）
+            uint64_t submitUs = monotonicUs(vkDisplay->getLastSubmitTime());
+            uint64_t presentUs = monotonicUs(vkDisplay->getLastPresentTime());
+            for (size_t i = 0; i < streamCount; i++) {
+                if (fresh[i]) {
+                    timings[i].submit_us = submitUs;
+                    timings[i].present_us = presentUs;
+                    _streams[i]->latency.record(timings[i]);
+                }
+                if (timings[i].dequeue_us != 0) {  // 还没有收到过帧的流显示为黑色，不计
+                    _streams[i]->latency.recordShown(timings[i].capture_us, presentUs, fresh[i]);
+                }
+            }
+        }
 
         auto draw_end = ::getCurrentTimePoint();
 
         // 3.8 更新帧 ID 记录
-        lastFrameId_l = currentFrameId_l;
-        lastFrameId_r = currentFrameId_r;
+        lastFrameIds = currentFrameIds;
         totalFrames++;
 
 #if DO_EFFECIENCY_TEST
@@ -325,16 +529,34 @@ void EndoViewer::show() {
                    totalFrames, droppedFrames,
                    totalFrames > 0 ? (100.0 * droppedFrames / totalFrames) : 0.0,
                    getDurationBetween(frame_start, draw_end));
+            const PresentScheduler::Stats& ps = vkDisplay->presentScheduler().stats();
+            printf("PRESENT_SCHED: refresh=%.3f ms (%.2f Hz, %s) jitter=%.0f us samples=%lu rejected=%lu "
+                   "relocks=%lu repeated=%lu\n",
+                   ps.period_us / 1000.0, 1e6 / ps.period_us, ps.measured ? "measured" : "nominal",
+                   ps.jitter_us, ps.samples, ps.rejected, ps.relocks, ps.repeated);
+            printDecodeStats();
+        }
+        if (totalFrames % 600 == 0) {
+            printLatency();
         }
+#else
+        (void)frame_start;
+        (void)draw_end;
 #endif
     }
 
     printf("EndoViewer: exit Vulkan mode. Total frames: %ld, dropped: %ld\n",
            totalFrames, droppedFrames);
-
-    _keep_running = false;
-    // 稍微等待一下，让子线程安全退出（可选，防止析构过快）
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    printLatency();
+
+    // 解码目标随渲染器销毁：先停掉整条流水线（录像、采集、解码）并归还所有帧，再恢复相机自己的解码缓冲区
+    stopPipeline();
+    for (auto& stream : _streams) {
+        V4L2Capture* cap = stream->cap.load();
+        if (cap) {
+            cap->setDecodeTargets({}, 0, INTERNAL_DECODE_FORMAT);
+        }
+    }
 
     vkDisplay->cleanup();
     delete vkDisplay;
@@ -343,17 +565,35 @@ void EndoViewer::show() {
 #if !USE_VULKAN
     // ========== OPENGL MAIN LOOP ==========
     // Main display loop - no frame rate limiting for latency testing
+    std::vector<bool> fresh(streamCount, false);  // 本次绘制上传了新帧的流
+    std::vector<uint64_t> lastFrameIds(streamCount, 0);
+    constexpr uint64_t NO_FRAME_WAIT_US = 5000;   // 没有新帧时最长等待，之后处理窗口事件
     while (!glDisplay->shouldClose()) {
-        // Check if camera data is ready
-        if (_image_l_buffers[0].empty() || _image_r_buffers[0].empty()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        // 帧 ID 在取帧之前读取：之后发布的帧一定会改变帧 ID，等待不会错过它
+        for (size_t i = 0; i < streamCount; i++) {
+            lastFrameIds[i] = _streams[i]->frame_id.load(std::memory_order_acquire);
+        }
+        // Hold the newest frames until drawing is done, workers upload straight from them
+        // (the front slot of the mailbox stays untouched until the next fetch).
+        // 任一路流有新帧即重绘，没有新帧的流沿用纹理中的图像，不重新上传；
+        // 没有新帧时阻塞到下一次发布，不按固定时间轮询
+        bool anyFresh = fetchFrames(&CameraStream::render, fresh);
+        if (!anyFresh) {
+            waitNewFrame(lastFrameIds, monotonicNowUs() + NO_FRAME_WAIT_US);
             continue;
         }
 
         // 测量OpenGL各阶段耗时
         auto t1 = ::getCurrentTimePoint();
         // Direct OpenGL rendering without data copying for minimum latency
-        glDisplay->updateVideo(_image_l_buffers[0].data, _image_r_buffers[0].data, imwidth, imheight);
+        // 尺寸和行距取自每帧图像（相机协商的格式可能小于请求的 imwidth x imheight，各路也可以不同）
+        for (size_t i = 0; i < streamCount; i++) {
+            if (fresh[i]) {
+                const FramePtr& frame = _streams[i]->render.front();
+                glDisplay->updateStream(static_cast<int>(i), frame->data(), static_cast<int>(frame->width()),
+                                        static_cast<int>(frame->height()), static_cast<int>(frame->pitch()));
+            }
+        }
         auto t2 = ::getCurrentTimePoint();
 
         // 根据宏选择渲染模式
@@ -374,50 +614,190 @@ void EndoViewer::show() {
     printf("OpenGL: upload=%ldus, draw=%ldus\n", getDurationBetween(t1, t2), getDurationBetween(t3, t4));
 #endif
 #endif
+        // OpenGL 在绘制时上传纹理，没有单独的暂存写入/提交时间，只记录到交换返回为止
+        // 没有新帧的流重复显示纹理中的图像（仍持有的帧），只计入显示时的图像年龄
+        for (size_t i = 0; i < streamCount; i++) {
+            if (!_streams[i]->render.front()) {
+                continue;
+            }
+            FrameTiming timing = _streams[i]->render.front()->timing();
+            timing.present_us = monotonicUs(t4);
+            if (fresh[i]) {
+                _streams[i]->latency.record(timing);
+            }
+            _streams[i]->latency.recordShown(timing.capture_us, timing.present_us, fresh[i]);
+        }
     }
 
     printf("EndoViewer: exit OpenGL latency test mode.\n");
+    printLatency();
     glDisplay->cleanup();
     delete glDisplay;
 #endif
 }
 
 
+void EndoViewer::printDecodeStats() {
+#if STEREO_SYNC
+    // 双目配对：成对发布的帧数、配不上而丢弃/单独发布的帧数，以及两台相机的相位差和漂移
+    StereoSync<FramePtr>::Stats ss;
+    {
+        std::lock_guard<std::mutex> lck(_stereo_mtx);
+        ss = _stereo_sync.stats();
+    }
+    printf("STEREO_SYNC: matched=%lu unmatched=%lu/%lu passed=%lu/%lu phase=%.0f us drift=%.1f ppm "
+           "period=%.0f/%.0f us\n",
+           ss.matched, ss.unmatched[0], ss.unmatched[1], ss.passed[0], ss.passed[1],
+           ss.phase_us, ss.drift_ppm, ss.period_us[0], ss.period_us[1]);
+#endif
+    // 各级流水线的队列深度与平均耗时（出队 / 排队 / 解码）
+    for (auto& stream : _streams) {
+        const char* name = stream->name.c_str();
+        V4L2Capture* cap = stream->cap.load();
+        DecodePool::SourceStats st = _decode_pool->stats(stream->source);
+        uint64_t n = st.submitted > 0 ? st.submitted : 1;
+        uint64_t d = (st.decoded + st.failed) > 0 ? (st.decoded + st.failed) : 1;
+        printf("DECODE_STATS[%s]: pending=%u decoding=%u submitted=%lu decoded=%lu failed=%lu dropped=%lu sliced=%lu skipped=%lu "
+               "dequeue=%lu us queue=%lu us decode=%lu us (max %lu us)\n",
+               name, st.pending, st.decoding, st.submitted, st.decoded, st.failed, st.dropped, st.sliced,
+               cap ? cap->skippedFrames() : 0,
+               st.dequeue_us_sum / n, st.queue_us_sum / d, st.decode_us_sum / d, st.decode_us_max);
+        if (cap) {
+            // 以驱动时间戳衡量：传感器帧间隔的抖动，以及从曝光完成到出队的延迟和抖动
+            V4L2Capture::PacingStats ps = cap->pacingStats();
+            printf("CAPTURE_STATS[%s]: frames=%lu lost=%lu interval=%.0f us (nominal %u us, jitter %.0f us) "
+                   "latency=%.0f us (jitter %.0f us, max %lu us)\n",
+                   name, ps.frames, ps.lost, ps.interval_us_avg, ps.nominal_interval_us, ps.interval_jitter_us,
+                   ps.latency_us_avg, ps.latency_jitter_us, ps.latency_us_max);
+        }
+    }
+}
+
+
+void EndoViewer::printLatency() {
+    for (auto& stream : _streams) {
+        stream->latency.print(stream->name.c_str());
+    }
+}
+
+
 void EndoViewer::writeVideo() {
-    cv::Size size = cv::Size(imwidth * 2, imheight);
-    _writer.open(getCurrentTimeStr() + ".avi", cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 30, size, true);
+    // 等到所有相机都出帧后再打开录像文件，帧率取第一路相机协商得到的 timeperframe
+    const size_t streamCount = _streams.size();
+    std::vector<uint64_t> ids(streamCount, 0);
+    auto allRecorded = [this]() {
+        for (auto& stream : _streams) {
+            if (!stream->record.hasNew()) {
+                return false;
+            }
+        }
+        return true;
+    };
+    while (_keep_running && !allRecorded()) {
+        waitNewFrame(ids);
+        for (size_t i = 0; i < streamCount; i++) {
+            ids[i] = _streams[i]->frame_id.load(std::memory_order_acquire);
+        }
+    }
+    if (!_keep_running) {
+        return;
+    }
+    V4L2Capture* cap = _streams[0]->cap.load();
+    double fps = (cap && cap->frameInterval() > 0) ? 1e6 / cap->frameInterval() : 30.0;
+
+    // 所有流横向拼接成一帧：格子按各相机协商的图像尺寸（可能小于请求的 imwidth x imheight），
+    // 高度取第一路相机的高度，其他相机按宽高比缩放到同一高度
+    std::vector<cv::Size> cells(streamCount);
+    int cellHeight = cap ? static_cast<int>(cap->height()) : imheight;
+    int totalWidth = 0;
+    for (size_t i = 0; i < streamCount; i++) {
+        V4L2Capture* c = _streams[i]->cap.load();
+        int w = c ? static_cast<int>(c->width()) : imwidth;
+        int h = c ? static_cast<int>(c->height()) : imheight;
+        cells[i] = cv::Size(h == cellHeight ? w : (w * cellHeight + h / 2) / h, cellHeight);
+        totalWidth += cells[i].width;
+    }
+    cv::Size size = cv::Size(totalWidth, cellHeight);
+    printf("EndoViewer::writeVideo: recording %dx%d\n", size.width, size.height);
+    _writer.open(getCurrentTimeStr() + ".avi", cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps, size, true);
     if (!_writer.isOpened()) {
         std::cout << "EndoViewer: cannot open the video writer!\n";
         std::exit(-1);
     }
 
-    cv::Mat bino;
-    bool is_show_left = true;
+    // 拼接帧长期保留：每路流的新帧复制进自己的格子后立即归还信箱中的帧，没有新帧的流沿用格子里的上一帧，
+    // 各相机帧率略有不同或有抖动时第一路相机的每一帧仍然都写入（还没有收到过图像的流为黑色）
+    std::vector<cv::Mat> cellImages(streamCount);
+    std::vector<bool> fetched(streamCount, false);
+    cv::Mat bino(cellHeight, totalWidth, CV_8UC3, cv::Scalar::all(0));
+    for (size_t i = 0, x = 0; i < streamCount; x += cells[i].width, i++) {
+        cellImages[i] = bino(cv::Rect(static_cast<int>(x), 0, cells[i].width, cells[i].height));
+    }
     auto time_org = ::getCurrentTimePoint();
     while(_keep_running) {  // 使用 _keep_running 而不是 while(true)
+        // 以第一路相机的出帧节奏写入：阻塞到有新帧为止，而不是固定休眠
+        for (size_t i = 1; i < streamCount; i++) {
+            ids[i] = _streams[i]->frame_id.load(std::memory_order_acquire);
+        }
+        if (!waitNewFrame(ids) || _streams[0]->frame_id.load(std::memory_order_acquire) == ids[0]) {
+            continue;
+        }
+        ids[0] = _streams[0]->frame_id.load(std::memory_order_acquire);
         auto time_start = ::getCurrentTimePoint();
 
-        // 使用双缓冲的读取索引
-        int read_idx_l = 1 - _write_index_l.load(std::memory_order_acquire);
-        int read_idx_r = 1 - _write_index_r.load(std::memory_order_acquire);
+        // 从录像信箱取得最新帧（双目同步时左右眼成对取得），直接包装借用的解码缓冲区（3 字节图像不分配新内存）
+        fetchFrames(&CameraStream::record, fetched);
+        for (size_t i = 0; i < streamCount; i++) {
+            FramePtr& frame = _streams[i]->record.front();
+            if (!frame) {
+                continue;
+            }
+            // 包装时用每帧自己的尺寸和行距，尺寸与格子不同时（如相机重新连接后协商了别的格式）再缩放
+            const int w = static_cast<int>(frame->width());
+            const int h = static_cast<int>(frame->height());
+            const size_t pitch = frame->pitch();
+            cv::Mat image;
+            if (frame->format() == PixelFormat::RGB) {
+                image = cv::Mat(h, w, CV_8UC3, frame->data(), pitch);
+            } else if (frame->format() == PixelFormat::YUV422P) {
+                // 平面 YUV：色度平面横向放大到全宽后合并，按全范围 YCrCb 转换（字节顺序与 RGB 帧相同）
+                unsigned char* base = frame->data();
+                cv::Mat chroma[2];
+                for (unsigned int p = 1; p <= 2; p++) {
+                    cv::Mat plane(h, (w + 1) / 2, CV_8UC1, base + planeOffset(pitch, h, p), pitch / 2);
+                    cv::resize(plane, chroma[p - 1], cv::Size(w, h), 0, 0, cv::INTER_NEAREST);
+                }
+                cv::Mat ycrcb;
+                cv::Mat planes[3] = {cv::Mat(h, w, CV_8UC1, base, pitch), chroma[1], chroma[0]};
+                cv::merge(planes, 3, ycrcb);
+                cv::cvtColor(ycrcb, image, cv::COLOR_YCrCb2RGB);
+            } else {
+                // 解码目标中的 4 字节图像去掉第 4 字节（通道顺序与 RGB 帧相同）
+                cv::cvtColor(cv::Mat(h, w, CV_8UC4, frame->data(), pitch), image, cv::COLOR_BGRA2BGR);
+            }
+            // 格子是 bino 的子区域，缩放和复制直接写入拼接帧
+            if (w != cells[i].width || h != cells[i].height) {
+                cv::resize(image, cellImages[i], cells[i], 0, 0, cv::INTER_LINEAR);
+            } else {
+                image.copyTo(cellImages[i]);
+            }
+            image.release();
+            frame.reset();
+        }
 
-        cv::hconcat(_image_l_buffers[read_idx_l],
-                    _image_r_buffers[read_idx_r], bino);
         _writer.write(bino);
 
         auto ms = getDurationSince(time_start);
 
         if(getDurationSince(time_org) > (60*1000)) {
             _writer.release();
-            _writer.open(getCurrentTimeStr() + ".avi", cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 30, size, true);
+            _writer.open(getCurrentTimeStr() + ".avi", cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), fps, size, true);
             time_org = ::getCurrentTimePoint();
         }
 #if DO_EFFECIENCY_TEST
         printf("EndoViewer::writeVideo: [%ld]ms elapsed.\n", ms);
+#else
+        (void)ms;
 #endif
-
-        if(ms < 17) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(TIME_INTTERVAL - ms));
-        }
     }
-}
\ No newline at end of file
+}
@@ -5,47 +5,88 @@
 #include <cstdint>
 #include <opencv2/opencv.hpp>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include "./inc/v4l2_capture.h"
+#include "./inc/triple_buffer.h"
+#include "./inc/stereo_sync.h"
 
-class V4L2Capture;
+class DecodePool;
+class CaptureReactor;
 
 class EndoViewer {
 public:
     EndoViewer();
     ~EndoViewer();
-    void startup(uint8_t left_cam_id = 0, uint8_t right_cam_id = 1, bool is_write_to_video = false);
+    /**
+     * @brief 打开所有相机并进入显示循环
+     * @param cam_ids 每路相机流的 /dev/videoN 编号，前两路为左、右眼，其余为全景等辅助相机
+     */
+    void startup(const std::vector<int>& cam_ids, bool is_write_to_video = false);
 
     const uint16_t imwidth;
     const uint16_t imheight;
 
 private:
-    void readLeftImage(int index);
-    void readRightImage(int index);
+    using FrameMailbox = TripleBuffer<FramePtr>;
+
+    // 一路相机流的完整流水线：采集 → 解码 → 信箱 → 显示槽位（_streams 中的下标即显示槽位）
+    // 增加一路相机只需要增加一个实例，各级处理代码对所有流通用
+    struct CameraStream {
+        int device = -1;                // /dev/videoN
+        std::string name;               // 统计输出中的名字
+        std::atomic<V4L2Capture*> cap{nullptr};  // 打开相机的线程连上设备后设置
+        std::thread opener;             // 打开相机的线程，stopPipeline 中在停掉 reactor 之前 join
+        int source = -1;                // 解码线程池中的源编号
+
+        // ========== 零拷贝帧借用 ==========
+        // 解码线程发布最新解码帧的句柄（借用 V4L2 缓冲区及其解码缓冲区，不做整帧拷贝）
+        // 每个消费者（渲染、录像）各有一个无锁三缓冲信箱：生产者从不阻塞，消费者总是取到最新的完整帧，
+        // 使用期间独占该槽位；最后一个持有者释放时缓冲区重新入队
+        FrameMailbox render;
+        FrameMailbox record;
+
+        // 帧 ID 追踪（用于最新帧策略）
+        std::atomic<uint64_t> frame_id{0};
+
+        // 逐帧延迟统计（采集→出队→解码→暂存→提交→呈现），只在渲染线程中访问
+        LatencyRecorder latency;
+    };
+
+    void openCamera(CameraStream* stream);
+    void stopPipeline();
+    void publishFrame(CameraStream* stream, FramePtr frame, bool success);
+    void storeFrame(CameraStream* stream, FramePtr frame);
+    void deliverFrame(CameraStream* stream, FramePtr frame);
+    void notifyNewFrame();
+    bool fetchFrames(FrameMailbox CameraStream::*mailbox, std::vector<bool>& fresh);
+    bool waitNewFrame(const std::vector<uint64_t>& last_ids, uint64_t deadline_us = 0);
     void show();
+    void printDecodeStats();
+    void printLatency();
     void writeVideo();
 
-    std::thread _thread_read_l;
-    std::thread _thread_read_r;
-    V4L2Capture* _cap_l;
-    V4L2Capture* _cap_r;
-
-    // ========== 双缓冲系统 ==========
-    // 每个相机使用两个缓冲区，采集线程和渲染线程各自操作不同的缓冲区
-    cv::Mat _image_l_buffers[2];
-    cv::Mat _image_r_buffers[2];
-
-    // 指示当前采集线程正在写入的缓冲区索引 (0 或 1)
-    // 渲染线程读取的是另一个缓冲区 (1 - _write_index)
-    std::atomic<int> _write_index_l{0};
-    std::atomic<int> _write_index_r{0};
-
-    // 帧 ID 追踪（用于最新帧策略）
-    std::atomic<uint64_t> _frame_id_l{0};
-    std::atomic<uint64_t> _frame_id_r{0};
-
-    // 标记是否有新帧就绪（可选，用于跳帧检测）
-    std::atomic<bool> _new_frame_l{false};
-    std::atomic<bool> _new_frame_r{false};
-    // ================================
+    std::thread _thread_capture;    // 所有相机共用的采集线程（epoll）
+    std::unique_ptr<CaptureReactor> _reactor;
+
+    // 两级流水线：采集线程只负责出队，解码由所有相机共享的解码线程池完成
+    std::unique_ptr<DecodePool> _decode_pool;
+
+    // 所有相机流，startup 中创建后数量不再变化
+    std::vector<std::unique_ptr<CameraStream>> _streams;
+
+    // 双目同步：左右眼（_streams[0]、_streams[1]）的帧按采集时间戳配对后才发布到信箱，
+    // 两个解码线程都会调用，由 _stereo_mtx 串行化；消费者也在该锁内取走左右眼，总是成对看到
+    StereoSync<FramePtr> _stereo_sync;
+    std::mutex _stereo_mtx;
+
+    // 新帧发布时通知等待方（录像线程和渲染线程），按相机出帧节奏而不是固定休眠；
+    // 退出时也在其上通知，打开相机的线程的重试等待随即结束
+    std::mutex _frame_mtx;
+    std::condition_variable _frame_cv;
 
     bool _is_write_to_video;
     cv::VideoWriter _writer;
@@ -2,7 +2,7 @@
  * @brief OpenGL显示管理类
  *
  * 该类负责OpenGL窗口管理、着色器编译、纹理处理和渲染操作。
- * 支持双纹理分屏显示，用于内窥镜的双目立体视觉渲染。
+ * 每路相机流一张纹理，按 streamCell 分格显示（双目时左右分屏，另有辅助相机时排成网格）。
  */
 #ifndef GLDISPLAY_H
 #define GLDISPLAY_H
@@ -28,26 +28,47 @@ public:
      * @param height 窗口高度
      * @param title 窗口标题
      * @param numWindows 窗口数量（默认为1）
+     * @param streamCount 相机流数量（默认为2，即左右眼）
      * @return 初始化是否成功
      */
-    bool init(int width, int height, std::string title, int numWindows = 1);
+    bool init(int width, int height, std::string title, int numWindows = 1, int streamCount = 2);
 
     /**
-     * @brief 设置双纹理（左右眼）
-     * @param width 纹理宽度
-     * @param height 纹理高度
-     * @return 左纹理ID（用于兼容性）
+     * @brief 选择平面 YUV 路径（须在 setupTexture 之前调用）
+     * 开启后 updateVideo 接收 YUV422P 图像，Y/Cb/Cr 三个平面分别上传到 GL_R8 纹理，
+     * 由片段着色器转换为 RGB，省去 CPU 上的颜色转换和 3 字节 GL_RGB 上传
+     * @param enable 是否开启
+     */
+    void setPlanarYuv(bool enable) { planarYuv = enable; }
+
+    /**
+     * @brief 为每路相机流创建纹理
+     * 相机协商的图像尺寸可能不同：上传时图像尺寸与纹理不一致的流按图像尺寸重新分配纹理
+     * @param width 纹理初始宽度
+     * @param height 纹理初始高度
+     * @return 第一路流的纹理ID（用于兼容性）
      */
     unsigned int setupTexture(int width, int height);
 
     /**
-     * @brief 更新双目视频纹理数据
-     * @param leftData 左眼图像数据（BGR格式）
-     * @param rightData 右眼图像数据（BGR格式）
+     * @brief 更新各路相机流的纹理数据
+     * @param streams 按流编号排列的图像数据（紧密排列的 BGR 格式；平面 YUV 路径为行距
+     *                planarPitch(width) 的 YUV422P 图像），为空的流保留上一帧
      * @param width 图像宽度
      * @param height 图像高度
      */
-    void updateVideo(unsigned char* leftData, unsigned char* rightData, int width, int height);
+    void updateVideo(const std::vector<const unsigned char*>& streams, int width, int height);
+
+    /**
+     * @brief 只更新第 stream 路流的纹理数据，其他流的纹理保留上一帧（不重新上传）
+     * 数据在下一次绘制时上传一次，之后的绘制直接使用纹理中的图像；调用方须保持数据有效到该次绘制完成
+     * @param stream 流编号
+     * @param data 图像数据（格式同 updateVideo）
+     * @param width 图像宽度（各路流可以不同）
+     * @param height 图像高度
+     * @param pitch 行距（字节，平面 YUV 时为 Y 平面的行距），0 表示默认行距（同 updateVideo）
+     */
+    void updateStream(int stream, const unsigned char* data, int width, int height, int pitch = 0);
 
     /**
      * @brief 执行渲染操作（单窗口，保持向后兼容）
@@ -85,12 +106,20 @@ private:
     std::vector<unsigned int> VAOs;      // 每个窗口的VAO（VAO在OpenGL 3.3 Core Profile中不共享）
     unsigned int shaderProgram;         // GLSL着色器程序（共享）
     unsigned int VBO, EBO;              // 顶点缓冲对象和索引缓冲对象（共享）
-    unsigned int leftTexID, rightTexID;  // 左右眼纹理ID（共享）
+    int streamCount;                     // 相机流数量
+    std::vector<unsigned int> streamTexIDs;  // 每路流的纹理ID（共享），平面 YUV 时为 Y 平面
+    std::vector<unsigned int> chromaTexIDs;  // 平面 YUV：每路流的 Cb/Cr 平面纹理（2 * i, 2 * i + 1）
+    bool planarYuv = false;
+    std::vector<int> streamTexWidths;        // 每路流纹理的当前尺寸（上传的图像尺寸不同时重新分配）
+    std::vector<int> streamTexHeights;
     int windowWidth, windowHeight;       // 窗口尺寸
+    int framebufferWidth, framebufferHeight;  // 帧缓冲尺寸（用于逐路设置视口）
 
     // 着色器uniform位置缓存（避免多线程中重复查询）
-    int texLeftLocation;                 // texLeft uniform位置
-    int texRightLocation;                // texRight uniform位置
+    int texStreamLocation;               // texStream uniform位置
+    int texCbLocation;                   // texCb uniform位置
+    int texCrLocation;                   // texCr uniform位置
+    int planarYuvLocation;               // planarYuv uniform位置
 
     // 线程池相关成员变量
     std::vector<std::thread> workers;           // 持久线程池
@@ -110,11 +139,15 @@ private:
     std::vector<GLsync> window_frame_fences;   // 每个窗口最近一帧的 fence
     std::vector<std::chrono::steady_clock::time_point> window_swap_timestamps; // 每个窗口的 swap 时间戳
 
-    // 当前帧的纹理数据指针（由 updateVideo 在主线程写入，worker 在持久上下文中读取并上传）
-    const unsigned char* currentLeftData = nullptr;
-    const unsigned char* currentRightData = nullptr;
-    int currentImgWidth = 0;
-    int currentImgHeight = 0;
+    // 待上传的图像（由 updateVideo/updateStream 在主线程写入，worker 在持久上下文中取走并上传，
+    // 取走后置空：没有新数据的流不重复上传）；尺寸和行距随每帧图像给出
+    struct PendingImage {
+        const unsigned char* data = nullptr;
+        int width = 0;
+        int height = 0;
+        int pitch = 0;
+    };
+    std::vector<PendingImage> currentStreamData;
 
     /**
      * @brief 初始化GLFW窗口
@@ -141,6 +174,21 @@ private:
      */
     void setupQuad(int windowIndex);
 
+    /**
+     * @brief 在当前上下文中上传 updateVideo 给出的各路流数据
+     */
+    void uploadStreamTextures();
+
+    /**
+     * @brief 按图像尺寸（重新）分配第 stream 路流的纹理，内容为白色
+     */
+    void allocateStreamTexture(int stream, int width, int height);
+
+    /**
+     * @brief 在当前上下文中逐路绘制：视口限定在该路流的格子内，绑定该路流的纹理
+     */
+    void drawStreamCells();
+
     /**
      * @brief 在指定窗口上下文中执行渲染（用于多线程渲染）
      * @param windowIndex 窗口索引
@@ -179,15 +227,11 @@ private:
     )";
 
     /**
-     * 片段着色器：实现双目分屏渲染
-     *
-     * 屏幕布局：
-     * 左半屏 (UV.x < 0.5)：显示左眼纹理
-     * 右半屏 (UV.x >= 0.5)：显示右眼纹理
+     * 片段着色器：采样当前绘制的相机流纹理
      *
-     * UV映射逻辑：
-     * - 左半屏：UV.x 从 [0, 0.5] 映射到 [0, 1] (乘以2)
-     * - 右半屏：UV.x 从 [0.5, 1.0] 映射到 [0, 1] (减0.5后乘以2)
+     * 屏幕布局由 drawStreamCells 决定：每路流设置一次视口（该路流的格子）并绑定
+     * 对应纹理后绘制全屏四边形，因此 UV 坐标 [0, 1] 直接对应整幅图像。
+     * 平面 YUV 时三张纹理分别为 Y/Cb/Cr 平面，在此按全范围 BT.601（JPEG）转换为 RGB
      */
     const char* fragmentShaderSource = R"(
         #version 330 core
@@ -195,24 +239,21 @@ private:
 
         in vec2 TexCoord;    // 从顶点着色器接收的纹理坐标
 
-        uniform sampler2D texLeft;   // 左眼纹理采样器
-        uniform sampler2D texRight;  // 右眼纹理采样器
+        uniform sampler2D texStream;  // 当前相机流的纹理采样器（平面 YUV 时为 Y 平面）
+        uniform sampler2D texCb;      // Cb 平面（半宽，线性采样即完成上采样）
+        uniform sampler2D texCr;      // Cr 平面
+        uniform bool planarYuv;
 
         void main()
         {
-            vec2 uv = TexCoord;
-
-            if (uv.x < 0.5) {
-                // 屏幕左半部分：采样左眼纹理
-                // 将UV坐标从[0, 0.5]映射到[0, 1]
-                vec2 leftUV = vec2(uv.x * 2.0, uv.y);
-                FragColor = texture(texLeft, leftUV);
-            } else {
-                // 屏幕右半部分：采样右眼纹理
-                // 将UV坐标从[0.5, 1.0]映射到[0, 1]
-                vec2 rightUV = vec2((uv.x - 0.5) * 2.0, uv.y);
-                FragColor = texture(texRight, rightUV);
+            if (!planarYuv) {
+                FragColor = texture(texStream, TexCoord);
+                return;
             }
+            float y = texture(texStream, TexCoord).r;
+            float cb = texture(texCb, TexCoord).r - 128.0 / 255.0;
+            float cr = texture(texCr, TexCoord).r - 128.0 / 255.0;
+            FragColor = vec4(y + 1.402 * cr, y - 0.344136 * cb - 0.714136 * cr, y + 1.772 * cb, 1.0);
         }
     )";
 };
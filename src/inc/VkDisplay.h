@@ -16,11 +16,19 @@
 #include <iostream>
 #include <cstring>
 #include <set>
+#include <map>
 #include <algorithm>
 #include <string>
 #include <limits>
 #include <fstream>
 #include <chrono>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "mjpeg_decoder.h"
+#include "present_scheduler.h"
 
 class VkDisplay {
 public:
@@ -32,105 +40,404 @@ public:
      * @param width 窗口宽度
      * @param height 窗口高度
      * @param title 窗口标题
+     * @param streamCount 相机流数量，每路流一张纹理，按 streamCell 布局在窗口中
      * @return 初始化是否成功
      */
-    bool init(int width, int height, std::string title);
+    bool init(int width, int height, std::string title, int streamCount = 2);
+
+    /**
+     * @brief 选择 GPU 颜色扩展路径（须在 init 之前调用）
+     * 开启后上传解码器输出的 3 字节打包 RGB（存储缓冲区），由计算着色器展开为 RGBA 写入纹理：
+     * CPU 不做颜色扩展，暂存内存与上传的数据量减少 25%。设备不支持时 init 退回拷贝路径
+     * @param enable 是否开启
+     * @param bgr 输入是否为 BGR 顺序（由特化常量在着色器中交换 R/B）
+     */
+    void setGpuColorExpansion(bool enable, bool bgr = false) {
+        gpuColorExpansion = enable;
+        expandSwapRedBlue = bgr;
+    }
+
+    /**
+     * @brief 选择平面 YUV 路径（须在 init 之前调用）
+     * 开启后解码器输出 YUV422P（跳过 CPU 上的色度上采样和颜色转换），Y/Cb/Cr 三个平面分别上传到
+     * R8 纹理，由片段着色器转换为 RGB：4:2:2 图像每像素上传 2 字节（RGBA 为 4 字节）。
+     * 与 GPU 颜色扩展互斥，同时开启时以平面 YUV 为准
+     */
+    void setPlanarYuv(bool enable) { planarYuv = enable; }
+
+    /**
+     * @brief 选择主机可见的线性纹理（须在 init 之前调用）
+     * 统一内存设备（集成 GPU、lavapipe）上纹理放在既是设备本地又主机可见的内存中（VK_IMAGE_TILING_LINEAR），
+     * updateVideo 按 vkGetImageSubresourceLayout 的行距直接写入纹理，没有暂存缓冲区和 vkCmdCopyBufferToImage。
+     * 设备没有这种内存、不支持线性纹理采样或没有时间线信号量时 init 退回拷贝路径；不与 GPU 颜色扩展、传输队列上传同时使用，
+     * 解码器写入自己的解码缓冲区（createDecodeTargets 返回空）
+     */
+    void setLinearTextures(bool enable) { linearTextures = enable; }
+
+    /**
+     * @brief 实际使用的上传路径：init 之后为设备支持的结果（不支持时 init 已退回拷贝路径），之前为所选的路径
+     */
+    bool hasGpuColorExpansion() const { return gpuColorExpansion; }
+    bool hasPlanarYuv() const { return planarYuv; }
+    bool hasLinearTextures() const { return linearTextures; }
+
+    /**
+     * @brief 是否允许解码目标导入主机内存（VK_EXT_external_memory_host，须在 init 之前调用，默认允许）
+     * 关闭时解码目标总是分配主机可见的设备内存，用于对比两条路径
+     */
+    void setHostMemoryImport(bool enable) { hostMemoryImportAllowed = enable; }
+
+    /**
+     * @brief 设置同时在途的帧数（须在 init 之前调用，取值 1 ~ MAX_FRAMES_IN_FLIGHT）
+     * 每个帧槽位有自己的暂存缓冲区、各路流纹理和命令缓冲区，CPU 写下一帧时不必等待上一帧的 GPU 工作。
+     * 1 为低延迟模式（默认）；4K 或多路相机时可用 2 ~ 3 以一帧排队换取吞吐量
+     * @param depth 在途帧数
+     */
+    void setFramesInFlight(int depth) { framesInFlight = std::min(std::max(depth, 1), MAX_FRAMES_IN_FLIGHT); }
+
+    /**
+     * @brief 设置管线缓存文件（须在 init 之前调用，空字符串表示不使用），默认为工作目录下的 pipeline_cache.bin
+     * init 用文件中的数据创建 VkPipelineCache，头部的厂商/设备 ID 和 pipelineCacheUUID 与当前设备不一致时丢弃；
+     * 缓存为空或被丢弃时在 init 结束后写回，之后的启动不再由驱动编译管线
+     */
+    void setPipelineCachePath(const std::string& path) { pipelineCachePath = path; }
+
+    /**
+     * @brief 选择离屏模式（须在 init 之前调用）
+     * 不创建窗口、表面和交换链，按 init 的宽高绘制到离屏颜色图像，draw 不呈现。不需要显示器，
+     * 可以在没有 GPU 的构建机上用软件 Vulkan（lavapipe）测量上传/绘制吞吐量并检查输出像素
+     * @param enable 是否开启
+     * @param readback 每帧绘制后把图像拷贝到主机可见的回读缓冲区，由 readback 读取
+     */
+    void setHeadless(bool enable, bool readback = false) {
+        headless = enable;
+        headlessReadback = enable && readback;
+    }
+
+    /**
+     * @brief 读取最近一次 draw 绘制的离屏图像（离屏模式且开启回读时可用），等待该帧完成
+     * @param pixels 输出：BGRA，紧密排列（每行 width * 4 字节）
+     * @param width 输出：图像宽度
+     * @param height 输出：图像高度
+     * @return 是否读到图像
+     */
+    bool readback(std::vector<unsigned char>& pixels, uint32_t& width, uint32_t& height);
 
     /**
      * @brief 检查窗口是否应该关闭
      * @return true如果窗口应该关闭
      */
-    bool shouldClose() { return glfwWindowShouldClose(window); }
+    bool shouldClose() { return window != nullptr && glfwWindowShouldClose(window); }
 
     /**
      * @brief 处理窗口事件
      */
-    void pollEvents() { glfwPollEvents(); }
+    void pollEvents() {
+        if (window != nullptr) {
+            glfwPollEvents();
+        }
+    }
 
     /**
      * @brief 执行渲染操作
+     * @return true 如果本帧已提交并呈现（交换链重建时返回 false）
      */
-    void draw();
+    bool draw();
 
     /**
-     * @brief 更新双目视频纹理数据
-     * @param leftData 左眼图像数据（BGR格式）
-     * @param rightData 右眼图像数据（BGR格式）
+     * @brief 更新各路相机流的纹理数据
+     * 数据位于 createDecodeTargets 分配的解码目标中时只记录上传来源（指针交接），否则按紧密排列的
+     * 3 字节图像写入暂存缓冲区（拷贝路径扩展为 RGBA，GPU 颜色扩展路径原样写入）；
+     * 平面 YUV 路径的数据为行距 planarPitch(width) 的 YUV422P 图像，原样写入
+     * @param streams 按流编号排列的图像数据，为空的流保留上一帧
      * @param width 图像宽度
      * @param height 图像高度
+     * @param owners 按流编号排列的数据持有者；解码目标中的数据会被持有到 GPU 拷贝完成，
+     *               期间对应的解码目标不会被重新写入
+     */
+    void updateVideo(const std::vector<const unsigned char*>& streams, int width, int height,
+                     const std::vector<std::shared_ptr<const void>>& owners = {});
+
+    /**
+     * @brief 只更新第 stream 路流的纹理数据（数据来源和持有规则同 updateVideo）
+     * 其他流不上传：本槽位的纹理已是它们的最新图像时直接采样，否则由 GPU 从最新图像所在槽位的纹理拷贝。
+     * 图像尺寸与该路流不同时先按 setFrameSize 重新分配；失败的尺寸只报告一次，之后该尺寸的帧直接丢弃
+     * @param owner 数据持有者，数据位于解码目标中时持有到 GPU 拷贝完成
+     */
+    void updateStream(int stream, const unsigned char* data, int width, int height,
+                      const std::shared_ptr<const void>& owner = nullptr);
+
+    /**
+     * @brief 为第 stream 路流分配解码目标：持久映射的暂存内存，解码器直接写入，GPU 从中上传到纹理，
+     * 省去解码缓冲区到暂存缓冲区的颜色扩展和拷贝。设备支持 VK_EXT_external_memory_host 时解码目标为
+     * 按页对齐分配的普通主机内存（带 CPU 缓存），导入为 VkBuffer 后拷贝直接从中读取；否则分配主机可见的设备内存
+     * @param stream 流编号
+     * @param count 解码目标数量（每个 V4L2 缓冲区一块）
+     * @param pitch 输出：每行字节数
+     * @param format 输出：解码器应写入的像素格式（拷贝路径为 RGBX，GPU 颜色扩展路径为 RGB，
+     *               平面 YUV 路径为 YUV422P）
+     * @return 各解码目标的地址，失败时为空（继续使用拷贝路径）；地址在 cleanup 之前有效
      */
-    void updateVideo(unsigned char* leftData, unsigned char* rightData, int width, int height);
+    std::vector<unsigned char*> createDecodeTargets(int stream, uint32_t count, uint32_t& pitch, PixelFormat& format);
+
+    /**
+     * @brief 第 stream 路流的解码目标是否为导入的主机内存（否则为主机可见的设备内存，或还没有分配）
+     */
+    bool decodeTargetsImported(int stream) const {
+        return stream >= 0 && stream < static_cast<int>(decodeTargets.size()) &&
+               decodeTargets[stream].hostAllocation != nullptr;
+    }
+
+    /**
+     * @brief 设置第 stream 路流的相机图像尺寸（采集设备协商的格式，各路流可以不同），默认 1920x1080
+     * init 之前调用只记录尺寸；init 之后尺寸变化时只重新分配该路流的纹理、暂存缓冲区和描述符，
+     * 替换下来的资源在引用它们的在途帧完成后才销毁，不等待整个设备空闲。
+     * 该路流已分配解码目标时不能修改（解码器正按旧尺寸写入），须在 createDecodeTargets 之前调用
+     * @return 新尺寸是否已生效
+     */
+    bool setFrameSize(int stream, uint32_t width, uint32_t height);
 
     /**
      * @brief 清理Vulkan资源
      */
     void cleanup();
 
-    // ========== VSync 相位追踪（Just-in-Time 提交优化）==========
-    static constexpr double VSYNC_PERIOD_MS = 16.667;  // 60Hz VSync 周期
-    static constexpr double SUBMIT_AHEAD_MS = 2.0;     // 提交提前量
+    // ========== 提交时机（Just-in-Time 提交优化）==========
+    static constexpr double SUBMIT_AHEAD_MS = 2.0;     // 提交提前量（目标 VSync 之前）
+
+    /**
+     * @brief 提交时机调度器：刷新周期与 VSync 相位由呈现完成时间测得，结合相机帧时钟决定何时提交
+     * 先取走等待线程测得的呈现完成时间再返回；只在渲染线程使用
+     */
+    PresentScheduler& presentScheduler();
+
+    /**
+     * @brief 能否测得呈现完成时间（VK_KHR_present_wait），否则刷新周期取显示器模式的标称值
+     */
+    bool hasPresentTiming() const { return presentWait; }
 
     /**
-     * @brief 计算到下一个 VSync 的剩余时间（毫秒）
-     * @return 剩余时间，正数表示还有多久到下一个 VSync，负数表示已过
+     * @brief 最近一次 vkQueueSubmit / vkQueuePresentKHR 返回的时间（用于逐帧延迟统计）
      */
-    double getTimeToNextVSync();
+    std::chrono::steady_clock::time_point getLastSubmitTime() const { return lastSubmitTime; }
+    std::chrono::steady_clock::time_point getLastPresentTime() const { return lastPresentTime; }
     // ============================================================
 
 private:
     // GLFW窗口
     GLFWwindow* window = nullptr;
 
-    // Vulkan核心对象
-    VkInstance instance;
-    VkDebugUtilsMessengerEXT debugMessenger;
-    VkSurfaceKHR surface;
+    // Vulkan核心对象（句柄初始化为空，init 中途失败或重复调用 cleanup 时只销毁已创建的对象）
+    VkInstance instance = VK_NULL_HANDLE;
+    VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    VkDevice device;
-    VkQueue graphicsQueue;
-    VkQueue presentQueue;
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+    VkQueue presentQueue = VK_NULL_HANDLE;
+    VkQueue transferQueue = VK_NULL_HANDLE;     // 只支持传输的队列族（DMA 引擎），设备没有时为空
+    uint32_t graphicsFamilyIndex = 0;
+    uint32_t transferFamilyIndex = 0;
 
     // 交换链相关
-    VkSwapchainKHR swapChain;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     std::vector<VkImage> swapChainImages;
-    VkFormat swapChainImageFormat;
-    VkExtent2D swapChainExtent;
+    VkFormat swapChainImageFormat = VK_FORMAT_UNDEFINED;
+    VkExtent2D swapChainExtent{};
     std::vector<VkImageView> swapChainImageViews;
 
+    // 离屏模式：每个帧槽位一张颜色图像代替交换链图像（draw 以槽位为图像编号），可选的回读缓冲区
+    bool headless = false;
+    bool headlessReadback = false;
+    std::vector<VkDeviceMemory> offscreenMemories;
+    std::vector<VkBuffer> readbackBuffers;
+    std::vector<VkDeviceMemory> readbackMemories;
+    std::vector<void*> readbackMapped;
+    int lastDrawnSlot = -1;                     // 最近一次 draw 提交的槽位，-1 表示还没有绘制
+
     // 渲染管线相关
-    VkRenderPass renderPass;
-    VkDescriptorSetLayout descriptorSetLayout;
-    VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    bool pipelineCacheWarm = false;             // 缓存文件有效并已载入
     std::vector<VkFramebuffer> swapChainFramebuffers;
-    VkCommandPool commandPool;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
 
-    // 纹理资源（左眼和右眼）
-    VkImage leftTextureImage, rightTextureImage;
-    VkDeviceMemory leftTextureImageMemory, rightTextureImageMemory;
-    VkImageView leftTextureImageView, rightTextureImageView;
-    VkSampler textureSampler;
-    VkDescriptorPool descriptorPool;
-    VkDescriptorSet descriptorSet;
+    // 图像的当前状态（布局、最近的访问及其阶段）：录制时跟踪，据此只生成需要的屏障
+    struct ImageState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkAccessFlags access = 0;
+        VkPipelineStageFlags stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    };
 
-    // Staging Buffer（支持多缓冲以实现 CPU/GPU 并行）
+    // 屏障批次：一组图像转换合并为一次 vkCmdPipelineBarrier，状态已满足的转换（读后读）不生成屏障
+    struct BarrierBatch {
+        std::vector<VkImageMemoryBarrier> barriers;
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+
+        void transition(VkImage image, ImageState& state, VkImageLayout layout,
+                        VkAccessFlags access, VkPipelineStageFlags stage,
+                        uint32_t srcFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t dstFamily = VK_QUEUE_FAMILY_IGNORED);
+        void record(VkCommandBuffer commandBuffer);
+    };
+
+    // 纹理资源：每个帧槽位每路相机流一张纹理和一个描述符集，逐路设置视口绘制
+    struct TexturePlane {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        ImageState state;                   // 图形队列上录制到的最新状态
+        unsigned char* mapped = nullptr;    // 线性纹理：映射的第一行
+        VkDeviceSize rowPitch = 0;          // 线性纹理：每行字节数（vkGetImageSubresourceLayout）
+    };
+    struct StreamTexture {
+        VkImage image = VK_NULL_HANDLE;     // RGBA 纹理，平面 YUV 路径为 Y 平面
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        ImageState state;
+        unsigned char* mapped = nullptr;
+        VkDeviceSize rowPitch = 0;
+        TexturePlane chroma[2];             // 平面 YUV 路径的 Cb/Cr 平面（半宽）
+        VkExtent2D extent{};                // 图像尺寸（该路流的相机格式，Cb/Cr 平面为半宽）
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkDescriptorSet expandSet = VK_NULL_HANDLE;  // GPU 颜色扩展：源为同一槽位的暂存缓冲区
+    };
+    int streamCount = 2;
+    std::vector<StreamTexture> streamTextures;  // 按 slot * streamCount + stream 排列
+    std::vector<int> latestSlot;                // 每路流最新图像所在的槽位，-1 表示还没有收到图像
+    VkSampler textureSampler = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> descriptorPools;  // 每路流一个，该路流重新分配纹理时随之替换
+    static constexpr uint32_t DEFAULT_FRAME_WIDTH = 1920;   // setFrameSize 之前各路流的图像尺寸
+    static constexpr uint32_t DEFAULT_FRAME_HEIGHT = 1080;
+    std::vector<VkExtent2D> streamExtents;      // 每路流的相机图像尺寸（setFrameSize），该路流的纹理、暂存区域和拷贝区域按此分配
+    std::vector<VkExtent2D> rejectedExtents;    // 每路流 setFrameSize 失败的尺寸：同一尺寸的帧直接丢弃，不再逐帧重试
+
+    StreamTexture& streamTexture(int slot, int stream) { return streamTextures[slot * streamCount + stream]; }
+
+    // Staging Buffer（支持多缓冲以实现 CPU/GPU 并行）：每个帧槽位每路流一个，按 slot * streamCount + stream 排列
     std::vector<VkBuffer> stagingBuffers;
     std::vector<VkDeviceMemory> stagingBufferMemories;
     std::vector<void*> stagingBuffersMapped;
 
+    // 解码目标：每路流一个持久映射的缓冲区，内含 count 个图像（RGBX/RGB/YUV422P），解码线程直接写入
+    struct DecodeTargets {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        unsigned char* mapped = nullptr;
+        void* hostAllocation = nullptr;     // 导入的主机内存（非空时 mapped 指向它），释放设备内存后 free
+        VkDeviceSize slotSize = 0;
+        uint32_t count = 0;
+        uint32_t pitch = 0;
+        std::vector<VkDescriptorSet> expandSets;  // GPU 颜色扩展：源为该缓冲区，按帧槽位写入该槽位的纹理
+    };
+    std::vector<DecodeTargets> decodeTargets;
+
+    // 本帧各路流纹理的上传来源：updateVideo 设置，recordUploads 录制拷贝
+    struct StreamUpload {
+        VkBuffer buffer = VK_NULL_HANDLE;   // VK_NULL_HANDLE 表示本帧不更新该路纹理
+        VkDeviceSize offset = 0;
+        uint32_t pitch = 0;                 // 每行字节数（平面 YUV 为 Y 平面），0 表示紧密排列
+        VkExtent2D extent{};                // 图像尺寸（与该路流的纹理一致）
+        VkDescriptorSet expandSet = VK_NULL_HANDLE;  // 非空时由计算着色器展开打包 RGB，否则直接拷贝
+        uint64_t transferValue = 0;         // 非 0 表示已在传输队列上拷贝：图形队列等待 uploadTimeline 到该值并获取所有权
+        bool hostWritten = false;           // 线性纹理：CPU 已直接写入本槽位的纹理，不需要拷贝
+    };
+    std::vector<StreamUpload> streamUploads;
+    // 上传来源为解码目标时的数据持有者：先挂在下一次提交上，按帧槽位保留到其 fence 完成
+    std::vector<std::shared_ptr<const void>> pendingOwners;
+    std::vector<std::vector<std::shared_ptr<const void>>> inFlightOwners;
+
+    // GPU 颜色扩展：计算着色器把存储缓冲区中的打包 RGB 展开写入纹理（存储图像）
+    bool gpuColorExpansion = false;
+    bool expandSwapRedBlue = false;
+    VkDescriptorSetLayout expandSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout expandPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline expandPipeline = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> expandDescriptorPools;  // 每路流一个（纹理的集合和解码目标的集合）
+
+    // 平面 YUV：Y/Cb/Cr 三张 R8 纹理，片段着色器（特化常量）转换为 RGB
+    bool planarYuv = false;
+
+    // 线性纹理：主机可见、持久映射，CPU 直接写入；始终处于 General 布局（主机访问要求），在该布局下采样
+    bool linearTextures = false;
+    VkImageLayout sampledLayout() const {
+        return linearTextures ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    // 传输队列上传：每路流的数据就绪后立即在传输队列上提交拷贝，与图形队列上一帧的绘制和呈现重叠；
+    // 拷贝完成后把纹理所有权释放给图形队列族，图形队列等待 uploadTimeline 并获取所有权后采样
+    bool transferUploads = false;
+    VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> transferCommandBuffers;  // 按 slot * streamCount + stream 排列
+    VkSemaphore uploadTimeline = VK_NULL_HANDLE;
+    uint64_t uploadCounter = 0;
+    std::vector<uint64_t> textureReadValues;    // 每张纹理最近一次被采样的提交在 frameTimeline 上的值
+
     // 命令缓冲区和同步对象
-    std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<VkCommandBuffer> commandBuffers;        // 每个槽位一个，每帧只录制上传命令
+    // 预录制的绘制命令，按（交换链图像，帧槽位，sources）索引，见 renderCommandKey。
+    // sources 是各路流采样的纹理所在槽位（framesInFlight 进制，第 i 位对应第 i 路流），
+    // 各路流都采样本槽位的组合在创建时录制，其余组合第一次用到时才分配和录制，只保存实际出现过的组合
+    struct RenderCommands {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        bool dirty = false;                             // 描述符集已替换，下次使用前重新录制
+    };
+    std::map<uint64_t, RenderCommands> renderCommandBuffers;
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
+    std::vector<VkFence> inFlightFences;        // 设备不支持时间线信号量时按槽位等待
     uint32_t currentFrame = 0;
+    int framesInFlight = 1;                     // 在途帧数（帧槽位数），1 为低延迟模式
+
+    // 时间线信号量：每次提交把计数推进到 ++frameCounter，槽位复用前等待该槽位上次提交的值
+    bool timelineSemaphores = false;
+    VkSemaphore frameTimeline = VK_NULL_HANDLE;
+    uint64_t frameCounter = 0;
+    std::vector<uint64_t> slotTimelineValues;
+    PFN_vkWaitSemaphores waitSemaphoresFn = nullptr;   // 核心 1.2 或 VK_KHR_timeline_semaphore 的入口
+    uint64_t submitCount = 0;                   // 图形队列上已提交的帧数（两种同步方式下都计数）
+
+    // VK_EXT_external_memory_host：解码目标为导入的主机内存，起点和大小按 hostPointerAlignment 对齐
+    bool hostMemoryImport = false;
+    bool hostMemoryImportAllowed = true;    // setHostMemoryImport
+    VkDeviceSize hostPointerAlignment = 0;
+    PFN_vkGetMemoryHostPointerPropertiesEXT getMemoryHostPointerPropertiesFn = nullptr;
+
+    // 呈现时机（VK_KHR_present_id + VK_KHR_present_wait）：每次呈现带上递增的 ID，等待线程等待最新一次
+    // 呈现完成并记下完成时间，presentScheduler() 取走交给调度器
+    PresentScheduler scheduler;
+    bool presentWait = false;
+    PFN_vkWaitForPresentKHR waitForPresentFn = nullptr;
+    uint64_t presentId = 0;                         // 最近一次呈现的 ID
+    std::thread presentWaitThread;
+    std::mutex presentWaitMutex;                    // 保护以下三项
+    std::condition_variable presentWaitCv;
+    uint64_t presentWaitTarget = 0;                 // 等待线程要等的呈现 ID
+    bool presentWaitStop = false;
+    std::vector<uint64_t> presentCompletions;       // 测得的呈现完成时间（us），等待取走
+
+    // 图像尺寸变化时替换下来的资源：draw 中槽位等待覆盖了退役前的全部提交后销毁
+    struct RetiredResources {
+        uint64_t submitCount = 0;               // 退役时的 submitCount，此前的提交可能仍在使用这些资源
+        std::vector<StreamTexture> textures;
+        std::vector<VkBuffer> buffers;
+        std::vector<VkDeviceMemory> memories;
+        std::vector<VkDescriptorPool> descriptorPools;
+    };
+    std::vector<RetiredResources> retiredResources;
 
     // 配置常量
-    static constexpr int MAX_FRAMES_IN_FLIGHT = 1;  // 改为 1 启用低延迟模式
+    static constexpr int MAX_FRAMES_IN_FLIGHT = 3;  // 在途帧数上限（setFramesInFlight）
+    static constexpr uint32_t EXPAND_GROUP_SIZE = 16;     // 计算着色器工作组边长（与 expand.glsl 一致）
     bool framebufferResized = false;
 
-    // VSync 相位追踪（用于 Just-in-Time 提交优化）
+    // 逐帧延迟统计
     std::chrono::steady_clock::time_point lastPresentTime;  // 最近一次 vkQueuePresentKHR 的时间
+    std::chrono::steady_clock::time_point lastSubmitTime;   // 最近一次 vkQueueSubmit 的时间
 
     // Vulkan初始化辅助函数
     void initGLFW(int width, int height, std::string title);
@@ -141,24 +448,56 @@ private:
     void createLogicalDevice();
     void createSwapChain();
     void createImageViews();
+    void createOffscreenTargets(uint32_t width, uint32_t height);
     void createRenderPass();
     void createDescriptorSetLayout();
     void createGraphicsPipeline();
     void createFramebuffers();
     void createCommandPool();
-    void createTextureResources();
-    void createStagingBuffer();
-    void createDescriptors();
+    void createTextureResources(int stream);
+    void destroyStreamTexture(StreamTexture& texture);
+    void destroyRetiredResources(bool all);
+    bool checkLinearTextureSupport();
+    void createTexturePlane(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage,
+                            VkImage& image, VkDeviceMemory& memory, VkImageView& view,
+                            unsigned char*& mapped, VkDeviceSize& rowPitch);
+    void writeLinearTexture(int stream, const unsigned char* data, int width, int height);
+    void createStagingBuffer(int stream);
+    bool importDecodeTargets(DecodeTargets& dt, VkBufferCreateInfo bufferInfo);
+    void destroyDecodeTargets(DecodeTargets& dt);
+    void createDescriptors(int stream);
+    void createExpandPipeline();
+    void destroyExpandPipeline();
+    VkDescriptorSet createExpandSet(int stream, const StreamTexture& texture, VkBuffer source);
     void createSyncObjects();
+    void createTransferResources();
+    void waitForSlot(uint32_t slot);
+    void stageUpload(int stream, const unsigned char* data, int width, int height,
+                     const std::shared_ptr<const void>& owner);
+    void submitTransferUpload(int stream);
+    void recordUploadCopy(VkCommandBuffer commandBuffer, int stream);
+    uint32_t texturePlanes(StreamTexture& texture, VkImage images[3], ImageState* states[3]);
+    uint32_t uploadPlanes(int stream, VkBufferImageCopy regions[3]);
     void createCommandBuffers();
-    VkShaderModule createShaderModule(const std::vector<char>& code);
+    void createRenderCommandBuffers();
+    void createPipelineCache();
+    void savePipelineCache();
+    VkShaderModule createShaderModule(const uint32_t* code, size_t codeSize);
 
     // 文件读取辅助函数
     static std::vector<char> readFile(const std::string& filename);
 
     // 渲染和同步函数
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    bool recordUploads(VkCommandBuffer commandBuffer);
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, int slot, uint32_t sources);
+    uint32_t renderSources(int slot) const;
+    uint64_t renderCommandKey(uint32_t imageIndex, int slot, uint32_t sources) const;
+    VkCommandBuffer renderCommandBuffer(uint32_t imageIndex, int slot, uint32_t sources);
     void recreateSwapChain();
+    void updateNominalRefresh();
+    void startPresentWait();
+    void stopPresentWait();
+    void presentWaitLoop(VkSwapchainKHR swapchain, uint64_t waited);
     // 辅助函数（主要用于调试或特殊情况）
     void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
     void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t offset);
@@ -176,6 +515,7 @@ private:
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        std::optional<uint32_t> transferFamily;     // 可选：只支持传输（不含图形和计算）的队列族
 
         bool isComplete() {
             return graphicsFamily.has_value() && presentFamily.has_value();
@@ -0,0 +1,169 @@
+#include "capture_reactor.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <chrono>
+#include <iostream>
+#include <cstring>
+
+namespace
+{
+    // events handled per epoll_wait(), more ready cameras are picked up by the next call
+    const int MAX_EVENTS = 16;
+}
+
+CaptureReactor::CaptureReactor()
+    : epoll_fd(-1)
+    , wake_fd(-1)
+    , stopping(false)
+    , idle_wakeups(0)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd == -1)
+    {
+        std::cout << "CaptureReactor: epoll_create1 error " << errno << ", " << strerror(errno) << std::endl;
+        return;
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wake_fd == -1)
+    {
+        std::cout << "CaptureReactor: eventfd error " << errno << ", " << strerror(errno) << std::endl;
+        return;
+    }
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;      // the wake-up event has no camera
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == -1)
+        std::cout << "CaptureReactor: cannot register the wake-up fd, " << strerror(errno) << std::endl;
+}
+
+CaptureReactor::~CaptureReactor()
+{
+    if(wake_fd != -1)
+        close(wake_fd);
+    if(epoll_fd != -1)
+        close(epoll_fd);
+}
+
+int CaptureReactor::addCamera(V4L2Capture *capture, FrameCallback on_frame)
+{
+    if(epoll_fd == -1 || capture == nullptr || capture->getFd() < 0)
+        return -1;
+
+    std::lock_guard<std::mutex> lck(mtx);
+    std::unique_ptr<Camera> camera(new Camera());
+    camera->capture = capture;
+    camera->on_frame = std::move(on_frame);
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = camera.get();
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, capture->getFd(), &ev) == -1)
+    {
+        std::cout << "CaptureReactor: cannot register camera fd " << capture->getFd() << ", " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    cameras.push_back(std::move(camera));
+    int id = static_cast<int>(cameras.size()) - 1;
+
+    // a buffer completed before the registration raised no edge, pick it up on the reactor thread
+    uint64_t one = 1;
+    if(write(wake_fd, &one, sizeof(one)) == -1)
+    {
+        // the counter is already non-zero, the reactor wakes up anyway
+    }
+    return id;
+}
+
+void CaptureReactor::run()
+{
+    if(epoll_fd == -1 || wake_fd == -1)
+        return;
+
+    epoll_event events[MAX_EVENTS];
+    while(!stopping)
+    {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if(n == -1)
+        {
+            if(errno == EINTR)
+                continue;
+            std::cout << "CaptureReactor: epoll_wait error " << errno << ", " << strerror(errno) << std::endl;
+            break;
+        }
+
+        for(int i = 0; i < n && !stopping; i++)
+        {
+            Camera *camera = static_cast<Camera*>(events[i].data.ptr);
+            if(camera != nullptr)
+            {
+                dispatch(*camera, events[i].events);
+                continue;
+            }
+
+            uint64_t count;
+            if(read(wake_fd, &count, sizeof(count)) == -1)
+            {
+                // already drained
+            }
+            if(stopping)
+                break;
+
+            // after addCamera(): try every camera once, a buffer may be waiting without an edge
+            std::vector<Camera*> all;
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                for(auto &c : cameras)
+                    all.push_back(c.get());
+            }
+            for(Camera *c : all)
+                dispatch(*c, EPOLLIN);
+        }
+    }
+}
+
+void CaptureReactor::stop()
+{
+    stopping = true;
+    uint64_t one = 1;
+    if(wake_fd != -1 && write(wake_fd, &one, sizeof(one)) == -1)
+    {
+        // the counter is already non-zero, the reactor wakes up anyway
+    }
+}
+
+void CaptureReactor::dispatch(Camera &camera, uint32_t events)
+{
+    auto wakeup = std::chrono::steady_clock::now();
+
+    if((events & (EPOLLERR | EPOLLHUP)) != 0 && !camera.error_reported)
+    {
+        // also raised while every buffer is lent out; the edge is reported once, keep serving
+        std::cout << "CaptureReactor: error is reported for camera fd " << camera.capture->getFd() << std::endl;
+        camera.error_reported = true;
+    }
+
+    // edge-triggered: dequeue until the driver has no filled buffer left
+    bool delivered = false;
+    while(true)
+    {
+        FramePtr frame = std::make_shared<V4L2Capture::Frame>(camera.capture->tryDequeueRawFrame());
+        if(!*frame)
+            break;
+
+        camera.error_reported = false;
+        delivered = true;
+        long dequeue_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - wakeup).count();
+        if(camera.on_frame)
+            camera.on_frame(std::move(frame), dequeue_us);
+        wakeup = std::chrono::steady_clock::now();
+    }
+
+    if(!delivered)
+        idle_wakeups.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,68 @@
+#ifndef CAPTURE_REACTOR_H
+#define CAPTURE_REACTOR_H
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+#include "v4l2_capture.h"
+
+
+/** @brief One thread serving the capture of any number of cameras.
+ * The (non-blocking) fds of all cameras are registered in one epoll set and the thread sleeps in
+ * epoll_wait() until a driver completes a buffer, so it wakes right when a frame is ready instead
+ * of one thread per camera polling with select(). The ready buffers are dequeued and handed to the
+ * callback of the camera, which passes them on to the decode stage.
+ * The fds are edge-triggered: every wake-up dequeues until VIDIOC_DQBUF reports EAGAIN.
+ */
+class CaptureReactor
+{
+public:
+    /** @brief Called on the reactor thread for every dequeued (raw) frame
+     * @param dequeue_us time from the wake-up to the frame being dequeued
+     */
+    using FrameCallback = std::function<void(FramePtr frame, long dequeue_us)>;
+
+    CaptureReactor();
+    ~CaptureReactor();
+
+    CaptureReactor(const CaptureReactor&) = delete;
+    CaptureReactor& operator=(const CaptureReactor&) = delete;
+
+    /** @brief Register an opened camera, may be called while the reactor is running
+     * The camera must stay open while registered, a reopened camera must be added again.
+     * @return the camera id, -1 on failure
+     */
+    int addCamera(V4L2Capture *capture, FrameCallback on_frame);
+
+    /** @brief Dispatch frames until stop() is called, runs on the calling thread
+     */
+    void run();
+
+    /** @brief Wake up run() and make it return, may be called from any thread
+     */
+    void stop();
+
+    /** @brief Count of epoll wake-ups that delivered no frame (spurious or error events)
+     */
+    uint64_t idleWakeups() const { return idle_wakeups.load(std::memory_order_relaxed); }
+
+private:
+    struct Camera
+    {
+        V4L2Capture    *capture;
+        FrameCallback   on_frame;
+        bool            error_reported = false;
+    };
+
+    void dispatch(Camera &camera, uint32_t events);
+
+    int     epoll_fd;
+    int     wake_fd;        // eventfd waking run() up for stop()
+    std::vector<std::unique_ptr<Camera>> cameras;   // the epoll events point at the entries
+    std::mutex              mtx;                    // guards cameras
+    std::atomic<bool>       stopping;
+    std::atomic<uint64_t>   idle_wakeups;
+};
+#endif  // CAPTURE_REACTOR_H
@@ -0,0 +1,239 @@
+#include "decode_pool.h"
+#include <algorithm>
+
+DecodePool::DecodePool(unsigned int worker_count/* = 0 */, unsigned int max_stripes/* = 0 */)
+{
+    if(worker_count == 0)
+    {
+        // keep one core for the render thread, but always decode two cameras in parallel
+        unsigned int cores = std::thread::hardware_concurrency();
+        worker_count = std::max(2u, cores > 1 ? cores - 1 : 1u);
+    }
+
+    this->max_stripes = max_stripes == 0 ? worker_count : max_stripes;
+
+    decoders.reserve(worker_count);
+    stripes.reserve(worker_count);
+    workers.reserve(worker_count);
+    for(unsigned int i = 0; i < worker_count; i++)
+    {
+        decoders.emplace_back(new MjpegDecoder());
+        stripes.emplace_back(new MjpegStripes());
+    }
+    for(unsigned int i = 0; i < worker_count; i++)
+        workers.emplace_back(&DecodePool::workerLoop, this, i);
+}
+
+DecodePool::~DecodePool()
+{
+    stop();
+}
+
+int DecodePool::addSource(DoneCallback done)
+{
+    std::lock_guard<std::mutex> lck(mtx);
+    std::unique_ptr<Source> source(new Source());
+    source->done = std::move(done);
+    sources.push_back(std::move(source));
+    return static_cast<int>(sources.size()) - 1;
+}
+
+void DecodePool::submit(int source_id, FramePtr frame, long dequeue_us/* = 0 */)
+{
+    FramePtr dropped;
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        if(stopping || source_id < 0 || source_id >= static_cast<int>(sources.size()))
+            return;
+
+        Source &source = *sources[source_id];
+        source.stats.submitted++;
+        source.stats.dequeue_us_sum += static_cast<uint64_t>(std::max(0L, dequeue_us));
+        if(source.pending)
+        {
+            // the older frame was never picked up, only the newest one is worth decoding
+            source.stats.dropped++;
+            dropped = std::move(source.pending);
+        }
+        source.pending = std::move(frame);
+        source.pending_since = Clock::now();
+    }
+    cv_work.notify_one();
+    // the dropped frame re-queues its V4L2 buffer here, outside of the lock
+}
+
+DecodePool::SourceStats DecodePool::stats(int source_id) const
+{
+    std::lock_guard<std::mutex> lck(mtx);
+    if(source_id < 0 || source_id >= static_cast<int>(sources.size()))
+        return SourceStats();
+
+    const Source &source = *sources[source_id];
+    SourceStats stats = source.stats;
+    stats.pending = source.pending ? 1 : 0;
+    stats.decoding = source.busy ? 1 : 0;
+    return stats;
+}
+
+void DecodePool::stop()
+{
+    std::vector<FramePtr> dropped;
+    {
+        std::lock_guard<std::mutex> lck(mtx);
+        if(stopping)
+            return;
+        stopping = true;
+        for(auto &source : sources)
+        {
+            if(source->pending)
+                dropped.push_back(std::move(source->pending));
+        }
+    }
+    cv_work.notify_all();
+
+    for(auto &worker : workers)
+    {
+        if(worker.joinable())
+            worker.join();
+    }
+}
+
+int DecodePool::nextReadySource()
+{
+    const size_t N = sources.size();
+    for(size_t i = 0; i < N; i++)
+    {
+        size_t index = (next_source + i) % N;
+        if(sources[index]->pending && !sources[index]->busy)
+        {
+            next_source = index + 1;
+            return static_cast<int>(index);
+        }
+    }
+    return -1;
+}
+
+bool DecodePool::decodeStripe(std::unique_lock<std::mutex> &lck, MjpegDecoder &decoder, StripeJob *job/* = nullptr */)
+{
+    if(job == nullptr)
+    {
+        if(stripe_jobs.empty())
+            return false;
+        job = stripe_jobs.front();
+    }
+    if(job->next >= job->stripes->count())
+        return false;
+
+    unsigned int index = job->next++;
+    if(job->next == job->stripes->count())
+        stripe_jobs.erase(std::find(stripe_jobs.begin(), stripe_jobs.end(), job));
+
+    lck.unlock();
+    V4L2Capture::Frame &frame = *job->frame;
+    bool success = decoder.decodeStripe(*job->stripes, index, frame.data(), frame.width(), frame.pitch(), frame.format());
+    lck.lock();
+
+    if(!success)
+        job->failed = true;
+    if(++job->done == job->stripes->count())
+        cv_stripe_done.notify_all();
+    return true;
+}
+
+bool DecodePool::decodeFrame(unsigned int worker_index, V4L2Capture::Frame &frame, bool &sliced)
+{
+    MjpegDecoder &decoder = *decoders[worker_index];
+    MjpegStripes &layout = *stripes[worker_index];
+
+    sliced = layout.split(frame.compressed(), frame.compressedSize(), frame.width(), frame.height(), max_stripes);
+    if(!sliced)
+    {
+        // no restart markers to cut at, decode in one piece
+        return decoder.decodeMJPEG(frame.compressed(), frame.compressedSize(),
+                                   frame.data(), frame.width(), frame.height(), frame.pitch(), frame.format());
+    }
+
+    StripeJob job;
+    job.stripes = &layout;
+    job.frame = &frame;
+
+    std::unique_lock<std::mutex> lck(mtx);
+    stripe_jobs.push_back(&job);
+    lck.unlock();
+    cv_work.notify_all();
+    lck.lock();
+
+    // decode the stripes nobody helped with, then wait for the helpers still busy
+    while(decodeStripe(lck, decoder, &job))
+        ;
+    cv_stripe_done.wait(lck, [&job]() { return job.done == job.stripes->count(); });
+    return !job.failed;
+}
+
+void DecodePool::workerLoop(unsigned int worker_index)
+{
+    MjpegDecoder &decoder = *decoders[worker_index];
+
+    while(true)
+    {
+        int source_id = -1;
+        FramePtr frame;
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            cv_work.wait(lck, [this, &source_id]() {
+                if(stopping || !stripe_jobs.empty())
+                    return true;
+                source_id = nextReadySource();
+                return source_id >= 0;
+            });
+
+            // finish the frames already started before picking up a new one
+            if(decodeStripe(lck, decoder))
+                continue;
+            if(stopping)
+                break;
+
+            Source &source = *sources[source_id];
+            frame = std::move(source.pending);
+            source.busy = true;
+            source.stats.queue_us_sum += std::chrono::duration_cast<std::chrono::microseconds>(
+                        Clock::now() - source.pending_since).count();
+        }
+
+        auto decode_start = Clock::now();
+        frame->timing().decode_start_us = monotonicUs(decode_start);
+        bool sliced = false;
+        bool success = decodeFrame(worker_index, *frame, sliced);
+        auto decode_end = Clock::now();
+        frame->timing().decode_end_us = monotonicUs(decode_end);
+        uint64_t decode_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    decode_end - decode_start).count();
+
+        DoneCallback done;
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            Source &source = *sources[source_id];
+            if(success)
+                source.stats.decoded++;
+            else
+                source.stats.failed++;
+            if(sliced)
+                source.stats.sliced++;
+            source.stats.decode_us_sum += decode_us;
+            source.stats.decode_us_max = std::max(source.stats.decode_us_max, decode_us);
+            done = source.done;
+        }
+
+        if(done)
+            done(std::move(frame), success);
+        frame.reset();
+
+        {
+            // the source may only take its next frame once this one is published, so frames of
+            // one camera are always delivered in order
+            std::lock_guard<std::mutex> lck(mtx);
+            sources[source_id]->busy = false;
+        }
+        cv_work.notify_one();
+    }
+}
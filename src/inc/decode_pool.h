@@ -0,0 +1,121 @@
+#ifndef DECODE_POOL_H
+#define DECODE_POOL_H
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include "v4l2_capture.h"
+#include "mjpeg_decoder.h"
+
+
+/** @brief A fixed pool of decode workers shared by all cameras.
+ * Each worker owns a persistent MjpegDecoder. The capture threads only dequeue raw frames and
+ * submit them, so decoding frame N overlaps waiting on select() for frame N+1.
+ * Every camera (source) has at most one frame being decoded and one frame pending; a pending
+ * frame that has not been picked up yet is replaced by a newer one and its V4L2 buffer is
+ * re-queued, so a slow decode never builds up latency and one camera cannot starve another.
+ * Frames with restart markers are cut into stripes (see MjpegStripes): the worker owning the frame
+ * publishes the stripes, idle workers help decoding them before picking up new frames, and the
+ * owner decodes the rest itself, so the decode latency of one frame shrinks with the core count.
+ */
+class DecodePool
+{
+public:
+    /** @brief Called on the worker thread once a frame of the source is decoded (or failed) */
+    using DoneCallback = std::function<void(FramePtr frame, bool success)>;
+
+    /** @brief Counters of one source, sums are in microseconds */
+    struct SourceStats
+    {
+        uint32_t pending = 0;           // frames waiting for a worker (queue depth, 0 or 1)
+        uint32_t decoding = 0;          // frames being decoded (0 or 1)
+        uint64_t submitted = 0;
+        uint64_t decoded = 0;
+        uint64_t failed = 0;
+        uint64_t dropped = 0;           // pending frames replaced by a newer one
+        uint64_t sliced = 0;            // frames decoded in stripes on several workers
+        uint64_t dequeue_us_sum = 0;    // time spent in select() + VIDIOC_DQBUF
+        uint64_t queue_us_sum = 0;      // time between submit and pick-up by a worker
+        uint64_t decode_us_sum = 0;
+        uint64_t decode_us_max = 0;
+    };
+
+    /** @param worker_count number of decode threads, 0 picks one per core minus one (at least 2)
+     * @param max_stripes  upper bound of the stripes of one frame, 0 for the worker count, 1 to
+     *                     always decode a frame in one piece
+     */
+    explicit DecodePool(unsigned int worker_count = 0, unsigned int max_stripes = 0);
+    ~DecodePool();
+
+    DecodePool(const DecodePool&) = delete;
+    DecodePool& operator=(const DecodePool&) = delete;
+
+    /** @brief Register a camera
+     * @return the source id to submit frames with
+     */
+    int addSource(DoneCallback done);
+
+    /** @brief Hand a raw (not decoded) frame of the source to the pool
+     * @param dequeue_us time the capture thread spent dequeuing the frame
+     */
+    void submit(int source, FramePtr frame, long dequeue_us = 0);
+
+    SourceStats stats(int source) const;
+
+    unsigned int workerCount() const { return static_cast<unsigned int>(workers.size()); }
+
+    /** @brief Stop the workers, pending frames are dropped and their buffers re-queued */
+    void stop();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Source
+    {
+        DoneCallback        done;
+        FramePtr            pending;
+        Clock::time_point   pending_since;
+        bool                busy = false;
+        SourceStats         stats;
+    };
+
+    /** @brief The stripes of a frame being decoded by several workers */
+    struct StripeJob
+    {
+        const MjpegStripes *stripes;
+        V4L2Capture::Frame *frame;
+        unsigned int        next = 0;       // next stripe to claim
+        unsigned int        done = 0;
+        bool                failed = false;
+    };
+
+    void workerLoop(unsigned int worker_index);
+
+    /** @brief Claim and decode one stripe of a published frame (lck must own mtx)
+     * @return false if no stripe is left to claim
+     */
+    bool decodeStripe(std::unique_lock<std::mutex> &lck, MjpegDecoder &decoder, StripeJob *job = nullptr);
+
+    /** @brief Decode a frame, in stripes if possible (called without mtx) */
+    bool decodeFrame(unsigned int worker_index, V4L2Capture::Frame &frame, bool &sliced);
+
+    /** @brief Pick the next source with a pending frame, round robin (mtx must be held) */
+    int nextReadySource();
+
+    std::vector<std::unique_ptr<Source>>        sources;
+    std::vector<std::unique_ptr<MjpegDecoder>>  decoders;   // one persistent decoder per worker
+    std::vector<std::unique_ptr<MjpegStripes>>  stripes;    // stripe layout of the frame of each worker
+    std::vector<std::thread>                    workers;
+    std::vector<StripeJob*>     stripe_jobs;    // frames with stripes nobody claimed yet
+    unsigned int                max_stripes;
+    mutable std::mutex          mtx;
+    std::condition_variable     cv_work;
+    std::condition_variable     cv_stripe_done;
+    size_t                      next_source = 0;
+    bool                        stopping = false;
+};
+#endif  // DECODE_POOL_H
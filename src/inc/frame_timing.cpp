@@ -0,0 +1,127 @@
+#include "frame_timing.h"
+#include <time.h>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+
+uint64_t monotonicNowUs()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+uint64_t monotonicUs(std::chrono::steady_clock::time_point time_point)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time_point.time_since_epoch()).count();
+}
+
+void sleepUntilUs(uint64_t deadline_us, uint64_t spin_us/* = 200 */)
+{
+    if(deadline_us > spin_us)
+    {
+        uint64_t wake_us = deadline_us - spin_us;
+        timespec wake;
+        wake.tv_sec = static_cast<time_t>(wake_us / 1000000);
+        wake.tv_nsec = static_cast<long>(wake_us % 1000000) * 1000;
+        while(monotonicNowUs() < wake_us &&
+              clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR)
+            ;
+    }
+    while(monotonicNowUs() < deadline_us)
+        ;
+}
+
+LatencyRecorder::LatencyRecorder(size_t window/* = 1024 */)
+    : window(window > 0 ? window : 1)
+{
+    for(Ring &ring : rings)
+        ring.samples.reserve(this->window);
+}
+
+void LatencyRecorder::record(const FrameTiming &timing)
+{
+    add(CAPTURE_TO_DEQUEUE, timing.capture_us, timing.dequeue_us);
+    add(DEQUEUE_TO_DECODE, timing.dequeue_us, timing.decode_start_us);
+    add(DECODE, timing.decode_start_us, timing.decode_end_us);
+    add(DECODE_TO_STAGING, timing.decode_end_us, timing.staging_write_us);
+    add(STAGING_TO_SUBMIT, timing.staging_write_us, timing.submit_us);
+    add(SUBMIT_TO_PRESENT, timing.submit_us, timing.present_us);
+    add(CAPTURE_TO_PRESENT, timing.capture_us, timing.present_us);
+}
+
+void LatencyRecorder::recordShown(uint64_t capture_us, uint64_t present_us, bool fresh)
+{
+    shown++;
+    if(!fresh)
+        repeated++;
+    add(SHOWN_AGE, capture_us, present_us);
+}
+
+void LatencyRecorder::add(Stage stage, uint64_t begin_us, uint64_t end_us)
+{
+    if(begin_us == 0 || end_us == 0 || end_us < begin_us)
+        return;
+
+    Ring &ring = rings[stage];
+    if(!ring.full)
+    {
+        ring.samples.push_back(end_us - begin_us);
+        ring.full = ring.samples.size() == window;
+        return;
+    }
+    ring.samples[ring.next] = end_us - begin_us;
+    ring.next = (ring.next + 1) % window;
+}
+
+LatencyRecorder::Percentiles LatencyRecorder::percentiles(Stage stage) const
+{
+    Percentiles result;
+    const Ring &ring = rings[stage];
+    if(ring.samples.empty())
+        return result;
+
+    std::vector<uint64_t> sorted(ring.samples);
+    std::sort(sorted.begin(), sorted.end());
+    auto at = [&sorted](double q) {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()))];
+    };
+    result.count = sorted.size();
+    result.p50 = at(0.50);
+    result.p90 = at(0.90);
+    result.p99 = at(0.99);
+    result.max = sorted.back();
+    return result;
+}
+
+const char* LatencyRecorder::stageName(Stage stage)
+{
+    switch(stage)
+    {
+    case CAPTURE_TO_DEQUEUE:    return "capture->dequeue";
+    case DEQUEUE_TO_DECODE:     return "dequeue->decode";
+    case DECODE:                return "decode";
+    case DECODE_TO_STAGING:     return "decode->staging";
+    case STAGING_TO_SUBMIT:     return "staging->submit";
+    case SUBMIT_TO_PRESENT:     return "submit->present";
+    case CAPTURE_TO_PRESENT:    return "capture->present";
+    case SHOWN_AGE:             return "shown age";
+    default:                    return "?";
+    }
+}
+
+void LatencyRecorder::print(const char *name) const
+{
+    for(int i = 0; i < STAGE_COUNT; i++)
+    {
+        Stage stage = static_cast<Stage>(i);
+        Percentiles p = percentiles(stage);
+        if(p.count == 0)
+            continue;
+        printf("LATENCY[%s] %-17s n=%lu p50=%lu us p90=%lu us p99=%lu us max=%lu us\n",
+               name, stageName(stage), p.count, p.p50, p.p90, p.p99, p.max);
+    }
+    if(shown > 0)
+        printf("STALENESS[%s] shown=%lu repeated=%lu (%.1f%%)\n",
+               name, shown, repeated, 100.0 * repeated / shown);
+}
@@ -0,0 +1,108 @@
+#ifndef FRAME_TIMING_H
+#define FRAME_TIMING_H
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <vector>
+
+
+/** @brief Timing record travelling with a frame from the V4L2 buffer to the present.
+ * All times are microseconds on CLOCK_MONOTONIC, the clock uvcvideo stamps the buffers with,
+ * so they can be subtracted from each other directly. 0 means the stage was not reached or is
+ * not known (e.g. the driver timestamp is not monotonic).
+ */
+struct FrameTiming
+{
+    uint64_t capture_us = 0;        // v4l2_buffer.timestamp
+    uint32_t sequence = 0;          // v4l2_buffer.sequence
+    uint64_t dequeue_us = 0;        // VIDIOC_DQBUF returned
+    uint64_t decode_start_us = 0;
+    uint64_t decode_end_us = 0;
+    uint64_t staging_write_us = 0;  // pixels written to the upload (staging) memory
+    uint64_t submit_us = 0;         // command buffer submitted
+    uint64_t present_us = 0;        // present call returned
+};
+
+/** @brief Now on CLOCK_MONOTONIC in microseconds */
+uint64_t monotonicNowUs();
+
+/** @brief Convert a steady_clock time point (CLOCK_MONOTONIC on Linux) to microseconds */
+uint64_t monotonicUs(std::chrono::steady_clock::time_point time_point);
+
+/** @brief Sleep until deadline_us on CLOCK_MONOTONIC
+ * clock_nanosleep() to an absolute time spin_us before the deadline, so the time spent before the
+ * call does not add up, then the last part (timer slack and wake-up latency) is spun on the clock.
+ */
+void sleepUntilUs(uint64_t deadline_us, uint64_t spin_us = 200);
+
+
+/** @brief Latency percentiles of the pipeline stages over the last frames.
+ * Not thread-safe, record and query from the render thread.
+ */
+class LatencyRecorder
+{
+public:
+    enum Stage
+    {
+        CAPTURE_TO_DEQUEUE = 0,
+        DEQUEUE_TO_DECODE,      // waiting in the decode queue
+        DECODE,
+        DECODE_TO_STAGING,      // waiting for the renderer and writing the staging memory
+        STAGING_TO_SUBMIT,
+        SUBMIT_TO_PRESENT,
+        CAPTURE_TO_PRESENT,     // software estimate of glass-to-glass minus the display
+        SHOWN_AGE,              // capture to present of the image shown, repeated images included
+        STAGE_COUNT
+    };
+
+    struct Percentiles
+    {
+        uint64_t count = 0;     // samples in the window
+        uint64_t p50 = 0;
+        uint64_t p90 = 0;
+        uint64_t p99 = 0;
+        uint64_t max = 0;
+    };
+
+    /** @param window number of frames the percentiles are computed over */
+    explicit LatencyRecorder(size_t window = 1024);
+
+    /** @brief Add the stages of a presented frame, stages with a missing end are skipped */
+    void record(const FrameTiming &timing);
+
+    /** @brief Account a present that showed this stream
+     * A redraw triggered by another stream shows the image already resident in the texture again
+     * (fresh == false). Its age goes into SHOWN_AGE like the age of a fresh image, so SHOWN_AGE
+     * is the staleness of the stream as seen on screen, while CAPTURE_TO_PRESENT only covers the
+     * fresh images.
+     * @param capture_us capture time of the shown image (FrameTiming::capture_us)
+     */
+    void recordShown(uint64_t capture_us, uint64_t present_us, bool fresh);
+
+    /** @brief Presents that showed this stream, and those that repeated the previous image */
+    uint64_t shownCount() const { return shown; }
+    uint64_t repeatedCount() const { return repeated; }
+
+    Percentiles percentiles(Stage stage) const;
+
+    static const char* stageName(Stage stage);
+
+    /** @brief Print the percentiles of every stage with samples */
+    void print(const char *name) const;
+
+private:
+    struct Ring
+    {
+        std::vector<uint64_t>   samples;
+        size_t                  next = 0;
+        bool                    full = false;
+    };
+
+    void add(Stage stage, uint64_t begin_us, uint64_t end_us);
+
+    size_t  window;
+    Ring    rings[STAGE_COUNT];
+    uint64_t shown = 0;
+    uint64_t repeated = 0;
+};
+#endif  // FRAME_TIMING_H
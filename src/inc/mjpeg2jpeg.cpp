@@ -1,7 +1,6 @@
 #include "mjpeg2jpeg.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
 
 namespace
 {
@@ -52,31 +51,53 @@ namespace
 }
 
 
-bool mjpeg2jpeg(const byte *in, const unsigned int in_size, byte *out, unsigned int out_limit_size, unsigned int *out_size)
+bool mjpegHasDHT(const byte *in, unsigned int in_size)
 {
-    unsigned int ptr, size;
-
-    // allocate enough memory for the out buffer
-    size = static_cast<unsigned int>(in_size) + sizeof(jpgHdr) + sizeof(JPGDHTSeg);
-    if(size > out_limit_size)
-        return false;
-
-    *out_size = size;
+    // walk the marker segments of the header, the entropy-coded data starts after SOS
+    unsigned int ptr = 2;   // skip SOI
+    while(ptr + 4 <= in_size)
+    {
+        if(in[ptr] != 0xFF)
+            return false;   // not a marker, the header is corrupt
 
-    // write the header
-    memcpy( out, jpgHdr, sizeof(jpgHdr) );
-    ptr = sizeof(jpgHdr);
+        byte marker = in[ptr + 1];
+        if(marker == 0xFF)
+        {
+            // fill byte before the marker
+            ptr++;
+            continue;
+        }
+        if(marker == 0xC4)  // DHT
+            return true;
+        if(marker == 0xDA || marker == 0xD9)    // SOS / EOI
+            return false;
+        if(marker == 0x01 || marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7))
+        {
+            // stand-alone markers without length
+            ptr += 2;
+            continue;
+        }
 
-    // write the Huffman table
-    memcpy( out + ptr, JPGDHTSeg, sizeof(JPGDHTSeg) );
-    ptr += sizeof(JPGDHTSeg);
+        unsigned int length = (static_cast<unsigned int>(in[ptr + 2]) << 8) | in[ptr + 3];
+        ptr += 2 + length;
+    }
+    return false;
+}
 
+unsigned int mjpeg2jpegChunks(const byte *in, unsigned int in_size, JpegChunk *chunks)
+{
     // remove the existing header, which is a corrupt of of 0xffd8 0xffd8
-    unsigned int offset = 2;
+    const unsigned int offset = 2;
+    if(in_size <= offset)
+        return 0;
 
-    // write the data
-    memcpy( out + ptr, in + offset, in_size - offset );
+    unsigned int count = 0;
+    chunks[count++] = JpegChunk{ jpgHdr, sizeof(jpgHdr) };
 
-    return true;
-}
+    // the Huffman table is only injected when the camera omits it
+    if(!mjpegHasDHT(in, in_size))
+        chunks[count++] = JpegChunk{ JPGDHTSeg, sizeof(JPGDHTSeg) };
 
+    chunks[count++] = JpegChunk{ in + offset, in_size - offset };
+    return count;
+}
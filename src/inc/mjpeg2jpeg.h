@@ -3,6 +3,23 @@
 
 using byte = unsigned char;
 
-bool mjpeg2jpeg(const byte *in, const unsigned int in_size, byte *out, unsigned int out_limit_size, unsigned int *out_size);
+/* A piece of a JPEG stream. The pieces of a frame are fed to the decoder back to back without being
+   joined into one buffer. */
+struct JpegChunk
+{
+    const byte  *data;
+    unsigned int size;
+};
+
+/* The most chunks mjpeg2jpegChunks() produces for one frame */
+constexpr unsigned int MJPEG_MAX_CHUNKS = 3;
+
+/* Check whether the MJPEG frame carries its own Huffman tables (a DHT segment before SOS) */
+bool mjpegHasDHT(const byte *in, unsigned int in_size);
+
+/* Describe the MJPEG frame as a complete JPEG stream without copying it: the JFIF header, the
+   standard DHT segment (only if the camera omits it) and the frame data after its SOI.
+   Returns the number of chunks written into chunks (at most MJPEG_MAX_CHUNKS), 0 on failure. */
+unsigned int mjpeg2jpegChunks(const byte *in, unsigned int in_size, JpegChunk *chunks);
 
 #endif // MJPEG2JPEG_H
@@ -0,0 +1,506 @@
+#include "mjpeg_decoder.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <csetjmp>
+#include <jpeglib.h>
+#include <jerror.h>
+#include <algorithm>
+
+namespace
+{
+    /* libjpeg reports fatal errors through error_exit(), which must not return */
+    struct ErrorManager
+    {
+        jpeg_error_mgr  pub;
+        jmp_buf         setjmp_buffer;
+    };
+
+    void errorExit(j_common_ptr cinfo)
+    {
+        ErrorManager *err = reinterpret_cast<ErrorManager*>(cinfo->err);
+        longjmp(err->setjmp_buffer, 1);
+    }
+
+    void outputMessage(j_common_ptr /*cinfo*/)
+    {
+        // UVC cameras often pad the frames, do not print a warning for every frame
+    }
+
+    /* Source manager walking through the chunks of a frame one after another */
+    struct ChunkSource
+    {
+        jpeg_source_mgr     pub;
+        const JpegChunk    *chunks;
+        unsigned int        chunk_count;
+        unsigned int        next_chunk;
+    };
+
+    const JOCTET fake_eoi[2] = { 0xFF, JPEG_EOI };
+
+    /* Output colorspace writing the format, false if the libjpeg build can not */
+    bool outputColorSpace(PixelFormat format, J_COLOR_SPACE &color_space)
+    {
+        switch(format)
+        {
+        case PixelFormat::RGB:
+            color_space = JCS_RGB;
+            return true;
+        case PixelFormat::YUV422P:
+            color_space = JCS_YCbCr;
+            return true;
+#ifdef JCS_EXTENSIONS
+        // the alpha variants set the 4th byte to 0xFF, the X variants leave it undefined
+        case PixelFormat::RGBX:
+            color_space = JCS_EXT_RGBA;
+            return true;
+        case PixelFormat::BGRX:
+            color_space = JCS_EXT_BGRA;
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    // rows handed to jpeg_read_scanlines() at once, covers a full MCU row of any sampling
+    const unsigned int MAX_ROWS_PER_READ = 16;
+
+    /* The planar output takes YCbCr 4:2:2 (h2v1) and 4:2:0 (h2v2), the samplings of UVC cameras */
+    bool planarSampling(const jpeg_decompress_struct *cinfo)
+    {
+        if(cinfo->num_components != 3 || cinfo->jpeg_color_space != JCS_YCbCr)
+            return false;
+        const jpeg_component_info *comp = cinfo->comp_info;
+        return comp[0].h_samp_factor == 2 && (comp[0].v_samp_factor == 1 || comp[0].v_samp_factor == 2) &&
+               comp[1].h_samp_factor == 1 && comp[1].v_samp_factor == 1 &&
+               comp[2].h_samp_factor == 1 && comp[2].v_samp_factor == 1;
+    }
+
+    /* Read the planes of a started raw decompression into rows first_row.. of a YUV422P frame.
+     * jpeg_read_raw_data() returns whole iMCU rows, the rows past the image land in scratch. */
+    void readPlanes(jpeg_decompress_struct *cinfo, unsigned char *dst, unsigned int pitch,
+                    unsigned int first_row, unsigned int frame_height, JSAMPLE *scratch)
+    {
+        const unsigned int rows = cinfo->output_height;
+        const unsigned int chroma_pitch = pitch / 2;
+        unsigned char *planes[3];
+        for(unsigned int i = 0; i < 3; i++)
+            planes[i] = dst + planeOffset(pitch, frame_height, i);
+
+        const unsigned int v_max = cinfo->max_v_samp_factor;    // 1 for 4:2:2, 2 for 4:2:0
+        const unsigned int imcu_rows = v_max * DCTSIZE;
+        JSAMPROW y_rows[2 * DCTSIZE];
+        JSAMPROW cb_rows[DCTSIZE];
+        JSAMPROW cr_rows[DCTSIZE];
+        JSAMPARRAY image[3] = { y_rows, cb_rows, cr_rows };
+        while(cinfo->output_scanline < rows)
+        {
+            const unsigned int y0 = cinfo->output_scanline;
+            for(unsigned int i = 0; i < imcu_rows; i++)
+            {
+                y_rows[i] = y0 + i < rows ? planes[0] + static_cast<size_t>(first_row + y0 + i) * pitch : scratch;
+            }
+            for(unsigned int j = 0; j < DCTSIZE; j++)
+            {
+                const unsigned int row = y0 + j * v_max;        // first luma row the chroma row covers
+                const size_t offset = static_cast<size_t>(first_row + row) * chroma_pitch;
+                cb_rows[j] = row < rows ? planes[1] + offset : scratch;
+                cr_rows[j] = row < rows ? planes[2] + offset : scratch;
+            }
+            jpeg_read_raw_data(cinfo, image, imcu_rows);
+
+            // 4:2:0 chroma rows cover two luma rows, double them to get 4:2:2 planes
+            for(unsigned int j = 0; v_max == 2 && j < DCTSIZE; j++)
+            {
+                if(y0 + 2 * j + 1 >= rows)
+                    break;
+                memcpy(cb_rows[j] + chroma_pitch, cb_rows[j], chroma_pitch);
+                memcpy(cr_rows[j] + chroma_pitch, cr_rows[j], chroma_pitch);
+            }
+        }
+    }
+
+    void initSource(j_decompress_ptr /*cinfo*/)
+    {
+    }
+
+    boolean fillInputBuffer(j_decompress_ptr cinfo)
+    {
+        ChunkSource *src = reinterpret_cast<ChunkSource*>(cinfo->src);
+        while(src->next_chunk < src->chunk_count)
+        {
+            const JpegChunk &chunk = src->chunks[src->next_chunk++];
+            if(chunk.size == 0)
+                continue;
+            src->pub.next_input_byte = chunk.data;
+            src->pub.bytes_in_buffer = chunk.size;
+            return TRUE;
+        }
+
+        // the frame is truncated, terminate it like jpeg_mem_src() does
+        WARNMS(cinfo, JWRN_JPEG_EOF);
+        src->pub.next_input_byte = fake_eoi;
+        src->pub.bytes_in_buffer = sizeof(fake_eoi);
+        return TRUE;
+    }
+
+    void skipInputData(j_decompress_ptr cinfo, long num_bytes)
+    {
+        ChunkSource *src = reinterpret_cast<ChunkSource*>(cinfo->src);
+        if(num_bytes <= 0)
+            return;
+        while(num_bytes > static_cast<long>(src->pub.bytes_in_buffer))
+        {
+            num_bytes -= static_cast<long>(src->pub.bytes_in_buffer);
+            fillInputBuffer(cinfo);
+        }
+        src->pub.next_input_byte += num_bytes;
+        src->pub.bytes_in_buffer -= num_bytes;
+    }
+
+    void termSource(j_decompress_ptr /*cinfo*/)
+    {
+    }
+
+    const byte eoi[2] = { 0xFF, JPEG_EOI };
+
+    inline unsigned int readU16(const byte *p)
+    {
+        return (static_cast<unsigned int>(p[0]) << 8) | p[1];
+    }
+
+    /* What the stripes need to know about the frame header */
+    struct FrameHeader
+    {
+        unsigned int sof_height_offset = 0;     // offset of the height field of SOF from the SOI
+        unsigned int scan_offset = 0;           // offset of the entropy-coded data from the SOI
+        unsigned int mcu_width = 0;
+        unsigned int mcu_height = 0;
+        unsigned int restart_interval = 0;      // in MCUs
+    };
+
+    /* Walk the markers up to the (single, baseline) scan */
+    bool parseFrameHeader(const byte *in, unsigned int in_size, FrameHeader &hdr)
+    {
+        unsigned int components = 0;
+        unsigned int pos = 2;
+        while(pos + 4 <= in_size)
+        {
+            if(in[pos] != 0xFF)
+                return false;
+            byte marker = in[pos + 1];
+            if(marker == 0xFF)
+            {
+                pos++;                          // fill byte
+                continue;
+            }
+            if(marker == JPEG_EOI || (marker >= 0xD0 && marker <= 0xD7))
+                return false;
+            unsigned int length = readU16(in + pos + 2);
+            if(length < 2 || pos + 2 + length > in_size)
+                return false;
+            const byte *seg = in + pos + 4;
+
+            switch(marker)
+            {
+            case 0xC0: case 0xC1:               // baseline / extended sequential Huffman
+            {
+                if(length < 8)
+                    return false;
+                components = seg[5];
+                if(components == 0 || length < 8 + 3 * components)
+                    return false;
+                unsigned int h_max = 1, v_max = 1;
+                for(unsigned int i = 0; i < components; i++)
+                {
+                    unsigned int sampling = seg[6 + 3 * i + 1];
+                    h_max = std::max(h_max, sampling >> 4);
+                    v_max = std::max(v_max, sampling & 0x0F);
+                }
+                // a single-component scan is not interleaved, its MCU is one block
+                hdr.mcu_width = components == 1 ? 8 : 8 * h_max;
+                hdr.mcu_height = components == 1 ? 8 : 8 * v_max;
+                hdr.sof_height_offset = pos + 5;
+                break;
+            }
+            case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+            case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+                return false;                   // progressive, lossless or arithmetic
+            case 0xDD:
+                if(length < 4)
+                    return false;
+                hdr.restart_interval = readU16(seg);
+                break;
+            case 0xDA:
+                // the whole image must be in this scan
+                if(hdr.mcu_width == 0 || seg[0] != components)
+                    return false;
+                hdr.scan_offset = pos + 2 + length;
+                return hdr.restart_interval > 0;
+            default:
+                break;
+            }
+            pos += 2 + length;
+        }
+        return false;
+    }
+}
+
+struct MjpegDecoder::Context
+{
+    jpeg_decompress_struct  cinfo;
+    ErrorManager            jerr;
+    ChunkSource             source;
+    std::vector<JSAMPLE>    scratch;    // planar output: destination of the rows past the image
+};
+
+MjpegDecoder::MjpegDecoder()
+    : ctx(new Context())
+{
+    ctx->cinfo.err = jpeg_std_error(&ctx->jerr.pub);
+    ctx->jerr.pub.error_exit = errorExit;
+    ctx->jerr.pub.output_message = outputMessage;
+    jpeg_create_decompress(&ctx->cinfo);
+
+    ctx->source.pub.init_source = initSource;
+    ctx->source.pub.fill_input_buffer = fillInputBuffer;
+    ctx->source.pub.skip_input_data = skipInputData;
+    ctx->source.pub.resync_to_restart = jpeg_resync_to_restart;
+    ctx->source.pub.term_source = termSource;
+    ctx->cinfo.src = &ctx->source.pub;
+}
+
+MjpegDecoder::~MjpegDecoder()
+{
+    jpeg_destroy_decompress(&ctx->cinfo);
+}
+
+bool MjpegDecoder::supports(PixelFormat format)
+{
+    J_COLOR_SPACE color_space;
+    return outputColorSpace(format, color_space);
+}
+
+bool MjpegDecoder::decodeMJPEG(const byte *in, uint in_size, uchar *dst, uint width, uint height, uint pitch,
+                               PixelFormat format/* = PixelFormat::RGB */)
+{
+    JpegChunk chunks[MJPEG_MAX_CHUNKS];
+    uint chunk_count = mjpeg2jpegChunks(in, in_size, chunks);
+    if(chunk_count == 0)
+        return false;
+    return decode(chunks, chunk_count, dst, width, height, pitch, format);
+}
+
+bool MjpegDecoder::decode(const JpegChunk *chunks, uint chunk_count, uchar *dst, uint width, uint height, uint pitch,
+                          PixelFormat format/* = PixelFormat::RGB */)
+{
+    return decodeRows(chunks, chunk_count, dst, width, height, pitch, format, 0, height);
+}
+
+bool MjpegDecoder::decodeRows(const JpegChunk *chunks, uint chunk_count, uchar *dst, uint width, uint height,
+                              uint pitch, PixelFormat format, uint first_row, uint frame_height)
+{
+    jpeg_decompress_struct *cinfo = &ctx->cinfo;
+
+    J_COLOR_SPACE color_space;
+    if(!outputColorSpace(format, color_space) || pitch < width * bytesPerPixel(format))
+        return false;
+
+    // the raw planes are written in whole DCT blocks, the padding to the MCU width must fit the rows
+    const bool planar = format == PixelFormat::YUV422P;
+    if(planar && (pitch % 2 != 0 || pitch < planarPitch(width)))
+        return false;
+    if(planar && ctx->scratch.size() < pitch)
+        ctx->scratch.resize(pitch);
+
+    ctx->source.chunks = chunks;
+    ctx->source.chunk_count = chunk_count;
+    ctx->source.next_chunk = 0;
+    ctx->source.pub.next_input_byte = nullptr;
+    ctx->source.pub.bytes_in_buffer = 0;
+
+    if(setjmp(ctx->jerr.setjmp_buffer))
+    {
+        // keep the context for the next frame, only drop the state of this one
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    jpeg_read_header(cinfo, TRUE);
+
+    // the destination is sized for the negotiated format, never decode a bigger image into it
+    if(cinfo->image_width != width || cinfo->image_height != height)
+    {
+        jpeg_abort_decompress(cinfo);
+        return false;
+    }
+
+    if(planar)
+    {
+        // the planes are handed out before upsampling and color conversion, the shader does both
+        if(!planarSampling(cinfo))
+        {
+            jpeg_abort_decompress(cinfo);
+            return false;
+        }
+        cinfo->raw_data_out = TRUE;
+        cinfo->dct_method = JDCT_IFAST;
+
+        jpeg_start_decompress(cinfo);
+        readPlanes(cinfo, dst, pitch, first_row, frame_height, ctx->scratch.data());
+        jpeg_finish_decompress(cinfo);
+        return true;
+    }
+
+    // same trade-off as TJFLAG_FASTDCT | TJFLAG_FASTUPSAMPLE
+    dst += static_cast<size_t>(first_row) * pitch;
+    cinfo->out_color_space = color_space;
+    cinfo->dct_method = JDCT_IFAST;
+    cinfo->do_fancy_upsampling = FALSE;
+
+    jpeg_start_decompress(cinfo);
+    JSAMPROW rows[MAX_ROWS_PER_READ];
+    while(cinfo->output_scanline < cinfo->output_height)
+    {
+        uint row_count = cinfo->output_height - cinfo->output_scanline;
+        if(row_count > MAX_ROWS_PER_READ)
+            row_count = MAX_ROWS_PER_READ;
+        for(uint i = 0; i < row_count; i++)
+            rows[i] = dst + static_cast<size_t>(cinfo->output_scanline + i) * pitch;
+        jpeg_read_scanlines(cinfo, rows, row_count);
+    }
+    jpeg_finish_decompress(cinfo);
+
+    return true;
+}
+
+bool MjpegDecoder::decodeStripe(const MjpegStripes &frame, uint index, uchar *dst, uint width, uint pitch,
+                                PixelFormat format/* = PixelFormat::RGB */)
+{
+    JpegChunk chunks[MJPEG_MAX_STRIPE_CHUNKS];
+    uint chunk_count = frame.chunks(index, chunks);
+    const MjpegStripes::Stripe &stripe = frame.stripe(index);
+    return decodeRows(chunks, chunk_count, dst, width, stripe.rows, pitch, format, stripe.first_row, frame.height());
+}
+
+bool MjpegStripes::split(const byte *in, uint in_size, uint width, uint height, uint max_stripes)
+{
+    stripes.clear();
+    frame_height = height;
+    if(max_stripes < 2)
+        return false;
+
+    JpegChunk frame_chunks[MJPEG_MAX_CHUNKS];
+    uint frame_chunk_count = mjpeg2jpegChunks(in, in_size, frame_chunks);
+    if(frame_chunk_count == 0)
+        return false;
+
+    FrameHeader hdr;
+    if(!parseFrameHeader(in, in_size, hdr))
+        return false;
+    if(readU16(in + hdr.sof_height_offset) != height || readU16(in + hdr.sof_height_offset + 2) != width)
+        return false;
+
+    const uint mcus_per_row = (width + hdr.mcu_width - 1) / hdr.mcu_width;
+    const uint mcu_rows = (height + hdr.mcu_height - 1) / hdr.mcu_height;
+
+    // Collect the restart markers a stripe can start after: every 8th marker (RST7, the decoder
+    // expects RST0 after the cut) that also ends on an MCU row.
+    cuts.clear();
+    const byte *scan = in + hdr.scan_offset;
+    const byte *end = in + in_size;
+    const byte *scan_end = end;
+    uint marker_count = 0;
+    for(const byte *p = scan; p + 1 < end; )
+    {
+        p = static_cast<const byte*>(memchr(p, 0xFF, end - p - 1));
+        if(p == nullptr)
+            break;
+        byte code = p[1];
+        if(code == 0x00 || code == 0xFF)
+        {
+            p += code == 0x00 ? 2 : 1;          // stuffed byte or fill byte
+            continue;
+        }
+        if(code < 0xD0 || code > 0xD7)
+        {
+            scan_end = p;                       // EOI (or garbage), end of the scan
+            break;
+        }
+        if(code != 0xD0 + marker_count % 8)
+            return false;                       // lost a marker, let the decoder resync
+        marker_count++;
+        uint64_t mcus = static_cast<uint64_t>(marker_count) * hdr.restart_interval;
+        if(marker_count % 8 == 0 && mcus % mcus_per_row == 0 && mcus / mcus_per_row < mcu_rows)
+        {
+            cuts.push_back(Cut{ static_cast<uint>(mcus / mcus_per_row), static_cast<uint>(p - in) });
+        }
+        p += 2;
+    }
+    if(cuts.empty())
+        return false;
+
+    // spread the stripes evenly over the rows, using the cut closest to each target row
+    const uint stripe_target = std::min(max_stripes, mcu_rows);
+    auto distance = [](uint row, uint target) { return row > target ? row - target : target - row; };
+    chosen.clear();
+    size_t next = 0;
+    for(uint i = 1; i < stripe_target && next < cuts.size(); i++)
+    {
+        uint target_row = static_cast<uint>(static_cast<uint64_t>(i) * mcu_rows / stripe_target);
+        while(next + 1 < cuts.size() &&
+              distance(cuts[next + 1].mcu_row, target_row) <= distance(cuts[next].mcu_row, target_row))
+            next++;
+        chosen.push_back(cuts[next++]);
+    }
+    if(chosen.empty())
+        return false;
+
+    prefix_count = frame_chunk_count - 1;
+    for(uint i = 0; i < prefix_count; i++)
+        prefix[i] = frame_chunks[i];
+
+    // the frame header after SOI, patched per stripe
+    header_size = hdr.scan_offset - 2;
+    headers.resize(static_cast<size_t>(header_size) * (chosen.size() + 1));
+
+    uint first_mcu_row = 0;
+    const byte *data = scan;
+    for(size_t i = 0; i <= chosen.size(); i++)
+    {
+        Stripe stripe;
+        stripe.first_row = first_mcu_row * hdr.mcu_height;
+        stripe.data = data;
+        if(i < chosen.size())
+        {
+            stripe.rows = (chosen[i].mcu_row - first_mcu_row) * hdr.mcu_height;
+            stripe.size = static_cast<uint>(in + chosen[i].marker - data);
+            first_mcu_row = chosen[i].mcu_row;
+            data = in + chosen[i].marker + 2;
+        }
+        else
+        {
+            stripe.rows = height - stripe.first_row;
+            stripe.size = static_cast<uint>(scan_end - data);
+        }
+        stripes.push_back(stripe);
+
+        byte *header = headers.data() + i * header_size;
+        memcpy(header, in + 2, header_size);
+        header[hdr.sof_height_offset - 2] = static_cast<byte>(stripe.rows >> 8);
+        header[hdr.sof_height_offset - 1] = static_cast<byte>(stripe.rows & 0xFF);
+    }
+    return true;
+}
+
+unsigned int MjpegStripes::chunks(uint index, JpegChunk *out) const
+{
+    uint count = 0;
+    for(uint i = 0; i < prefix_count; i++)
+        out[count++] = prefix[i];
+    out[count++] = JpegChunk{ headers.data() + static_cast<size_t>(index) * header_size, header_size };
+    out[count++] = JpegChunk{ stripes[index].data, stripes[index].size };
+    out[count++] = JpegChunk{ eoi, sizeof(eoi) };
+    return count;
+}
@@ -0,0 +1,158 @@
+#ifndef MJPEG_DECODER_H
+#define MJPEG_DECODER_H
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "mjpeg2jpeg.h"
+
+
+/** @brief Pixel layout the decoder writes */
+enum class PixelFormat
+{
+    RGB,    // 3 bytes per pixel
+    RGBX,   // 4 bytes per pixel, the 4th byte is 0xFF (R8G8B8A8 textures)
+    BGRX,   // 4 bytes per pixel, the 4th byte is 0xFF (B8G8R8A8 textures)
+    YUV422P // planar YCbCr 4:2:2 (full range, as stored in the JPEG): a Y plane of pitch bytes per
+            // row, then the Cb and Cr planes of pitch / 2 bytes per row and full height
+};
+
+/** @brief Bytes per pixel of the (first) plane */
+inline unsigned int bytesPerPixel(PixelFormat format)
+{
+    switch(format)
+    {
+    case PixelFormat::RGB:      return 3;
+    case PixelFormat::YUV422P:  return 1;
+    default:                    return 4;
+    }
+}
+
+/** @brief Smallest pitch of a YUV422P frame: the planes are written in whole MCUs of 16 pixels */
+inline unsigned int planarPitch(unsigned int width)
+{
+    return (width + 15) / 16 * 16;
+}
+
+/** @brief Offset of plane 0 (Y), 1 (Cb) or 2 (Cr) of a YUV422P frame */
+inline size_t planeOffset(unsigned int pitch, unsigned int height, unsigned int plane)
+{
+    return plane == 0 ? 0 : static_cast<size_t>(pitch) * height + (plane - 1) * static_cast<size_t>(pitch / 2) * height;
+}
+
+/** @brief Size of a frame, pitch being the bytes per row of the (first) plane */
+inline size_t frameBytes(PixelFormat format, unsigned int pitch, unsigned int height)
+{
+    return format == PixelFormat::YUV422P ? planeOffset(pitch, height, 3) : static_cast<size_t>(pitch) * height;
+}
+
+/** @brief A MJPEG frame cut into horizontal stripes at its restart markers.
+ * A stripe starts on an MCU row right after a RST7 marker, so the decoder expects RST0 next just
+ * like at the start of a scan. Each stripe is then a JPEG image of its own: the frame header with
+ * the SOF height patched to the stripe height, the entropy-coded data of the stripe and an EOI.
+ * The data of the stripes still points into the V4L2 buffer, only the headers are copied.
+ */
+class MjpegStripes
+{
+    using uint = unsigned int;
+public:
+    struct Stripe
+    {
+        uint        first_row;
+        uint        rows;
+        const byte *data;   // entropy-coded data, without the RST marker closing the stripe
+        uint        size;
+    };
+
+    /** @brief Find the restart markers of a frame and choose the stripes
+     * @param max_stripes   upper bound of the stripe count
+     * @return false when the frame can not be split into 2 stripes or more (no DRI, progressive,
+     *         restart interval not aligned to MCU rows, ...), the frame is decoded in one piece then
+     */
+    bool split(const byte *in, uint in_size, uint width, uint height, uint max_stripes);
+
+    uint count() const { return static_cast<uint>(stripes.size()); }
+    uint height() const { return frame_height; }
+    const Stripe &stripe(uint index) const { return stripes[index]; }
+
+    /** @brief The chunks of the JPEG stream of a stripe, returns the chunk count */
+    uint chunks(uint index, JpegChunk *out) const;
+
+private:
+    JpegChunk               prefix[MJPEG_MAX_CHUNKS];   // JFIF header and DHT segment if missing
+    uint                    prefix_count = 0;
+    std::vector<byte>       headers;                    // header_size bytes per stripe
+    uint                    header_size = 0;
+    std::vector<Stripe>     stripes;
+    uint                    frame_height = 0;
+
+    struct Cut
+    {
+        uint    mcu_row;    // first MCU row after the marker
+        uint    marker;     // offset of the RST7 marker in the frame
+    };
+    std::vector<Cut>        cuts;                       // every place a stripe may start at
+    std::vector<Cut>        chosen;
+};
+
+/* The most chunks of the JPEG stream of one stripe */
+constexpr unsigned int MJPEG_MAX_STRIPE_CHUNKS = MJPEG_MAX_CHUNKS + 2;
+
+
+/** @brief This class decodes the MJPEG frames of a V4L2 camera with libjpeg(-turbo).
+ * The frame is fed to the decoder as a chain of chunks (JFIF header, DHT segment and the
+ * untouched V4L2 buffer) through a custom source manager, so the compressed frame is never
+ * copied into an intermediate JPEG buffer.
+ * The decompressor context is created once and reused for every frame.
+ */
+class MjpegDecoder
+{
+    using uint = unsigned int;
+    using uchar = unsigned char;
+public:
+    MjpegDecoder();
+    ~MjpegDecoder();
+
+    MjpegDecoder(const MjpegDecoder&) = delete;
+    MjpegDecoder& operator=(const MjpegDecoder&) = delete;
+
+    /** @brief Decode a MJPEG frame captured by V4L2
+     * @param in        the MJPEG frame (mmap'd V4L2 buffer)
+     * @param in_size   the size of the frame in bytes
+     * @param dst       destination of the image
+     * @param width     expected image width, the frame is rejected if it differs
+     * @param height    expected image height, the frame is rejected if it differs
+     * @param pitch     bytes per row of dst
+     * @param format    pixel layout written to dst, the 4 byte layouts are written by the color
+     *                  converter of libjpeg-turbo without an extra pass. YUV422P skips the color
+     *                  conversion and the upsampling, the planes come straight out of the IDCT
+     *                  (4:2:2 frames as they are, the chroma rows of 4:2:0 frames are doubled)
+     * @return true/false
+     */
+    bool decodeMJPEG(const byte *in, uint in_size, uchar *dst, uint width, uint height, uint pitch,
+                     PixelFormat format = PixelFormat::RGB);
+
+    /** @brief Decode a JPEG stream given as chunks
+     */
+    bool decode(const JpegChunk *chunks, uint chunk_count, uchar *dst, uint width, uint height, uint pitch,
+                PixelFormat format = PixelFormat::RGB);
+
+    /** @brief Decode one stripe of a split frame
+     * @param dst       destination of the whole frame, only the rows of the stripe are written
+     */
+    bool decodeStripe(const MjpegStripes &frame, uint index, uchar *dst, uint width, uint pitch,
+                      PixelFormat format = PixelFormat::RGB);
+
+    /** @brief Whether the linked libjpeg can write the format directly (the 4 byte layouts need
+     * the colorspace extensions of libjpeg-turbo)
+     */
+    static bool supports(PixelFormat format);
+
+private:
+    /* Decode rows first_row.. of a frame of frame_height rows, height being the rows in the stream */
+    bool decodeRows(const JpegChunk *chunks, uint chunk_count, uchar *dst, uint width, uint height, uint pitch,
+                    PixelFormat format, uint first_row, uint frame_height);
+
+    struct Context;
+    std::unique_ptr<Context> ctx;
+};
+#endif  // MJPEG_DECODER_H
@@ -0,0 +1,288 @@
+#ifndef PRESENT_SCHEDULER_H
+#define PRESENT_SCHEDULER_H
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+
+/** @brief Decides when the render loop submits a frame, from the display clock and the camera
+ * frame clocks.
+ *
+ * The display clock is learned from present completion times (the moment a presented image
+ * reached the screen, e.g. vkWaitForPresentKHR returning). The loop only presents when a camera
+ * delivered, so most intervals span several refreshes: each interval is divided by its count of
+ * refreshes, counted against the nominal period (the refresh rate of the monitor mode), which
+ * keeps a 30 fps stream from locking the estimate on a subharmonic. The period is locked to the
+ * median of the recent per-refresh intervals, then tracked with a narrow exponential filter;
+ * completions off the grid by more than the gate are jitter and ignored. Until samples arrive, or
+ * if the display reports none, the period is the nominal one.
+ *
+ * A frame is submitted submit_ahead_us before the vblank it targets (plus the measured jitter), at
+ * most one frame per vblank. Waiting until that deadline only pays off if a newer camera frame
+ * becomes ready before it, so the camera frame clocks (the times new frames were seen by the
+ * render loop) are tracked per stream too: when no stream is expected to deliver before the
+ * deadline, the frame at hand is submitted at once.
+ *
+ * The class reads no clock, every time is passed in (microseconds on CLOCK_MONOTONIC), so it runs
+ * against a simulated clock as well (main.cpp --present-sim). Not thread-safe.
+ */
+class PresentScheduler
+{
+public:
+    struct Config
+    {
+        double   nominal_period_us = 16667;     // refresh period until measured
+        double   submit_ahead_us = 2000;        // submit this long before the target vblank
+        double   min_period_us = 2000;          // plausible refresh periods (500 Hz .. 20 Hz)
+        double   max_period_us = 50000;
+    };
+
+    struct Stats
+    {
+        double   period_us = 0;             // refresh period, measured or nominal
+        double   jitter_us = 0;             // mean deviation of the present completions from the grid
+        bool     measured = false;          // period locked on present completions
+        uint64_t samples = 0;               // present completions accepted
+        uint64_t rejected = 0;              // present completions off the grid
+        uint64_t relocks = 0;               // period re-acquired from the interval history
+        uint64_t repeated = 0;              // refreshes between two completions that showed the old image
+    };
+
+    PresentScheduler() : PresentScheduler(Config()) {}
+    explicit PresentScheduler(const Config &config) : config(config)
+    {
+        statistics.period_us = config.nominal_period_us;
+    }
+
+    /** @brief Refresh period reported by the display (monitor mode), used until measured */
+    void setNominalPeriod(double period_us)
+    {
+        if(period_us < config.min_period_us || period_us > config.max_period_us)
+            return;
+        config.nominal_period_us = period_us;
+        if(!statistics.measured)
+            statistics.period_us = period_us;
+    }
+
+    void setSubmitAhead(double ahead_us) { config.submit_ahead_us = ahead_us; }
+
+    /** @brief A presented image reached the screen at time_us (on a vblank) */
+    void onPresentComplete(uint64_t time_us)
+    {
+        if(last_complete_us != 0 && time_us > last_complete_us)
+            updatePeriod(static_cast<double>(time_us - last_complete_us));
+        updatePhase(time_us);
+        last_complete_us = time_us;
+    }
+
+    /** @brief The display gives no completion times: the vblank grid is anchored on the return of
+     * the first present call and runs on the nominal period, its phase to the real vblanks is not
+     * known
+     */
+    void onPresentReturned(uint64_t time_us)
+    {
+        if(vblank_us == 0)
+            vblank_us = static_cast<double>(time_us);
+    }
+
+    /** @brief The render loop saw a new frame of a stream at time_us */
+    void onFrameReady(int stream, uint64_t time_us)
+    {
+        if(stream < 0)
+            return;
+        if(static_cast<size_t>(stream) >= cameras.size())
+            cameras.resize(stream + 1);
+        Camera &camera = cameras[stream];
+        if(camera.last_us != 0 && time_us > camera.last_us)
+        {
+            double interval = static_cast<double>(time_us - camera.last_us);
+            if(camera.period_us == 0)
+                camera.period_us = interval;
+            else if(interval < camera.period_us * 1.5)   // a gap (lost frames) is not a period
+                camera.period_us += (interval - camera.period_us) * CAMERA_GAIN;
+        }
+        camera.last_us = std::max(camera.last_us, time_us);
+    }
+
+    /** @brief When to submit the frame at hand
+     * @return the submit deadline of the next vblank no frame was submitted for, or now_us if no
+     *         newer camera frame is expected before that deadline
+     */
+    uint64_t submitTimeUs(uint64_t now_us) const
+    {
+        uint64_t deadline = deadlineUs(now_us);
+        uint64_t next_frame = nextFrameUs(now_us);
+        if(next_frame == 0 || next_frame <= deadline)
+            return deadline;
+        return now_us;
+    }
+
+    /** @brief Account a submit at time_us, the frame targets the vblank of its deadline */
+    void onSubmit(uint64_t time_us)
+    {
+        target_vblank_us = targetVblankUs(time_us);
+    }
+
+    /** @brief The next vblank after time_us predicted on the grid */
+    double nextVblankUs(uint64_t time_us) const
+    {
+        const double period = statistics.period_us;
+        const double t = static_cast<double>(time_us);
+        if(vblank_us == 0)
+            return t + period;
+        return vblank_us + (std::floor((t - vblank_us) / period) + 1) * period;
+    }
+
+    const Stats& stats() const { return statistics; }
+
+    /** @brief Forget the grid and the camera clocks (e.g. swapchain recreated, window moved to
+     * another monitor), the counters stay
+     */
+    void reset()
+    {
+        last_complete_us = 0;
+        vblank_us = 0;
+        target_vblank_us = 0;
+        rejected_in_row = 0;
+        history.clear();
+        cameras.clear();
+        statistics.measured = false;
+        statistics.period_us = config.nominal_period_us;
+        statistics.jitter_us = 0;
+    }
+
+private:
+    struct Camera
+    {
+        uint64_t last_us = 0;
+        double   period_us = 0;
+    };
+
+    static constexpr double PERIOD_GAIN = 1.0 / 32;    // the refresh clock is stable, filter hard
+    static constexpr double PHASE_GAIN = 1.0 / 4;
+    static constexpr double JITTER_GAIN = 1.0 / 16;
+    static constexpr double CAMERA_GAIN = 1.0 / 16;
+    static constexpr int    MAX_SKIPPED = 8;            // longer intervals are pauses, not repeated refreshes
+    static constexpr int    RELOCK_AFTER = 8;           // rejected samples in a row before re-acquiring
+    static constexpr size_t HISTORY = 16;
+    static constexpr size_t LOCK_SAMPLES = 5;
+
+    /** deviation from the grid still accepted as jitter */
+    double gate() const
+    {
+        double period = statistics.period_us;
+        return std::min(std::max(4 * statistics.jitter_us, period * 0.05), period * 0.25);
+    }
+
+    void updatePeriod(double interval)
+    {
+        double &period = statistics.period_us;
+        if(interval >= config.min_period_us && interval <= config.max_period_us * MAX_SKIPPED)
+        {
+            history.push_back(interval);
+            if(history.size() > HISTORY)
+                history.erase(history.begin());
+        }
+
+        double vblanks = std::round(interval / period);
+        double error = interval - vblanks * period;
+        if(statistics.measured && vblanks >= 1 && vblanks <= MAX_SKIPPED && std::fabs(error) <= gate())
+        {
+            period += error / vblanks * PERIOD_GAIN;
+            statistics.jitter_us += (std::fabs(error) - statistics.jitter_us) * JITTER_GAIN;
+            statistics.repeated += static_cast<uint64_t>(vblanks) - 1;
+            statistics.samples++;
+            rejected_in_row = 0;
+            return;
+        }
+        if(statistics.measured)
+            statistics.rejected++;
+
+        // not locked yet, or the grid is lost (e.g. the refresh rate changed): lock on the median
+        // of the recent intervals, which missed vblanks and outliers do not move as long as they
+        // are fewer than half
+        if(!statistics.measured || ++rejected_in_row >= RELOCK_AFTER)
+        {
+            if(history.size() < LOCK_SAMPLES)
+                return;
+            std::vector<double> sorted;
+            for(double h : history)
+                sorted.push_back(h / std::max(std::round(h / config.nominal_period_us), 1.0));
+            std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+            double median = sorted[sorted.size() / 2];
+            if(median < config.min_period_us || median > config.max_period_us)
+                return;
+            if(statistics.measured)
+                statistics.relocks++;
+            period = median;
+            statistics.measured = true;
+            statistics.jitter_us = 0;
+            rejected_in_row = 0;
+            history.clear();
+        }
+    }
+
+    void updatePhase(uint64_t time_us)
+    {
+        const double period = statistics.period_us;
+        const double t = static_cast<double>(time_us);
+        if(vblank_us == 0)
+        {
+            vblank_us = t;
+            return;
+        }
+        double predicted = vblank_us + std::round((t - vblank_us) / period) * period;
+        double error = t - predicted;
+        // a completion far off the grid re-anchors it (the grid is off after a relock or a pause)
+        vblank_us = std::fabs(error) <= gate() ? predicted + error * PHASE_GAIN : t;
+    }
+
+    /** the vblank a frame submitted at time_us makes: the first one at least submit ahead away */
+    double targetVblankUs(uint64_t time_us) const
+    {
+        double ahead = config.submit_ahead_us + 2 * statistics.jitter_us;
+        double vblank = nextVblankUs(time_us);
+        while(vblank - ahead < static_cast<double>(time_us))
+            vblank += statistics.period_us;
+        return vblank;
+    }
+
+    uint64_t deadlineUs(uint64_t now_us) const
+    {
+        double ahead = config.submit_ahead_us + 2 * statistics.jitter_us;
+        double vblank = targetVblankUs(now_us);
+        // one frame per vblank: the vblank of the last submit is taken (FIFO would queue behind it)
+        while(target_vblank_us != 0 && vblank < target_vblank_us + statistics.period_us / 2)
+            vblank += statistics.period_us;
+        return static_cast<uint64_t>(std::max(vblank - ahead, static_cast<double>(now_us)));
+    }
+
+    /** the earliest predicted arrival of a new camera frame after now_us, 0 if no clock is known */
+    uint64_t nextFrameUs(uint64_t now_us) const
+    {
+        uint64_t next = 0;
+        for(const Camera &camera : cameras)
+        {
+            if(camera.period_us <= 0 || camera.last_us == 0)
+                continue;
+            double t = static_cast<double>(camera.last_us) + camera.period_us;
+            if(t < static_cast<double>(now_us))    // late or lost: it may arrive any moment
+                t = static_cast<double>(now_us);
+            uint64_t arrival = static_cast<uint64_t>(t);
+            if(next == 0 || arrival < next)
+                next = arrival;
+        }
+        return next;
+    }
+
+    Config   config;
+    Stats    statistics;
+    uint64_t last_complete_us = 0;
+    double   vblank_us = 0;             // a vblank on the grid, 0 until the first completion
+    double   target_vblank_us = 0;      // the vblank targeted by the last submit
+    int      rejected_in_row = 0;
+    std::vector<double> history;        // recent completion intervals for (re-)locking
+    std::vector<Camera> cameras;
+};
+#endif  // PRESENT_SCHEDULER_H
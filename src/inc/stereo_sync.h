@@ -0,0 +1,234 @@
+#ifndef STEREO_SYNC_H
+#define STEREO_SYNC_H
+#include <cstdint>
+#include <cmath>
+#include <utility>
+
+
+/** @brief Pairs the frames of two free-running cameras (left = eye 0, right = eye 1) by capture
+ * time, so that the two eyes shown together were exposed at the same instant.
+ *
+ * Frames are pushed in the order they finish decoding, with the capture timestamps of the driver
+ * (both cameras on the same clock, CLOCK_MONOTONIC for uvcvideo). A frame is paired with the frame
+ * of the other eye captured within window_us of it. Each eye holds at most one frame waiting for
+ * its partner, and a frame is dropped at once when the other camera's period predicts no partner
+ * inside the window, so pairing adds at most one frame of latency. When an eye has not been
+ * published for lost_us (the other camera stopped, or the phase of two free-running cameras slid
+ * out of the window), its frames pass through alone instead of freezing the display.
+ *
+ * The phase offset between the cameras (right capture time minus the nearest left one) and its
+ * drift (the frame clocks of two cameras never run at exactly the same rate, so the phase slides
+ * over time) are estimated from every right frame, paired or not, and reported in Stats.
+ *
+ * The class only sees the timestamps it is given and reads no clock, so recorded timestamp streams
+ * can be replayed through it (main.cpp --stereo-replay). Not thread-safe, the caller serializes
+ * push() and stats().
+ */
+template <typename T>
+class StereoSync
+{
+public:
+    struct Config
+    {
+        uint64_t window_us = 2000;      // max capture time difference of a pair
+        uint64_t lost_us = 500000;      // silence after which an eye counts as lost
+    };
+
+    struct Stats
+    {
+        uint64_t matched = 0;           // pairs published
+        uint64_t unmatched[2] = {0, 0}; // frames dropped without a partner, per eye
+        uint64_t passed[2] = {0, 0};    // frames published alone while the other eye was lost
+        double   phase_us = 0;          // right minus nearest left capture time, filtered
+        double   drift_ppm = 0;         // change of the phase per time, filtered
+        double   period_us[2] = {0, 0}; // frame interval of each eye, filtered
+    };
+
+    enum Result
+    {
+        NONE = 0,   // nothing to publish (the frame waits or was dropped)
+        PAIR,       // out[0] and out[1] are a matched pair
+        SINGLE      // out[eye] passes through alone, the other eye is lost
+    };
+
+    explicit StereoSync(const Config &config = Config()) : config(config) {}
+
+    /** @brief Offer the next frame of an eye
+     * @param eye           0 = left, 1 = right
+     * @param timestamp_us  capture time of the frame
+     * @param out           receives the frames to publish, left in out[0] and right in out[1]
+     */
+    Result push(int eye, uint64_t timestamp_us, T frame, T out[2])
+    {
+        const int other = 1 - eye;
+        updatePeriod(eye, timestamp_us);
+        if(eye == 1)
+            updatePhase(timestamp_us);
+
+        // the partner may already be waiting
+        if(pending[other].valid)
+        {
+            Pending &p = pending[other];
+            uint64_t delta = timestamp_us > p.timestamp_us ? timestamp_us - p.timestamp_us : p.timestamp_us - timestamp_us;
+            if(delta <= config.window_us)
+            {
+                out[eye] = std::move(frame);
+                out[other] = std::move(p.frame);
+                published_us[eye] = timestamp_us;
+                published_us[other] = p.timestamp_us;
+                p = Pending();
+                dropPending(eye);   // an older frame of this eye lost its chance
+                statistics.matched++;
+                return PAIR;
+            }
+            if(p.timestamp_us > timestamp_us)
+            {
+                // the other eye is already past this frame, no later frame of it can match
+                statistics.unmatched[eye]++;
+                return NONE;
+            }
+            // the waiting frame is older than this one by more than the window, it never matches
+            dropPending(other);
+        }
+
+        // the other camera is silent, or no pair was found for too long: show this eye alone rather
+        // than freezing it
+        if(last_us[other] == 0 || timestamp_us > last_us[other] + config.lost_us ||
+           timestamp_us > published_us[eye] + config.lost_us)
+        {
+            dropPending(eye);
+            out[eye] = std::move(frame);
+            out[other] = T();
+            published_us[eye] = timestamp_us;
+            statistics.passed[eye]++;
+            return SINGLE;
+        }
+
+        // the next frame of the other eye is predicted outside the window: drop instead of waiting
+        if(statistics.period_us[other] > 0)
+        {
+            const double period = statistics.period_us[other];
+            const double earliest = static_cast<double>(timestamp_us) - config.window_us;
+            double next_us = static_cast<double>(last_us[other]) + period;
+            if(next_us < earliest)
+                next_us += std::ceil((earliest - next_us) / period) * period;
+            if(next_us > static_cast<double>(timestamp_us + config.window_us))
+            {
+                statistics.unmatched[eye]++;
+                return NONE;
+            }
+        }
+
+        // wait for the partner, replacing an older waiting frame of this eye
+        dropPending(eye);
+        pending[eye].valid = true;
+        pending[eye].timestamp_us = timestamp_us;
+        pending[eye].frame = std::move(frame);
+        return NONE;
+    }
+
+    const Stats& stats() const { return statistics; }
+
+    /** @brief Drop the waiting frames and the estimates, e.g. after a camera reconnected */
+    void reset()
+    {
+        pending[0] = Pending();
+        pending[1] = Pending();
+        last_us[0] = last_us[1] = 0;
+        published_us[0] = published_us[1] = 0;
+        phase_valid = false;
+        drift_base_us = 0;
+        drift_measured = false;
+        Stats cleared;
+        cleared.matched = statistics.matched;
+        for(int i = 0; i < 2; i++)
+        {
+            cleared.unmatched[i] = statistics.unmatched[i];
+            cleared.passed[i] = statistics.passed[i];
+        }
+        statistics = cleared;
+    }
+
+private:
+    struct Pending
+    {
+        bool     valid = false;
+        uint64_t timestamp_us = 0;
+        T        frame = T();
+    };
+
+    static constexpr double FILTER_GAIN = 1.0 / 16;        // exponential filter of the estimates
+    static constexpr uint64_t DRIFT_BASE_US = 1000000;      // time base of a drift measurement
+
+    void dropPending(int eye)
+    {
+        if(!pending[eye].valid)
+            return;
+        pending[eye] = Pending();
+        statistics.unmatched[eye]++;
+    }
+
+    void updatePeriod(int eye, uint64_t timestamp_us)
+    {
+        // intervals across a gap (lost frames, reconnect) are skipped, they are not a period
+        if(last_us[eye] != 0 && timestamp_us > last_us[eye])
+        {
+            double interval = static_cast<double>(timestamp_us - last_us[eye]);
+            double &period = statistics.period_us[eye];
+            if(period == 0)
+                period = interval;
+            else if(interval < period * 1.5)
+                period += (interval - period) * FILTER_GAIN;
+        }
+        if(published_us[eye] == 0)
+            published_us[eye] = timestamp_us;   // the lost_us grace period starts with the first frame
+        if(timestamp_us > last_us[eye])
+            last_us[eye] = timestamp_us;
+    }
+
+    void updatePhase(uint64_t right_us)
+    {
+        // phase to the last left frame, unwrapped by whole left periods against the estimate so the
+        // estimate keeps sliding continuously when the drift carries it across a frame boundary
+        const double period = statistics.period_us[0];
+        if(last_us[0] == 0 || period <= 0)
+            return;
+        double phase = static_cast<double>(right_us) - static_cast<double>(last_us[0]);
+        if(!phase_valid)
+        {
+            phase_unwrapped_us = phase;
+            phase_valid = true;
+        }
+        phase += std::round((phase_unwrapped_us - phase) / period) * period;
+        phase_unwrapped_us += (phase - phase_unwrapped_us) * FILTER_GAIN;
+        statistics.phase_us = phase_unwrapped_us - std::round(phase_unwrapped_us / period) * period;
+
+        // the capture jitter of single frames is far larger than the drift between them, so the drift
+        // is measured on the filtered phase over at least DRIFT_BASE_US
+        if(drift_base_us == 0)
+        {
+            drift_base_us = right_us;
+            drift_base_phase_us = phase_unwrapped_us;
+        }
+        else if(right_us >= drift_base_us + DRIFT_BASE_US)
+        {
+            double drift = (phase_unwrapped_us - drift_base_phase_us) / static_cast<double>(right_us - drift_base_us) * 1e6;
+            statistics.drift_ppm = drift_measured ? statistics.drift_ppm + (drift - statistics.drift_ppm) * 0.25 : drift;
+            drift_measured = true;
+            drift_base_us = right_us;
+            drift_base_phase_us = phase_unwrapped_us;
+        }
+    }
+
+    Config   config;
+    Stats    statistics;
+    Pending  pending[2];
+    uint64_t last_us[2] = {0, 0};       // capture time of the last frame pushed per eye
+    uint64_t published_us[2] = {0, 0};  // capture time of the last frame published per eye
+    bool     phase_valid = false;
+    double   phase_unwrapped_us = 0;    // filtered phase, not wrapped into one period
+    uint64_t drift_base_us = 0;         // right capture time where the current drift measurement started
+    double   drift_base_phase_us = 0;
+    bool     drift_measured = false;
+};
+#endif  // STEREO_SYNC_H
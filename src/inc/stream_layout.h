@@ -0,0 +1,55 @@
+#ifndef STREAM_LAYOUT_H
+#define STREAM_LAYOUT_H
+#include <cmath>
+
+
+/** @brief Columns and rows the streams are tiled in */
+struct StreamGrid
+{
+    int columns = 0;
+    int rows = 0;
+};
+
+/** @brief Where a stream is drawn, in pixels of the render target from its top left corner */
+struct StreamCell
+{
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+/** @brief Grid count streams are tiled in.
+ * One or two streams sit side by side (the stereo split), more are laid out row by row on the
+ * smallest near-square grid, the last row may be short.
+ */
+inline StreamGrid streamGrid(int count)
+{
+    StreamGrid grid;
+    if(count <= 0)
+        return grid;
+    grid.columns = count <= 2 ? count : static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+    grid.rows = (count + grid.columns - 1) / grid.columns;
+    return grid;
+}
+
+/** @brief Cell of stream index when count streams are tiled over a width x height render target,
+ * the cells cover the target without gaps
+ */
+inline StreamCell streamCell(int index, int count, int width, int height)
+{
+    StreamCell cell;
+    if(count <= 0 || index < 0 || index >= count)
+        return cell;
+
+    StreamGrid grid = streamGrid(count);
+    int column = index % grid.columns;
+    int row = index / grid.columns;
+
+    cell.x = width * column / grid.columns;
+    cell.y = height * row / grid.rows;
+    cell.width = width * (column + 1) / grid.columns - cell.x;
+    cell.height = height * (row + 1) / grid.rows - cell.y;
+    return cell;
+}
+#endif  // STREAM_LAYOUT_H
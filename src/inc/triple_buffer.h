@@ -0,0 +1,75 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+#include <atomic>
+#include <cstdint>
+
+
+/** @brief Lock-free triple buffer, a mailbox always holding the latest value.
+ * One producer and one consumer. The producer fills back() and publish()es it, which swaps the
+ * back slot with the middle slot; the consumer fetch()es, which swaps the middle slot with its
+ * front slot when a newer value was published. The three slots are never shared, so the producer
+ * never blocks or overwrites what the consumer reads, and the consumer always gets the newest
+ * complete value. Values the consumer skipped are handed back to the producer in the back slot.
+ * Use one TripleBuffer per consumer.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() = default;
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    /** @brief The slot the producer writes, owned by the producer until publish() */
+    T& back() { return slots[back_index]; }
+
+    /** @brief Hand back() over to the consumer, back() is then the oldest slot (a value the
+     * consumer skipped or already released)
+     */
+    void publish()
+    {
+        uint8_t old = middle.exchange(static_cast<uint8_t>(back_index | FRESH), std::memory_order_acq_rel);
+        back_index = old & INDEX_MASK;
+    }
+
+    /** @brief Take the newest published value into front() if there is one
+     * @return true if front() changed
+     */
+    bool fetch()
+    {
+        if((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+            return false;
+        uint8_t old = middle.exchange(front_index, std::memory_order_acq_rel);
+        front_index = old & INDEX_MASK;
+        return true;
+    }
+
+    /** @brief Whether a value newer than front() is waiting, may be called from any thread */
+    bool hasNew() const { return (middle.load(std::memory_order_acquire) & FRESH) != 0; }
+
+    /** @brief The slot the consumer reads, owned by the consumer until the next fetch() */
+    T& front() { return slots[front_index]; }
+
+    /** @brief Reset every slot, only while neither side is running */
+    void clear()
+    {
+        for(T &slot : slots)
+            slot = T();
+        middle.store(MIDDLE_INDEX, std::memory_order_relaxed);
+        back_index = BACK_INDEX;
+        front_index = FRONT_INDEX;
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH = 0x4;     // the middle slot holds a value not fetched yet
+    static constexpr uint8_t BACK_INDEX = 0;
+    static constexpr uint8_t MIDDLE_INDEX = 1;
+    static constexpr uint8_t FRONT_INDEX = 2;
+
+    T slots[3];
+    alignas(64) std::atomic<uint8_t> middle{MIDDLE_INDEX};  // index of the middle slot | FRESH
+    alignas(64) uint8_t back_index = BACK_INDEX;            // producer only
+    alignas(64) uint8_t front_index = FRONT_INDEX;          // consumer only
+};
+#endif  // TRIPLE_BUFFER_H
@@ -1,9 +1,9 @@
 #include "v4l2_capture.h"
-#include "mjpeg2jpeg.h"
 #include <poll.h>
-#include <turbojpeg.h>
 #include <iostream>
 #include <cstring>
+#include <cmath>
+#include <algorithm>
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 #define MJPG_FORMAT_VALUE 1196444237
@@ -84,23 +84,30 @@ namespace
 V4L2Capture::V4L2Capture(uint width, uint height, uint buffer_count/* = 3 */)
     : cameraFd(-1)
     , buffer_mmap_ptr(nullptr)
-    , decode_buffer(nullptr)
     , buffer_count(buffer_count)
     , frame_width(width)
     , frame_height(height)
     , fps(60)
     , sharpness(3)
+    , stream_generation(0)
+    , decode_pitch(width * 3)
+    , decode_format(PixelFormat::RGB)
+    , drain_to_newest(false)
+    , skipped_total(0)
+    , frame_interval_us(1000000 / 60)
 {
-    decode_buffer = new uchar[frame_width * frame_height * 3];
-    jpeg_buffer = new uchar[frame_width * frame_height * 3];
+    // each V4L2 buffer owns a decode buffer, so a lent frame keeps its pixels until re-queued
+    decode_buffers.resize(buffer_count);
+    for(uint i = 0; i < buffer_count; i++)
+        decode_buffers[i] = new uchar[frame_width * frame_height * 3];
     CLEAR(device_name);
 }
 
 V4L2Capture::~V4L2Capture()
 {
     closeDevice();
-    delete [] decode_buffer;
-    delete [] jpeg_buffer;
+    for(uchar *buffer : decode_buffers)
+        delete [] buffer;
 }
 
 bool V4L2Capture::openDevice(int index)
@@ -158,7 +165,8 @@ bool V4L2Capture::openDevice(const char* device_name)
 
     resetDevice();
     // open the device and return a new file descriptor for it, or -1 on error.
-    cameraFd = open(device_name, O_RDWR, 0); // | O_NONBLOCK
+    // non-blocking, readiness is waited for with select()/epoll and VIDIOC_DQBUF never blocks
+    cameraFd = open(device_name, O_RDWR | O_NONBLOCK, 0);
     if(cameraFd == -1)
     {
         std::cout<< "Cannot open device: " << device_name << ", " << errno << ", " << strerror(errno) << std::endl;
@@ -256,6 +264,13 @@ void V4L2Capture::ioctlSetStreamParm()
     // get the set fps
     ioctl(cameraFd, VIDIOC_G_PARM, &streamparm);
     std::cout << "Capture Mode: " << streamparm.parm.capture.capturemode << "\nFrame Rate: " << streamparm.parm.capture.timeperframe.numerator << "/" << streamparm.parm.capture.timeperframe.denominator << std::endl;
+
+    // the negotiated interval paces the consumers, not the fps we asked for
+    const v4l2_fract &tpf = streamparm.parm.capture.timeperframe;
+    if(tpf.numerator > 0 && tpf.denominator > 0)
+        frame_interval_us = static_cast<uint>(1000000ull * tpf.numerator / tpf.denominator);
+    else if(fps > 0)
+        frame_interval_us = 1000000 / fps;
 }
 
 void V4L2Capture::ioctlSetStreamFmt()
@@ -279,12 +294,26 @@ void V4L2Capture::ioctlSetStreamFmt()
 
     if(xioctl(cameraFd, VIDIOC_S_FMT, &format) == -1)
         errno_exit("VIDIOC_S_FMT");
-    if(format.fmt.pix.width != frame_width)
-        std::cout << "Device reset width to " << frame_width << std::endl;
-    if(format.fmt.pix.height != frame_height)
-        std::cout << "Device reset height to " << frame_height << std::endl;
     if(format.fmt.pix.pixelformat != V4L2_PIX_FMT_MJPEG)
         errno_exit("VIDIOC_S_FMT: Unable to set V4L2_PIX_FMT_MJPEG");
+
+    // use the geometry the driver negotiated, consumers size their textures from width()/height()
+    if(format.fmt.pix.width != frame_width || format.fmt.pix.height != frame_height)
+    {
+        std::cout << "Device reset the frame size to " << format.fmt.pix.width << "x"
+                  << format.fmt.pix.height << std::endl;
+        frame_width = format.fmt.pix.width;
+        frame_height = format.fmt.pix.height;
+        // only reached on the first negotiation (a reset keeps the size), so no frame is lent out
+        // yet; targets sized for the requested format no longer fit (initDevice holds mtx)
+        for(uchar *&buffer : decode_buffers)
+        {
+            delete [] buffer;
+            buffer = new uchar[frame_width * frame_height * 3];
+        }
+        decode_targets.clear();
+        decode_pitch = decode_format == PixelFormat::YUV422P ? planarPitch(frame_width) : frame_width * 3;
+    }
 }
 
 void V4L2Capture::ioctlSetSharpnessParm()
@@ -352,9 +381,47 @@ void V4L2Capture::ioctlQueueBuffers()
     }
 }
 
-bool V4L2Capture::ioctlDequeueBuffers(unsigned char* data)
+V4L2Capture::Frame V4L2Capture::dequeueFrame()
 {
     std::lock_guard<std::mutex> lck(mtx);
+    Frame frame = dequeueBuffer();
+    if(!frame)
+        return frame;
+
+    //GET_CURRENT_TIME(start);
+    bool decompress_mjpeg_success = processImage(frame);
+    //GET_CURRENT_TIME(end);
+    //decompress_time = ::std::chrono::duration_cast<::std::chrono::milliseconds>(end - start).count();
+
+    if(!decompress_mjpeg_success)
+    {
+        // nothing to lend, put the buffer room back to queue right away
+        frame.release();
+    }
+    return frame;
+}
+
+V4L2Capture::Frame V4L2Capture::dequeueRawFrame()
+{
+    std::lock_guard<std::mutex> lck(mtx);
+    return dequeueBuffer();
+}
+
+V4L2Capture::Frame V4L2Capture::tryDequeueRawFrame()
+{
+    std::lock_guard<std::mutex> lck(mtx);
+    return takeBuffer();
+}
+
+V4L2Capture::Frame V4L2Capture::dequeueBuffer()
+{
+    if(!waitForBuffer())
+        return Frame();
+    return takeBuffer();
+}
+
+bool V4L2Capture::waitForBuffer()
+{
     if(cameraFd < 0)
         return false;
 
@@ -396,6 +463,14 @@ bool V4L2Capture::ioctlDequeueBuffers(unsigned char* data)
     if(EINTR == err)
         return false;
 
+    return true;
+}
+
+V4L2Capture::Frame V4L2Capture::takeBuffer()
+{
+    if(cameraFd < 0)
+        return Frame();
+
     v4l2_buffer vbuffer;
     CLEAR(vbuffer);
     vbuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -407,30 +482,232 @@ bool V4L2Capture::ioctlDequeueBuffers(unsigned char* data)
         switch(errno)
         {
         case EAGAIN:
+            return Frame();     // no filled buffer yet
         case EIO:
         default:
             errno_exit("VIDIOC_DQBUF");
-            return false;
+            return Frame();
+        }
+    }
+
+    const uint64_t dequeue_us = monotonicNowUs();
+
+    uint skipped = 0;
+    if(drain_to_newest)
+    {
+        // take every buffer the driver has filled meanwhile (until EAGAIN), only the newest one is
+        // worth decoding
+        v4l2_buffer newer;
+        while(true)
+        {
+            CLEAR(newer);
+            newer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            newer.memory = V4L2_MEMORY_MMAP;
+            if(xioctl(cameraFd, VIDIOC_DQBUF, &newer) == -1)
+                break;
+
+            if(xioctl(cameraFd, VIDIOC_QBUF, &vbuffer) == -1)
+                errno_exit("VIDIOC_QBUF");
+            vbuffer = newer;
+            skipped++;
         }
+        skipped_total.fetch_add(skipped, std::memory_order_relaxed);
+    }
+
+    // bytesused is the size of the MJPEG payload, length is the size of the whole buffer room
+    uint payload_size = vbuffer.bytesused > 0 ? vbuffer.bytesused : vbuffer.length;
+    if(payload_size == 0)
+    {
+        // nothing to lend, put the buffer room back to queue right away
+        if(xioctl(cameraFd, VIDIOC_QBUF, &vbuffer) == -1)
+            errno_exit("VIDIOC_QBUF");
+        return Frame();
     }
 
-    bool decompress_mjpeg_success = false;
-    if(vbuffer.length > 0)
+    // the buffer room is re-queued by the frame once the consumer is done with it
+    Frame frame;
+    frame.owner = this;
+    frame.index = vbuffer.index;
+    frame.generation = stream_generation;
+    frame.decoded = decode_targets.empty() ? decode_buffers[vbuffer.index] : decode_targets[vbuffer.index];
+    frame.frame_pitch = decode_pitch;
+    frame.frame_format = decode_format;
+    frame.payload = static_cast<const uchar*>(buffer_mmap_ptr[vbuffer.index].addr);
+    frame.payload_size = payload_size;
+    frame.frame_width = frame_width;
+    frame.frame_height = frame_height;
+    frame.skipped_frames = skipped;
+    frame.timestamp_us = static_cast<uint64_t>(vbuffer.timestamp.tv_sec) * 1000000 + vbuffer.timestamp.tv_usec;
+    frame.timestamp_monotonic = (vbuffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+    frame.frame_sequence = vbuffer.sequence;
+    frame.frame_timing.capture_us = frame.timestamp_monotonic ? frame.timestamp_us : 0;
+    frame.frame_timing.sequence = vbuffer.sequence;
+    frame.frame_timing.dequeue_us = dequeue_us;
+    updatePacing(vbuffer, frame.timestamp_us, frame.timestamp_monotonic, dequeue_us);
+    return frame;
+}
+
+void V4L2Capture::updatePacing(const v4l2_buffer &vbuffer, uint64_t timestamp_us, bool monotonic, uint64_t dequeue_us)
+{
+    std::lock_guard<std::mutex> lck(pacing_mtx);
+    if(pacing.frames > 0)
     {
-        //GET_CURRENT_TIME(start);
-        decompress_mjpeg_success = processImage(buffer_mmap_ptr[vbuffer.index].addr, vbuffer.length, data);
+        // skipped frames were dequeued as well, a gap in the sequence is a frame the driver lost
+        if(vbuffer.sequence > pacing.last_sequence + 1)
+            pacing.lost += vbuffer.sequence - pacing.last_sequence - 1;
+
+        // interval per frame of the sensor clock, drained frames included
+        uint steps = vbuffer.sequence > pacing.last_sequence ? vbuffer.sequence - pacing.last_sequence : 1;
+        if(timestamp_us > pacing.last_timestamp_us)
+        {
+            double interval = static_cast<double>(timestamp_us - pacing.last_timestamp_us) / steps;
+            pacing.intervals++;
+            pacing.interval_sum += interval;
+            pacing.interval_sq_sum += interval * interval;
+        }
+    }
+    pacing.frames++;
+    pacing.last_sequence = vbuffer.sequence;
+    pacing.last_timestamp_us = timestamp_us;
 
-        //GET_CURRENT_TIME(end);
-        //decompress_time = ::std::chrono::duration_cast<::std::chrono::milliseconds>(end - start).count();
+    if(monotonic && dequeue_us >= timestamp_us)
+    {
+        uint64_t latency = dequeue_us - timestamp_us;
+        pacing.latencies++;
+        pacing.latency_sum += latency;
+        pacing.latency_sq_sum += static_cast<double>(latency) * latency;
+        pacing.latency_max = std::max(pacing.latency_max, latency);
     }
+}
+
+V4L2Capture::PacingStats V4L2Capture::pacingStats() const
+{
+    auto deviation = [](double sum, double sq_sum, uint64_t n) {
+        if(n < 2)
+            return 0.0;
+        double mean = sum / n;
+        return std::sqrt(std::max(0.0, sq_sum / n - mean * mean));
+    };
+
+    std::lock_guard<std::mutex> lck(pacing_mtx);
+    PacingStats stats;
+    stats.frames = pacing.frames;
+    stats.lost = pacing.lost;
+    stats.nominal_interval_us = frame_interval_us;
+    if(pacing.intervals > 0)
+    {
+        stats.interval_us_avg = pacing.interval_sum / pacing.intervals;
+        stats.interval_jitter_us = deviation(pacing.interval_sum, pacing.interval_sq_sum, pacing.intervals);
+    }
+    if(pacing.latencies > 0)
+    {
+        stats.latency_us_avg = pacing.latency_sum / pacing.latencies;
+        stats.latency_jitter_us = deviation(pacing.latency_sum, pacing.latency_sq_sum, pacing.latencies);
+    }
+    stats.latency_us_max = pacing.latency_max;
+    return stats;
+}
+
+bool V4L2Capture::setDecodeTargets(const std::vector<uchar*> &targets, uint pitch, PixelFormat format)
+{
+    std::lock_guard<std::mutex> lck(mtx);
+    if(targets.empty())
+    {
+        // the internal buffers hold a tight RGB frame, the planar layout needs its rows padded to MCUs
+        uint internal_pitch = format == PixelFormat::YUV422P ? planarPitch(frame_width) : frame_width * 3;
+        if((format != PixelFormat::RGB && format != PixelFormat::YUV422P) ||
+           frameBytes(format, internal_pitch, frame_height) > static_cast<size_t>(frame_width) * frame_height * 3)
+        {
+            std::cout << "V4L2Capture::setDecodeTargets: the internal buffers can not hold the format\n";
+            return false;
+        }
+        decode_targets.clear();
+        decode_pitch = internal_pitch;
+        decode_format = format;
+        return true;
+    }
+
+    if(targets.size() != buffer_count || pitch < frame_width * bytesPerPixel(format) ||
+       !MjpegDecoder::supports(format))
+    {
+        std::cout << "V4L2Capture::setDecodeTargets: " << targets.size() << " target(s) of pitch " << pitch
+                  << " do not fit " << buffer_count << " buffer(s) of " << frame_width << " pixels\n";
+        return false;
+    }
+
+    // the next dequeue of every V4L2 buffer lends its target, frames lent out keep their buffer
+    decode_targets = targets;
+    decode_pitch = pitch;
+    decode_format = format;
+    return true;
+}
+
+bool V4L2Capture::ioctlDequeueBuffers(unsigned char* data)
+{
+    Frame frame = dequeueFrame();
+    if(!frame)
+        return false;
+
+    memcpy(data, frame.data(), frameBytes(frame.format(), frame.pitch(), frame.height()));
+    return true;
+}
+
+void V4L2Capture::requeueBuffer(uint index, uint generation)
+{
+    // VIDIOC_QBUF is serialized by the driver, the capture mutex is not taken here since the
+    // dequeuing thread may hold it while waiting in select()
+    if(cameraFd < 0 || generation != stream_generation)
+        return;
+
+    v4l2_buffer vbuffer;
+    CLEAR(vbuffer);
+    vbuffer.index = index;
+    vbuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    vbuffer.memory = V4L2_MEMORY_MMAP;
 
     // put the buffer room back to queue to achieve a loop for data capturing
     if(xioctl(cameraFd, VIDIOC_QBUF, &vbuffer) == -1)
-        errno_exit("VIDIOC_DBUF");
+        errno_exit("VIDIOC_QBUF");
+}
+
+V4L2Capture::Frame& V4L2Capture::Frame::operator=(Frame&& other) noexcept
+{
+    if(this != &other)
+    {
+        release();
+        owner = other.owner;
+        index = other.index;
+        generation = other.generation;
+        decoded = other.decoded;
+        payload = other.payload;
+        payload_size = other.payload_size;
+        frame_width = other.frame_width;
+        frame_height = other.frame_height;
+        frame_pitch = other.frame_pitch;
+        frame_format = other.frame_format;
+        skipped_frames = other.skipped_frames;
+        timestamp_us = other.timestamp_us;
+        timestamp_monotonic = other.timestamp_monotonic;
+        frame_sequence = other.frame_sequence;
+        frame_timing = other.frame_timing;
+        other.owner = nullptr;
+    }
+    return *this;
+}
 
-    return decompress_mjpeg_success;
+void V4L2Capture::Frame::release()
+{
+    if(owner == nullptr)
+        return;
+    owner->requeueBuffer(index, generation);
+    owner = nullptr;
+    decoded = nullptr;
+    payload = nullptr;
+    payload_size = 0;
 }
 
+
+
 void V4L2Capture::ioctlSetStreamSwitch(bool on)
 {
     v4l2_buf_type type;
@@ -453,23 +730,15 @@ void V4L2Capture::unMmapBuffers()
         munmap(buffer_mmap_ptr[i].addr, buffer_mmap_ptr[i].length);
 }
 
-bool V4L2Capture::processImage(const void *p, uint size, unsigned char* data)
+bool V4L2Capture::processImage(Frame &frame)
 {
-    unsigned int jpg_size = 0;
-
-    bool bSuccess = mjpeg2jpeg(static_cast<const byte*>(p), size, jpeg_buffer, frame_width*frame_height * 3, &jpg_size);
-
+    // the image is decoded straight into the decode buffer (or target) lent with the frame.
+    // The JFIF header and DHT segment are chained in front of the mmap'd buffer by the decoder,
+    // the compressed frame itself is never copied.
+    bool bSuccess = decoder.decodeMJPEG(frame.payload, frame.payload_size, frame.decoded,
+                                        frame.frame_width, frame.frame_height, frame.frame_pitch, frame.frame_format);
     if(!bSuccess)
-    {
-        std::cout << "mjpeg2jpeg failed!\n";
-        return false;
-    }
-    bSuccess = decodeJPEG(jpeg_buffer, jpg_size);
-    if(bSuccess)
-    {
-        memcpy(data, decode_buffer, frame_height*frame_width*3*sizeof(unsigned char));
-    }
-    else std::cout << "Jpeg decompression failed!\n";
+        std::cout << "Jpeg decompression failed!\n";
 
     return bSuccess;
 }
@@ -480,23 +749,12 @@ bool V4L2Capture::waitAny(const std::vector<int> &camera_fds, std::vector<int> &
     return V4L2Capture_deviceHandlePoll(camera_fds, ready_index, timeout_ms);
 }
 
-bool V4L2Capture::decodeJPEG(uchar *pcompressed_image, unsigned long jpeg_size)
-{
-    int width, height, jpeg_sub_samp;
-    tjhandle jpeg_decompressor = tjInitDecompress();
-    tjDecompressHeader2(jpeg_decompressor, pcompressed_image, jpeg_size, &width, &height, &jpeg_sub_samp);
-
-    tjDecompress2(jpeg_decompressor, pcompressed_image, jpeg_size, decode_buffer, width, 0/*pitch*/, height, TJPF_RGB, TJFLAG_FASTDCT | TJFLAG_FASTUPSAMPLE);
-
-    tjDestroy(jpeg_decompressor);
-
-    return true;
-}
-
 void V4L2Capture::resetDevice()
 {
     if(cameraFd != -1)
     {
+        // frames still lent out belong to the old stream and must not be re-queued
+        stream_generation++;
         ioctlSetStreamSwitch(false);
         unMmapBuffers();
         delete [] buffer_mmap_ptr;
@@ -13,6 +13,11 @@
 #include <memory>
 #include <vector>
 #include <mutex>
+#include <utility>
+#include <atomic>
+#include <cstdint>
+#include "mjpeg_decoder.h"
+#include "frame_timing.h"
 
 
 /** @brief This class is designed for video capture.
@@ -94,9 +99,154 @@ private:
      */
     void ioctlQueueBuffers();
 public:
-    /** @brief Get frame from output queue
+    /** @brief A decoded frame lent out by V4L2Capture.
+     * The frame borrows the mmap'd V4L2 buffer it was captured into together with the decode
+     * buffer bound to that V4L2 buffer, so the pixels are handed to the consumer without copy.
+     * The V4L2 buffer is put back into the queue (VIDIOC_QBUF) when the frame is released or
+     * destroyed. All frames must be released before the capture is closed or destroyed.
+     */
+    class Frame
+    {
+    public:
+        Frame() = default;
+        ~Frame() { release(); }
+        Frame(Frame&& other) noexcept { *this = std::move(other); }
+        Frame& operator=(Frame&& other) noexcept;
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+
+        explicit operator bool() const { return owner != nullptr; }
+
+        /** @brief Decoded pixels in format(), pitch() bytes per row (the decode buffer or decode
+         * target bound to the V4L2 buffer)
+         */
+        uchar* data() const { return decoded; }
+        /** @brief The untouched MJPEG payload in the mmap'd V4L2 buffer */
+        const uchar* compressed() const { return payload; }
+        uint compressedSize() const { return payload_size; }
+        uint width() const { return frame_width; }
+        uint height() const { return frame_height; }
+        uint pitch() const { return frame_pitch; }
+        PixelFormat format() const { return frame_format; }
+        /** @brief Older frames re-queued undecoded right before this one (drain-to-newest mode) */
+        uint skipped() const { return skipped_frames; }
+        /** @brief Capture time stamped by the driver (v4l2_buffer.timestamp) in microseconds,
+         * on CLOCK_MONOTONIC if timestampIsMonotonic()
+         */
+        uint64_t timestamp() const { return timestamp_us; }
+        bool timestampIsMonotonic() const { return timestamp_monotonic; }
+        /** @brief Frame counter of the driver (v4l2_buffer.sequence) */
+        uint sequence() const { return frame_sequence; }
+        /** @brief Timing record of the frame, filled in by every stage of the pipeline */
+        FrameTiming& timing() { return frame_timing; }
+        const FrameTiming& timing() const { return frame_timing; }
+
+        /** @brief Re-queue the borrowed V4L2 buffer, the frame is empty afterwards */
+        void release();
+
+    private:
+        friend class V4L2Capture;
+        V4L2Capture *owner = nullptr;
+        uint    index = 0;          // index of the borrowed V4L2 buffer
+        uint    generation = 0;     // stream generation the buffer belongs to
+        uchar  *decoded = nullptr;
+        const uchar *payload = nullptr;
+        uint    payload_size = 0;
+        uint    frame_width = 0;
+        uint    frame_height = 0;
+        uint    frame_pitch = 0;
+        PixelFormat frame_format = PixelFormat::RGB;
+        uint    skipped_frames = 0;
+        uint64_t timestamp_us = 0;
+        bool    timestamp_monotonic = false;
+        uint    frame_sequence = 0;
+        FrameTiming frame_timing;
+    };
+
+    /** @brief Get frame from output queue and decode it without copying to the caller
+     * @return the lent frame, or an empty frame on timeout/error
+     */
+    Frame dequeueFrame();
+
+    /** @brief Get frame from output queue without decoding it
+     * Only compressed() is valid until the frame is decoded into data() by the caller, e.g. by
+     * DecodePool, which lets the next dequeue overlap with the decode of this frame.
+     */
+    Frame dequeueRawFrame();
+
+    /** @brief Same as dequeueRawFrame() without waiting, for callers polling the fd themselves
+     * (CaptureReactor). Returns an empty frame if no buffer is filled yet.
+     */
+    Frame tryDequeueRawFrame();
+
+    /** @brief Decode into memory owned by the consumer instead of the internal RGB buffers
+     * E.g. the persistently mapped staging memory of the renderer, so the decoder writes the
+     * pixels the GPU copies from and nothing is converted or copied afterwards. The i-th target is
+     * bound to the i-th V4L2 buffer, and like the internal buffers it is only written while that
+     * V4L2 buffer is lent out: a consumer holding a frame (or its copy in flight) keeps the target.
+     * Frames already lent out keep their old destination. The targets must stay valid until the
+     * decoding has stopped (or the internal buffers are restored by passing no targets).
+     * @param targets   bufferCount() destinations of width x height pixels, or empty to go back
+     *                  to the internal buffers
+     * @param pitch     bytes per row of the targets (of the Y plane for YUV422P), ignored for the
+     *                  internal buffers
+     * @param format    pixel layout to decode into, RGB or YUV422P for the internal buffers
+     * @return false if the targets do not fit or the decoder can not write the format
+     */
+    bool setDecodeTargets(const std::vector<uchar*> &targets, uint pitch, PixelFormat format);
+
+    /** @brief Number of V4L2 buffers (and decode buffers bound to them) */
+    uint bufferCount() const { return buffer_count; }
+
+    /** @brief Frame size negotiated with the device (VIDIOC_S_FMT), the requested size until the
+     * device is opened
+     */
+    uint width() const { return frame_width; }
+    uint height() const { return frame_height; }
+
+    /** @brief Get frame from output queue and copy the decoded pixels into data
+     * data receives pitch() * height() bytes in the current decode format
      */
     bool ioctlDequeueBuffers(unsigned char* data);
+
+    /** @brief Drain-to-newest mode
+     * Once select() reports a filled buffer, every ready buffer is dequeued without blocking and
+     * all but the newest are re-queued undecoded, so the frames that piled up in the driver queue
+     * are skipped instead of being decoded and displayed late.
+     */
+    void setDrainToNewest(bool enable) { drain_to_newest = enable; }
+
+    /** @brief Total count of frames skipped by the drain-to-newest mode */
+    uint64_t skippedFrames() const { return skipped_total.load(std::memory_order_relaxed); }
+
+    /** @brief Frame timing of the stream, measured on the driver timestamps (microseconds) */
+    struct PacingStats
+    {
+        uint64_t frames = 0;
+        uint64_t lost = 0;                  // frames missing in the driver sequence
+        uint    nominal_interval_us = 0;    // negotiated timeperframe
+        double  interval_us_avg = 0;        // between consecutive driver timestamps
+        double  interval_jitter_us = 0;     // standard deviation of the interval
+        double  latency_us_avg = 0;         // driver timestamp to dequeue
+        double  latency_jitter_us = 0;      // standard deviation of the latency
+        uint64_t latency_us_max = 0;
+    };
+
+    /** @brief Frame interval negotiated with the device (VIDIOC_G_PARM timeperframe) in
+     * microseconds, derived from the requested fps if the driver reports none
+     */
+    uint frameInterval() const { return frame_interval_us; }
+
+    PacingStats pacingStats() const;
+
+    /** @brief Wait until one of the cameras has a filled buffer (one-shot poll())
+     * CaptureReactor keeps the fds registered in an epoll set instead of rebuilding the set on
+     * every call.
+     */
+    static bool waitAny(const std::vector<int>& camera_fds, std::vector<int> &ready_index, int64_t timeout_ms);
+
+    /** @brief The (non-blocking) fd of the device, -1 if closed */
+    int getFd() const { return this->cameraFd; }
 private:
     /** @brief Start/stop video capture
      */
@@ -107,11 +257,25 @@ private:
     void unMmapBuffers();
 
 
-    bool processImage(const void *p, uint size, unsigned char* data);
+    /** @brief Decode the payload of a frame into its decode buffer (or target) */
+    bool processImage(Frame &frame);
 
-    static bool waitAny(const std::vector<int>& camera_fds, std::vector<int> &ready_index, int64_t timeout_ms);
+    /** @brief Wait for the next filled buffer and lend it as a frame (mtx must be held)
+     */
+    Frame dequeueBuffer();
+
+    /** @brief Wait up to 1 s until a filled buffer is ready (select())
+     */
+    bool waitForBuffer();
+
+    /** @brief Dequeue a filled buffer without blocking and lend it as a frame (mtx must be held)
+     */
+    Frame takeBuffer();
+
+    /** @brief Put the index-th buffer back into the queue, called when a Frame is released
+     */
+    void requeueBuffer(uint index, uint generation);
 
-    int getFd() { return this->cameraFd; }
 
 
     void setSharpness(uint value)
@@ -128,7 +292,6 @@ private:
     }
 
 private:
-    bool decodeJPEG(uchar* pcompressed_image, long unsigned int jpeg_size);
     void resetDevice();
     bool tryIoctl(unsigned long ioctl_code, void *param, bool fail_if_busy = true, int attempts = 10) const;
 
@@ -143,14 +306,46 @@ private:
     bufferMmap  *buffer_mmap_ptr;
 
     char    device_name[256];
-    uchar  *decode_buffer;
-    uchar  *jpeg_buffer;
+    std::vector<uchar*> decode_buffers;   // one decode buffer bound to each V4L2 buffer (RGB)
+    std::vector<uchar*> decode_targets;   // set by setDecodeTargets(), replaces decode_buffers
     uint    buffer_count;
     uint    frame_width;
     uint    frame_height;
     uint    fps;
     uint    sharpness;
+    uint    stream_generation;  // bumped on every device reset, stale frames are not re-queued
+    uint    decode_pitch;       // pitch and layout of the frames lent from now on
+    PixelFormat decode_format;
+    bool    drain_to_newest;
+    std::atomic<uint64_t> skipped_total;
+    std::atomic<uint> frame_interval_us;
+
+    /* running sums behind PacingStats */
+    struct PacingSums
+    {
+        uint64_t frames = 0;
+        uint64_t lost = 0;
+        uint64_t intervals = 0;
+        double   interval_sum = 0, interval_sq_sum = 0;
+        uint64_t latencies = 0;
+        double   latency_sum = 0, latency_sq_sum = 0;
+        uint64_t latency_max = 0;
+        uint64_t last_timestamp_us = 0;
+        uint     last_sequence = 0;
+    };
+    PacingSums  pacing;
+    mutable std::mutex  pacing_mtx;
+
+    /** @brief Account a dequeued buffer in the pacing statistics */
+    void updatePacing(const v4l2_buffer &vbuffer, uint64_t timestamp_us, bool monotonic, uint64_t dequeue_us);
+
+    MjpegDecoder    decoder;    // persistent decompressor fed straight from the mmap'd buffers
 
     std::mutex      mtx;
 };
+
+/* Frames shared between the capture thread and its consumers, the V4L2 buffer is re-queued when
+   the last reference goes away */
+using FramePtr = std::shared_ptr<V4L2Capture::Frame>;
+
 #endif  // V4L2_CAPTURE_H
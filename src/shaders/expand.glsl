@@ -0,0 +1,45 @@
+#version 450
+
+// 把解码器输出的 3 字节打包 RGB 展开为 RGBA 纹理（代替 CPU 上的颜色扩展）
+// 每个线程处理一个像素：从存储缓冲区中按字节偏移取出跨 1~2 个 32 位字的 3 个字节
+layout(local_size_x = 16, local_size_y = 16) in;
+
+// 输入为 BGR 顺序时交换 R/B（特化常量，创建管线时确定）
+layout(constant_id = 0) const bool SWAP_RED_BLUE = false;
+
+layout(std430, binding = 0) readonly buffer PackedPixels {
+    uint words[];
+};
+
+layout(binding = 1, rgba8) uniform writeonly image2D outImage;
+
+// offset/pitch 以字节计：图像在缓冲区中的起点和每行字节数
+layout(push_constant) uniform ExpandParams {
+    uint offset;
+    uint pitch;
+    uint width;
+    uint height;
+} params;
+
+void main() {
+    uvec2 pixel = gl_GlobalInvocationID.xy;
+    if (pixel.x >= params.width || pixel.y >= params.height) {
+        return;
+    }
+
+    uint byteIndex = params.offset + pixel.y * params.pitch + pixel.x * 3u;
+    uint wordIndex = byteIndex >> 2;
+    uint shift = (byteIndex & 3u) * 8u;
+
+    // 3 个字节从字内第 shift 位开始，shift 为 16/24 时跨到下一个字
+    uint bits = words[wordIndex] >> shift;
+    if (shift > 8u) {
+        bits |= words[wordIndex + 1u] << (32u - shift);
+    }
+
+    vec3 color = vec3(float(bits & 0xFFu), float((bits >> 8) & 0xFFu), float((bits >> 16) & 0xFFu)) / 255.0;
+    if (SWAP_RED_BLUE) {
+        color = color.bgr;
+    }
+    imageStore(outImage, ivec2(pixel), vec4(color, 1.0));
+}
@@ -3,25 +3,28 @@
 layout(location = 0) in vec2 TexCoord;
 layout(location = 0) out vec4 outColor;
 
-// 左眼和右眼纹理采样器
-layout(binding = 0) uniform sampler2D texLeft;
-layout(binding = 1) uniform sampler2D texRight;
+// 纹理为 Y/Cb/Cr 三个 R8 平面时在此转换为 RGB（特化常量，创建管线时确定）
+layout(constant_id = 0) const bool PLANAR_YUV = false;
 
-void main() {
-    vec2 uv = TexCoord;
-    vec4 color;
+// 当前绘制的相机流纹理采样器（平面 YUV 时为 Y 平面，Cb/Cr 平面为半宽，采样时线性插值即完成上采样）
+// 每路流一个描述符集，渲染器逐路设置视口（该路流在窗口中的格子）并绑定对应的集合后绘制
+layout(binding = 0) uniform sampler2D texStream;
+layout(binding = 1) uniform sampler2D texCb;
+layout(binding = 2) uniform sampler2D texCr;
 
-    if (uv.x < 0.5) {
-        // 屏幕左半部分：采样左眼纹理
-        // 将UV坐标从[0, 0.5]映射到[0, 1]
-        vec2 leftUV = vec2(uv.x * 2.0, uv.y);
-        color = texture(texLeft, leftUV);
-    } else {
-        // 屏幕右半部分：采样右眼纹理
-        // 将UV坐标从[0.5, 1.0]映射到[0, 1]
-        vec2 rightUV = vec2((uv.x - 0.5) * 2.0, uv.y);
-        color = texture(texRight, rightUV);
+void main() {
+    // 视口已限定在该路流的格子内，UV坐标[0, 1]直接对应整幅图像
+    if (!PLANAR_YUV) {
+        outColor = texture(texStream, TexCoord);
+        return;
     }
 
-    outColor = color;
-}
\ No newline at end of file
+    // JPEG 的 YCbCr 为全范围 BT.601
+    float y = texture(texStream, TexCoord).r;
+    float cb = texture(texCb, TexCoord).r - 128.0 / 255.0;
+    float cr = texture(texCr, TexCoord).r - 128.0 / 255.0;
+    outColor = vec4(y + 1.402 * cr,
+                    y - 0.344136 * cb - 0.714136 * cr,
+                    y + 1.772 * cb,
+                    1.0);
+}